@@ -0,0 +1,221 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "Benchmark.h"
+#include "CommandLine.h"
+#include "SIMD.h"
+
+// Runs the kernel and scene benchmarks, e.g.
+//
+//   Benchmark --filter scene --json results.json
+//   Benchmark --json new.json --baseline old.json --tolerance 0.05
+//
+// With --baseline, every result is compared with the one of the same name
+// in the given file, and the exit code is 1 if any got slower by more than
+// the tolerance (a fraction; 0.1 by default).
+
+namespace
+{
+	volatile float floatSink;
+	volatile int intSink;
+
+	std::string EscapeJson(const std::string& text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				escaped += '\\';
+			}
+
+			escaped += c;
+		}
+
+		return escaped;
+	}
+
+	// The value after "key": on a line written by WriteJson
+	bool FindJsonValue(const std::string& line, const std::string& key, std::string& value)
+	{
+		std::string pattern = "\"" + key + "\": ";
+		size_t start = line.find(pattern);
+		if (start == std::string::npos)
+		{
+			return false;
+		}
+
+		start += pattern.size();
+		if (line[start] == '"')
+		{
+			size_t end = line.find('"', start + 1);
+			value = line.substr(start + 1, end - start - 1);
+		}
+		else
+		{
+			size_t end = line.find_first_of(",}", start);
+			value = line.substr(start, end - start);
+		}
+
+		return true;
+	}
+
+	int CompareWithBaseline(const std::vector<BenchmarkResult>& results, const std::vector<BenchmarkResult>& baseline, double tolerance)
+	{
+		int regressionCount = 0;
+
+		for (const auto& result : results)
+		{
+			for (const auto& old : baseline)
+			{
+				if (old.name != result.name || old.itemsPerSecond <= 0.0)
+				{
+					continue;
+				}
+
+				double change = result.itemsPerSecond / old.itemsPerSecond - 1.0;
+				bool isRegression = change < -tolerance;
+				regressionCount += isRegression ? 1 : 0;
+				printf("%-40s %+7.1f%%%s\n", result.name.c_str(), change * 100.0, isRegression ? "  REGRESSION" : "");
+			}
+		}
+
+		return regressionCount;
+	}
+}
+
+void DoNotOptimize(float value) { floatSink = value; }
+void DoNotOptimize(int value) { intSink = value; }
+
+void BenchmarkSuite::Add(const std::string& name, const std::string& unit, Batch batch)
+{
+	entries.push_back(Entry{ name, unit, batch });
+}
+
+std::vector<BenchmarkResult> BenchmarkSuite::Run() const
+{
+	std::vector<BenchmarkResult> results;
+
+	for (const auto& entry : entries)
+	{
+		if (entry.name.find(options.filter) == std::string::npos)
+		{
+			continue;
+		}
+
+		BenchmarkResult best{ entry.name, entry.unit, 0.0, 0, 0.0 };
+		int trialCount = options.isQuick ? 1 : options.trialCount;
+
+		for (int trial = 0; trial < trialCount; ++trial)
+		{
+			int64_t items = 0;
+			double seconds = 0.0;
+			auto start = std::chrono::steady_clock::now();
+
+			do
+			{
+				items += entry.batch();
+				seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			} while (!options.isQuick && seconds < options.minSeconds);
+
+			double rate = seconds > 0.0 ? items / seconds : 0.0;
+			if (rate > best.itemsPerSecond)
+			{
+				best = BenchmarkResult{ entry.name, entry.unit, rate, items, seconds };
+			}
+		}
+
+		printf("%-40s %10.2f M %s/s\n", best.name.c_str(), best.itemsPerSecond / 1e6, best.unit.c_str());
+		fflush(stdout);
+		results.push_back(best);
+	}
+
+	return results;
+}
+
+void WriteJson(const std::vector<BenchmarkResult>& results, std::ostream& stream)
+{
+	stream << "{\n  \"backend\": \"" << SimdBackendName() << "\",\n  \"results\": [\n";
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const auto& result = results[i];
+		stream << "    {\"name\": \"" << EscapeJson(result.name) << "\", \"unit\": \"" << EscapeJson(result.unit)
+			   << "\", \"itemsPerSecond\": " << result.itemsPerSecond << ", \"items\": " << result.items
+			   << ", \"seconds\": " << result.seconds << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	stream << "  ]\n}\n";
+}
+
+bool ReadJson(const std::string& path, std::vector<BenchmarkResult>& results)
+{
+	std::ifstream stream(path);
+	if (!stream)
+	{
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(stream, line))
+	{
+		BenchmarkResult result{};
+		std::string rate;
+		if (FindJsonValue(line, "name", result.name) && FindJsonValue(line, "itemsPerSecond", rate))
+		{
+			FindJsonValue(line, "unit", result.unit);
+			result.itemsPerSecond = std::stod(rate);
+			results.push_back(result);
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	CommandLine commandLine(argc, argv);
+
+	BenchmarkOptions options;
+	options.filter = commandLine.GetString("filter", options.filter);
+	options.minSeconds = commandLine.GetFloat("min-time", (float)options.minSeconds);
+	options.trialCount = commandLine.GetInt("trials", options.trialCount);
+	options.isQuick = commandLine.Has("quick");
+
+	printf("%s backend\n", SimdBackendName());
+
+	BenchmarkSuite suite(options);
+	AddKernelBenchmarks(suite);
+	AddSceneBenchmarks(suite);
+	auto results = suite.Run();
+
+	std::string jsonPath = commandLine.GetString("json", "");
+	if (!jsonPath.empty())
+	{
+		std::ofstream jsonFile(jsonPath);
+		WriteJson(results, jsonFile);
+		if (!jsonFile)
+		{
+			std::cout << "Failed to write '" << jsonPath << "'" << std::endl;
+			return 1;
+		}
+	}
+
+	std::string baselinePath = commandLine.GetString("baseline", "");
+	if (!baselinePath.empty())
+	{
+		std::vector<BenchmarkResult> baseline;
+		if (!ReadJson(baselinePath, baseline))
+		{
+			std::cout << "Can't read baseline '" << baselinePath << "'" << std::endl;
+			return 1;
+		}
+
+		std::cout << "Compared with " << baselinePath << ":" << std::endl;
+		return CompareWithBaseline(results, baseline, commandLine.GetFloat("tolerance", 0.1f)) > 0 ? 1 : 0;
+	}
+
+	return 0;
+}
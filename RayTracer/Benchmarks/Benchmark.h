@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// A small benchmark harness. A benchmark is a function that does one
+// batch of work and returns how many items (rays, triangle tests,
+// samples, ...) it processed; the harness repeats it until minSeconds
+// have passed, several times over, and keeps the best rate.
+
+struct BenchmarkResult
+{
+	std::string name;
+	std::string unit;		// what an "item" is, e.g. "rays"
+	double itemsPerSecond;
+	int64_t items;
+	double seconds;
+};
+
+struct BenchmarkOptions
+{
+	std::string filter;				// only run benchmarks whose name contains this
+	double minSeconds = 0.2;		// per trial
+	int trialCount = 5;				// the best trial is reported
+	bool isQuick = false;			// one batch each, smaller scenes; for smoke tests
+};
+
+class BenchmarkSuite
+{
+public:
+	typedef std::function<int64_t()> Batch;
+
+	explicit BenchmarkSuite(const BenchmarkOptions& options) : options{ options } {}
+
+	void Add(const std::string& name, const std::string& unit, Batch batch);
+
+	// Scene benchmarks want to know whether they should keep things small
+	bool IsQuick() const { return options.isQuick; }
+
+	// Runs the benchmarks that pass the filter, printing each result
+	std::vector<BenchmarkResult> Run() const;
+
+private:
+	struct Entry
+	{
+		std::string name;
+		std::string unit;
+		Batch batch;
+	};
+
+	std::vector<Entry> entries;
+	BenchmarkOptions options;
+};
+
+// Keeps a computed value alive, so the optimizer can't drop the work that
+// produced it
+void DoNotOptimize(float value);
+void DoNotOptimize(int value);
+
+void AddKernelBenchmarks(BenchmarkSuite& suite);
+void AddSceneBenchmarks(BenchmarkSuite& suite);
+
+// JSON: {"backend": ..., "results": [{"name", "unit", "itemsPerSecond", "items", "seconds"}, ...]}
+void WriteJson(const std::vector<BenchmarkResult>& results, std::ostream& stream);
+
+// Reads results back from WriteJson's output; false if the file can't be read
+bool ReadJson(const std::string& path, std::vector<BenchmarkResult>& results);
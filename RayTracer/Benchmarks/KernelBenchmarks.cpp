@@ -0,0 +1,476 @@
+#include <memory>
+#include <vector>
+#include "Benchmark.h"
+#include "Camera.h"
+#include "Hitable.h"
+#include "Material.h"
+#include "PrimitiveStore.h"
+#include "SampleSequence.h"
+#include "Sampler.h"
+
+// Microbenchmarks of the hot kernels, each on a fixed, seeded set of inputs.
+// Rates are per primitive test, per ray, per scatter or per random number.
+
+// Keeps the kernel below out of line, like the one in TriangleKernel.cpp,
+// so that neither gets its per-ray setup hoisted out of the leaf loop
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+namespace
+{
+	const int RAY_COUNT = 4096;
+	const int TRIANGLE_COUNT = 4096;
+	const int LEAF_SIZE = 8;
+
+	// The previous layout and kernel: vertex, edges and normal as twelve
+	// SoA arrays, with the cross products and reciprocal done per test.
+	struct EdgeStore
+	{
+		std::vector<float> aX, aY, aZ, abX, abY, abZ, acX, acY, acZ, normalX, normalY, normalZ;
+
+		void Add(const Vec3& a, const Vec3& b, const Vec3& c)
+		{
+			Vec3 ab = b - a;
+			Vec3 ac = c - a;
+			Vec3 n = ab.Cross(ac).Normalize();
+			aX.push_back(a.x()); aY.push_back(a.y()); aZ.push_back(a.z());
+			abX.push_back(ab.x()); abY.push_back(ab.y()); abZ.push_back(ab.z());
+			acX.push_back(ac.x()); acY.push_back(ac.y()); acZ.push_back(ac.z());
+			normalX.push_back(n.x()); normalY.push_back(n.y()); normalZ.push_back(n.z());
+		}
+
+		void Pad()
+		{
+			for (auto array : { &aX, &aY, &aZ, &abX, &abY, &abZ, &acX, &acY, &acZ, &normalX, &normalY, &normalZ })
+			{
+				array->resize(array->size() + SIMD_WIDTH - 1, 0.0f);
+			}
+		}
+
+		BENCH_NOINLINE int IntersectRange(int first, int count, const Ray& ray, bool ignoreBackFaces, float& tMax) const
+		{
+			const SimdFloat zero = SimdFloat::Splat(0.0f);
+			const SimdFloat one = SimdFloat::Splat(1.0f);
+			const SimdFloat epsilon = SimdFloat::Splat(EPSILON);
+			const SimdFloat minusEpsilon = SimdFloat::Splat(-EPSILON);
+			const SimdFloat maxDistance = SimdFloat::Splat(1.0f / EPSILON);
+			const SimdFloat laneIndices = SimdFloat::LaneIndices();
+
+			const SimdFloat dx = SimdFloat::Splat(ray.Direction().x());
+			const SimdFloat dy = SimdFloat::Splat(ray.Direction().y());
+			const SimdFloat dz = SimdFloat::Splat(ray.Direction().z());
+			const SimdFloat ox = SimdFloat::Splat(ray.Origin().x());
+			const SimdFloat oy = SimdFloat::Splat(ray.Origin().y());
+			const SimdFloat oz = SimdFloat::Splat(ray.Origin().z());
+
+			int closest = -1;
+
+			for (int base = first; base < first + count; base += SIMD_WIDTH)
+			{
+				SimdMask active = laneIndices < SimdFloat::Splat((float)(first + count - base));
+
+				const SimdFloat acx = SimdFloat::Load(&acX[base]);
+				const SimdFloat acy = SimdFloat::Load(&acY[base]);
+				const SimdFloat acz = SimdFloat::Load(&acZ[base]);
+				const SimdFloat abx = SimdFloat::Load(&abX[base]);
+				const SimdFloat aby = SimdFloat::Load(&abY[base]);
+				const SimdFloat abz = SimdFloat::Load(&abZ[base]);
+
+				if (ignoreBackFaces)
+				{
+					SimdFloat facing = dx * SimdFloat::Load(&normalX[base]) +
+									   dy * SimdFloat::Load(&normalY[base]) +
+									   dz * SimdFloat::Load(&normalZ[base]);
+					active = AndNot(active, facing > zero);
+				}
+
+				SimdFloat rxacX = dy * acz - dz * acy;
+				SimdFloat rxacY = dz * acx - dx * acz;
+				SimdFloat rxacZ = dx * acy - dy * acx;
+
+				SimdFloat a = abx * rxacX + aby * rxacY + abz * rxacZ;
+				active = AndNot(active, (a > minusEpsilon) & (a < epsilon));
+
+				SimdFloat f = one / a;
+				SimdFloat sx = ox - SimdFloat::Load(&aX[base]);
+				SimdFloat sy = oy - SimdFloat::Load(&aY[base]);
+				SimdFloat sz = oz - SimdFloat::Load(&aZ[base]);
+				SimdFloat u = f * (sx * rxacX + sy * rxacY + sz * rxacZ);
+
+				SimdFloat qx = sy * abz - sz * aby;
+				SimdFloat qy = sz * abx - sx * abz;
+				SimdFloat qz = sx * aby - sy * abx;
+				SimdFloat v = f * (dx * qx + dy * qy + dz * qz);
+
+				active = active & (u >= zero) & (u <= one) & (v >= zero) & (u + v <= one);
+
+				SimdFloat t = f * (acx * qx + acy * qy + acz * qz);
+				active = active & (t > epsilon) & (t < maxDistance) & (t < SimdFloat::Splat(tMax));
+
+				if (!active.Any())
+				{
+					continue;
+				}
+
+				float distances[SIMD_WIDTH];
+				t.Store(distances);
+				int hitLanes = active.Bits();
+
+				for (int lane = 0; lane < SIMD_WIDTH; ++lane)
+				{
+					if ((hitLanes & (1 << lane)) && distances[lane] < tMax)
+					{
+						tMax = distances[lane];
+						closest = base + lane;
+					}
+				}
+			}
+
+			return closest;
+		}
+	};
+
+	Vec3 RandomPoint(Pcg32& rng)
+	{
+		return Vec3(rng.NextFloat() * 10.0f - 5.0f, rng.NextFloat() * 10.0f - 5.0f, rng.NextFloat() * 10.0f + 2.0f);
+	}
+
+	// Rays from the origin into the box RandomPoint() fills
+	std::vector<Ray> MakeRays(Pcg32& rng)
+	{
+		std::vector<Ray> rays;
+		for (int i = 0; i < RAY_COUNT; ++i)
+		{
+			rays.push_back(Ray(Vec3(), Vec3(rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f, 1.0f)));
+		}
+
+		return rays;
+	}
+
+	struct TriangleScene
+	{
+		std::vector<Ray> rays;
+		std::vector<Triangle> triangles;
+		TriangleStore store;
+		EdgeStore edges;
+	};
+
+	std::shared_ptr<TriangleScene> MakeTriangleScene()
+	{
+		auto scene = std::make_shared<TriangleScene>();
+		Pcg32 rng(1234u, 1u);
+
+		for (int i = 0; i < TRIANGLE_COUNT; ++i)
+		{
+			Vec3 a = RandomPoint(rng);
+			Vec3 b = a + Vec3(rng.NextFloat(), rng.NextFloat(), rng.NextFloat() - 0.5f);
+			Vec3 c = a + Vec3(rng.NextFloat(), -rng.NextFloat(), rng.NextFloat() - 0.5f);
+			scene->triangles.push_back(Triangle(a, b, c, nullptr));
+			scene->store.Add(a, b, c, 0);
+			scene->edges.Add(a, b, c);
+		}
+
+		scene->edges.Pad();
+		scene->rays = MakeRays(rng);
+		return scene;
+	}
+
+	// Every ray against every leaf of LEAF_SIZE triangles, as a BVH
+	// traversal would
+	template <typename Kernel>
+	int64_t IntersectLeaves(const TriangleScene& scene, Kernel kernel)
+	{
+		int hitCount = 0;
+		for (const auto& ray : scene.rays)
+		{
+			for (int first = 0; first < TRIANGLE_COUNT; first += LEAF_SIZE)
+			{
+				float tMax = FLT_MAX;
+				hitCount += kernel(first, LEAF_SIZE, ray, tMax) >= 0 ? 1 : 0;
+			}
+		}
+
+		DoNotOptimize(hitCount);
+		return (int64_t)scene.rays.size() * TRIANGLE_COUNT;
+	}
+
+	void AddTriangleBenchmarks(BenchmarkSuite& suite)
+	{
+		auto scene = MakeTriangleScene();
+
+		// The standalone AHitable, one virtual call per test
+		suite.Add("triangle/raycast", "tests", [scene]()
+		{
+			int hitCount = 0;
+			for (int r = 0; r < RAY_COUNT; r += 16)
+			{
+				for (const auto& triangle : scene->triangles)
+				{
+					HitInfo hit;
+					hitCount += triangle.Raycast(scene->rays[r], OUT hit) ? 1 : 0;
+				}
+			}
+
+			DoNotOptimize(hitCount);
+			return (int64_t)(RAY_COUNT / 16) * TRIANGLE_COUNT;
+		});
+
+		suite.Add("triangle/leaf_scalar", "tests", [scene]()
+		{
+			return IntersectLeaves(*scene, [&](int first, int count, const Ray& ray, float& tMax)
+			{
+				return scene->store.IntersectRangeScalar(first, count, ray, true, tMax);
+			});
+		});
+
+		// The SIMD kernel from before the unit triangle transforms
+		suite.Add("triangle/leaf_moller_trumbore_simd", "tests", [scene]()
+		{
+			return IntersectLeaves(*scene, [&](int first, int count, const Ray& ray, float& tMax)
+			{
+				return scene->edges.IntersectRange(first, count, ray, true, tMax);
+			});
+		});
+
+		suite.Add("triangle/leaf_simd", "tests", [scene]()
+		{
+			return IntersectLeaves(*scene, [&](int first, int count, const Ray& ray, float& tMax)
+			{
+				return scene->store.IntersectRange(first, count, ray, true, tMax);
+			});
+		});
+	}
+
+	void AddSphereBenchmarks(BenchmarkSuite& suite)
+	{
+		struct SphereScene
+		{
+			std::vector<Ray> rays;
+			std::vector<Sphere> spheres;
+			SphereStore store;
+		};
+
+		auto scene = std::make_shared<SphereScene>();
+		Pcg32 rng(99u, 1u);
+		for (int i = 0; i < 256; ++i)
+		{
+			Vec3 origin = RandomPoint(rng);
+			float radius = rng.NextFloat() * 0.5f;
+			scene->spheres.push_back(Sphere(origin, radius, nullptr));
+			scene->store.Add(origin, radius, 0);
+		}
+
+		scene->rays = MakeRays(rng);
+
+		suite.Add("sphere/raycast", "tests", [scene]()
+		{
+			int hitCount = 0;
+			for (const auto& ray : scene->rays)
+			{
+				for (const auto& sphere : scene->spheres)
+				{
+					HitInfo hit;
+					hitCount += sphere.Raycast(ray, OUT hit) ? 1 : 0;
+				}
+			}
+
+			DoNotOptimize(hitCount);
+			return (int64_t)scene->rays.size() * scene->spheres.size();
+		});
+
+		// Leaves of LEAF_SIZE spheres, one at a time and SIMD_WIDTH at a time
+		auto intersectLeaves = [scene](bool isSimd)
+		{
+			int hitCount = 0;
+			for (const auto& ray : scene->rays)
+			{
+				for (int first = 0; first < scene->store.Count(); first += LEAF_SIZE)
+				{
+					float tMax = FLT_MAX;
+					int index = isSimd ? scene->store.IntersectRange(first, LEAF_SIZE, ray, true, tMax)
+									   : scene->store.IntersectRangeScalar(first, LEAF_SIZE, ray, true, tMax);
+					hitCount += index >= 0 ? 1 : 0;
+				}
+			}
+
+			DoNotOptimize(hitCount);
+			return (int64_t)scene->rays.size() * scene->store.Count();
+		};
+
+		suite.Add("sphere/leaf_scalar", "tests", [intersectLeaves]() { return intersectLeaves(false); });
+		suite.Add("sphere/leaf_simd", "tests", [intersectLeaves]() { return intersectLeaves(true); });
+	}
+
+	void AddHitableListBenchmarks(BenchmarkSuite& suite)
+	{
+		struct ListScene
+		{
+			std::vector<Ray> rays;
+			HitableList world;
+		};
+
+		auto scene = std::make_shared<ListScene>();
+		Pcg32 rng(7u, 1u);
+		for (int i = 0; i < 10000; ++i)
+		{
+			Vec3 a = RandomPoint(rng);
+			scene->world.AddTriangle(a, a + Vec3(rng.NextFloat(), rng.NextFloat(), 0.0f) * 0.5f,
+									 a + Vec3(rng.NextFloat(), -rng.NextFloat(), 0.0f) * 0.5f, nullptr);
+			if (i % 10 == 0)
+			{
+				scene->world.AddSphere(RandomPoint(rng), rng.NextFloat() * 0.3f, nullptr);
+			}
+		}
+
+		scene->world.BuildAccelerationStructure();
+		scene->rays = MakeRays(rng);
+
+		suite.Add("hitablelist/raycast", "rays", [scene]()
+		{
+			int hitCount = 0;
+			for (const auto& ray : scene->rays)
+			{
+				HitInfo hit;
+				hitCount += scene->world.Raycast(ray, OUT hit) ? 1 : 0;
+			}
+
+			DoNotOptimize(hitCount);
+			return (int64_t)scene->rays.size();
+		});
+
+		suite.Add("hitablelist/occluded", "rays", [scene]()
+		{
+			int hitCount = 0;
+			for (const auto& ray : scene->rays)
+			{
+				hitCount += scene->world.Occluded(ray, FLT_MAX) ? 1 : 0;
+			}
+
+			DoNotOptimize(hitCount);
+			return (int64_t)scene->rays.size();
+		});
+	}
+
+	void AddCameraBenchmarks(BenchmarkSuite& suite)
+	{
+		suite.Add("camera/get_ray", "rays", []()
+		{
+			Camera camera(Vec3(), 320, 200, 200.0f);
+			float sum = 0.0f;
+			for (int y = 0; y < 200; ++y)
+			{
+				for (int x = 0; x < 320; ++x)
+				{
+					Ray ray = camera.GetRay(x / 320.0f, y / 200.0f);
+					sum += ray.Direction().x() + ray.Direction().y() + ray.Origin().z();
+				}
+			}
+
+			DoNotOptimize(sum);
+			return (int64_t)320 * 200;
+		});
+	}
+
+	void AddMaterialBenchmarks(BenchmarkSuite& suite)
+	{
+		auto diffuse = std::make_shared<DiffuseMaterial>("diffuse", Vec3(0.5f, 0.5f, 0.5f), 0.8f);
+		auto metallic = std::make_shared<MetallicMaterial>("metallic", Vec3(0.7f, 0.7f, 1.0f));
+
+		for (std::shared_ptr<AMaterial> material : { std::shared_ptr<AMaterial>(diffuse), std::shared_ptr<AMaterial>(metallic) })
+		{
+			suite.Add("material/" + material->name + "_scatter", "scatters", [material]()
+			{
+				const int scatterCount = 65536;
+				Sampler sampler(DEFAULT_RENDER_SEED);
+				sampler.StartSample(0, 0);
+
+				HitInfo hit;
+				hit.point = Vec3(0.0f, 0.0f, 2.0f);
+				hit.normal = Vec3(0.0f, 0.0f, -1.0f);
+				hit.distance = 2.0f;
+				hit.materialPtr = material.get();
+
+				Ray ray(Vec3(), Vec3(0.1f, 0.2f, 1.0f));
+				int scatteredCount = 0;
+				for (int i = 0; i < scatterCount; ++i)
+				{
+					Vec3 attenuation;
+					Ray scattered;
+					scatteredCount += material->DoesScatter(ray, hit, sampler, OUT attenuation, OUT scattered) ? 1 : 0;
+				}
+
+				DoNotOptimize(scatteredCount);
+				return (int64_t)scatterCount;
+			});
+		}
+	}
+
+	void AddRandomBenchmarks(BenchmarkSuite& suite)
+	{
+		suite.Add("rng/pcg32", "numbers", []()
+		{
+			const int count = 1 << 20;
+			Pcg32 rng(1u, 1u);
+			float sum = 0.0f;
+			for (int i = 0; i < count; ++i)
+			{
+				sum += rng.NextFloat();
+			}
+
+			DoNotOptimize(sum);
+			return (int64_t)count;
+		});
+
+		// Reseeding per (pixel, sample), as the renderer does
+		suite.Add("rng/sampler_start_sample", "samples", []()
+		{
+			const int count = 1 << 18;
+			Sampler sampler(DEFAULT_RENDER_SEED);
+			float sum = 0.0f;
+			for (int i = 0; i < count; ++i)
+			{
+				sampler.StartSample(i >> 4, i & 15);
+				sum += sampler.Next2D().u;
+			}
+
+			DoNotOptimize(sum);
+			return (int64_t)count;
+		});
+
+		// A camera jitter and one bounce's numbers per sample
+		for (SamplerType type : { SamplerType::Random, SamplerType::Stratified, SamplerType::Halton, SamplerType::Sobol,
+								  SamplerType::BlueNoise })
+		{
+			std::shared_ptr<ASampleSequence> sequence = MakeSampleSequence(type, DEFAULT_RENDER_SEED, 256, 16);
+			suite.Add(std::string("rng/sequence_") + SamplerTypeName(type), "samples", [sequence]()
+			{
+				const int count = 1 << 16;
+				Sampler sampler(DEFAULT_RENDER_SEED, sequence.get());
+				float sum = 0.0f;
+				for (int i = 0; i < count; ++i)
+				{
+					sampler.StartSample(i >> 4, i & 15);
+					sum += sampler.Next2D().u;
+					sampler.StartBounce(1);
+					sum += sampler.Next2D().v + sampler.Next1D() + sampler.Next1D();
+				}
+
+				DoNotOptimize(sum);
+				return (int64_t)count;
+			});
+		}
+	}
+}
+
+void AddKernelBenchmarks(BenchmarkSuite& suite)
+{
+	AddRandomBenchmarks(suite);
+	AddCameraBenchmarks(suite);
+	AddMaterialBenchmarks(suite);
+	AddSphereBenchmarks(suite);
+	AddTriangleBenchmarks(suite);
+	AddHitableListBenchmarks(suite);
+}
@@ -0,0 +1,164 @@
+#include <memory>
+#include "Benchmark.h"
+#include "RayTracer.h"
+
+// End-to-end benchmarks on the demo scene (MakeWorld): ray throughput for
+// primary rays and for whole paths on one thread, and samples per second
+// for full renders on all threads, with each of the renderer's modes. The
+// same, plus build time, on a larger GenerateScene() scene.
+
+namespace
+{
+	struct DemoScene
+	{
+		MaterialStorage materials;
+		MeshStorage meshes;
+		std::unique_ptr<HitableList> world;
+		int width;
+		int height;
+	};
+
+	std::shared_ptr<DemoScene> MakeDemoScene(bool isQuick)
+	{
+		auto scene = std::make_shared<DemoScene>();
+		scene->world = MakeWorld(&scene->materials, &scene->meshes);
+		scene->width = isQuick ? 64 : 320;
+		scene->height = isQuick ? 40 : 200;
+		return scene;
+	}
+
+	// 10k spheres and 200 instances of 8 meshes, 2.5M triangles placed
+	SceneParameters GeneratedSceneParameters(bool isQuick)
+	{
+		SceneParameters parameters;
+		parameters.isGenerated = true;
+		parameters.sphereCount = isQuick ? 100 : 10000;
+		parameters.meshCount = isQuick ? 2 : 8;
+		parameters.meshTriangleCount = isQuick ? 500 : 12500;
+		parameters.instanceCount = isQuick ? 10 : 200;
+		parameters.clusterCount = 16;
+		return parameters;
+	}
+
+	std::shared_ptr<DemoScene> MakeGeneratedScene(bool isQuick)
+	{
+		auto scene = std::make_shared<DemoScene>();
+		scene->world = GenerateScene(GeneratedSceneParameters(isQuick), &scene->materials, &scene->meshes);
+		scene->width = isQuick ? 64 : 320;
+		scene->height = isQuick ? 40 : 200;
+		return scene;
+	}
+
+	void AddPrimaryRayBenchmark(BenchmarkSuite& suite, const std::string& name, std::shared_ptr<DemoScene> scene)
+	{
+		suite.Add(name, "rays", [scene]()
+		{
+			Camera camera = MakeCamera(scene->width, scene->height);
+			int hitCount = 0;
+			for (int y = 0; y < scene->height; ++y)
+			{
+				for (int x = 0; x < scene->width; ++x)
+				{
+					HitInfo hit;
+					Ray ray = camera.GetRay((x + 0.5f) / scene->width, (y + 0.5f) / scene->height);
+					hitCount += scene->world->Raycast(ray, OUT hit) ? 1 : 0;
+				}
+			}
+
+			DoNotOptimize(hitCount);
+			return (int64_t)scene->width * scene->height;
+		});
+	}
+
+	// Follows one path per pixel the way SampleRecursiveWithMaterial does,
+	// counting every ray it casts
+	int64_t TracePaths(const DemoScene& scene, uint32_t frame)
+	{
+		Camera camera = MakeCamera(scene.width, scene.height);
+		Sampler sampler(DEFAULT_RENDER_SEED);
+		int64_t rayCount = 0;
+
+		for (int y = 0; y < scene.height; ++y)
+		{
+			for (int x = 0; x < scene.width; ++x)
+			{
+				sampler.StartSample(y * scene.width + x, frame);
+				Ray ray = camera.GetRay((x + 0.5f) / scene.width, (y + 0.5f) / scene.height);
+
+				for (int depth = 1; depth < DEFAULT_MAX_DEPTH; ++depth)
+				{
+					HitInfo hit;
+					rayCount++;
+					if (!scene.world->Raycast(ray, OUT hit))
+					{
+						break;
+					}
+
+					Vec3 attenuation;
+					Ray scattered;
+					if (!hit.materialPtr->DoesScatter(ray, hit, sampler, OUT attenuation, OUT scattered))
+					{
+						break;
+					}
+
+					ray = scattered;
+				}
+			}
+		}
+
+		return rayCount;
+	}
+}
+
+void AddSceneBenchmarks(BenchmarkSuite& suite)
+{
+	auto scene = MakeDemoScene(suite.IsQuick());
+
+	AddPrimaryRayBenchmark(suite, "scene/primary_rays", scene);
+
+	auto frame = std::make_shared<uint32_t>(0);
+	suite.Add("scene/path_rays", "rays", [scene, frame]()
+	{
+		return TracePaths(*scene, (*frame)++);
+	});
+
+	// All threads, fixed sample count
+	const char* modes[] = { "recursive", "packets", "wavefront" };
+	auto pool = std::make_shared<ThreadPool>(ThreadPool::DefaultThreadCount());
+	for (int mode = 0; mode < 3; ++mode)
+	{
+		suite.Add(std::string("scene/render_") + modes[mode], "samples", [scene, pool, mode]()
+		{
+			RenderSettings renderSettings;
+			renderSettings.width = scene->width;
+			renderSettings.height = scene->height;
+			renderSettings.sampleCount = 4;
+			renderSettings.adaptiveThreshold = 0.0f;
+			renderSettings.usePackets = mode == 1;
+			renderSettings.useWavefront = mode == 2;
+
+			Framebuffer framebuffer(scene->width, scene->height);
+			Renderer renderer(scene->world.get(), MakeCamera(scene->width, scene->height), renderSettings);
+			renderer.Render(*pool, framebuffer);
+			return (int64_t)scene->width * scene->height * renderSettings.sampleCount;
+		});
+	}
+
+	// Rate in placed primitives (spheres and triangles) per second
+	bool isQuick = suite.IsQuick();
+	suite.Add("generated/build", "primitives", [isQuick]()
+	{
+		MaterialStorage materials;
+		MeshStorage meshes;
+		SceneStatistics statistics;
+		GenerateScene(GeneratedSceneParameters(isQuick), &materials, &meshes, OUT &statistics);
+		return (int64_t)(statistics.sphereCount + statistics.instancedTriangleCount);
+	});
+
+	auto generated = MakeGeneratedScene(isQuick);
+	AddPrimaryRayBenchmark(suite, "generated/primary_rays", generated);
+	suite.Add("generated/path_rays", "rays", [generated, frame]()
+	{
+		return TracePaths(*generated, (*frame)++);
+	});
+}
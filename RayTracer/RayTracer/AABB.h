@@ -0,0 +1,66 @@
+#pragma once
+#include <float.h>
+#include "Ray.h"
+
+// Axis aligned bounding box.
+
+struct AABB
+{
+	AABB() : min{ FLT_MAX, FLT_MAX, FLT_MAX }, max{ -FLT_MAX, -FLT_MAX, -FLT_MAX } {}
+	AABB(const Vec3& min, const Vec3& max) : min{ min }, max{ max } {}
+
+	inline void Grow(const Vec3& point)
+	{
+		min = Min(min, point);
+		max = Max(max, point);
+	}
+
+	inline void Grow(const AABB& other)
+	{
+		min = Min(min, other.min);
+		max = Max(max, other.max);
+	}
+
+	inline bool IsEmpty() const { return min.x() > max.x(); }
+	inline Vec3 Centroid() const { return (min + max) * 0.5f; }
+	inline Vec3 Extent() const { return max - min; }
+
+	inline float SurfaceArea() const
+	{
+		if (IsEmpty())
+		{
+			return 0.0f;
+		}
+
+		Vec3 e = Extent();
+		return 2.0f * (e.x() * e.y() + e.y() * e.z() + e.z() * e.x());
+	}
+
+	inline int LongestAxis() const
+	{
+		Vec3 e = Extent();
+		if (e.x() >= e.y() && e.x() >= e.z()) { return 0; }
+		return e.y() >= e.z() ? 1 : 2;
+	}
+
+	// Slab test. "inverseDirection" is 1 / ray.Direction(), computed once
+	// per ray; returns the entry distance in "tEntry" on a hit.
+	inline bool Intersect(const Vec3& origin, const Vec3& inverseDirection, float tMax, float& tEntry) const
+	{
+		float tx0 = (min.x() - origin.x()) * inverseDirection.x();
+		float tx1 = (max.x() - origin.x()) * inverseDirection.x();
+		float ty0 = (min.y() - origin.y()) * inverseDirection.y();
+		float ty1 = (max.y() - origin.y()) * inverseDirection.y();
+		float tz0 = (min.z() - origin.z()) * inverseDirection.z();
+		float tz1 = (max.z() - origin.z()) * inverseDirection.z();
+
+		float tNear = Maxf(Maxf(Minf(tx0, tx1), Minf(ty0, ty1)), Maxf(Minf(tz0, tz1), 0.0f));
+		float tFar = Minf(Minf(Maxf(tx0, tx1), Maxf(ty0, ty1)), Minf(Maxf(tz0, tz1), tMax));
+
+		tEntry = tNear;
+		return tNear <= tFar;
+	}
+
+	Vec3 min;
+	Vec3 max;
+};
@@ -0,0 +1,145 @@
+#include "pch.h"
+#include "Accumulation.h"
+#include "Renderer.h"
+#include "Trace.h"
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace
+{
+	const uint32_t CHECKPOINT_MAGIC = 0x4b435452;		// "RTCK"
+	const uint32_t CHECKPOINT_VERSION = 3;
+
+	struct CheckpointHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		int32_t width;
+		int32_t height;
+		uint64_t seed;
+		int32_t samplerType;
+		int32_t sampleCount;
+	};
+
+	struct PixelRecord
+	{
+		float sum[3];
+		float luminanceMean;
+		float luminanceM2;
+		int32_t samplesTaken;
+	};
+
+	static_assert(sizeof(CheckpointHeader) == 32, "Checkpoint header must not have padding");
+	static_assert(sizeof(PixelRecord) == 24, "Checkpoint pixel records must not have padding");
+}
+
+AccumulationBuffer::AccumulationBuffer(const RenderSettings& settings) :
+	AccumulationBuffer(settings.width, settings.height, settings.seed, settings.samplerType, settings.sampleCount)
+{
+}
+
+uint64_t AccumulationBuffer::TotalSamples() const
+{
+	uint64_t total = 0;
+	for (const auto& estimate : estimates)
+	{
+		total += estimate.samplesTaken;
+	}
+
+	return total;
+}
+
+void AccumulationBuffer::Resolve(Framebuffer& framebuffer) const
+{
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			framebuffer.Set(x, y, At(x, y).Mean());
+		}
+	}
+}
+
+void AccumulationBuffer::ResolveSampleCounts(Framebuffer& framebuffer, int maxSamples) const
+{
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			float level = Minf((float)At(x, y).samplesTaken / (float)maxSamples, 1.0f);
+			framebuffer.Set(x, y, Vec3(level, level, level));
+		}
+	}
+}
+
+bool AccumulationBuffer::SaveCheckpoint(const std::string& path) const
+{
+	TraceScope scope("save checkpoint", "output");
+
+	std::vector<PixelRecord> records(estimates.size());
+	for (size_t i = 0; i < estimates.size(); ++i)
+	{
+		const PixelEstimate& estimate = estimates[i];
+		records[i] = PixelRecord{ { estimate.sum.x(), estimate.sum.y(), estimate.sum.z() },
+								  estimate.luminanceMean, estimate.luminanceM2, estimate.samplesTaken };
+	}
+
+	CheckpointHeader header{ CHECKPOINT_MAGIC, CHECKPOINT_VERSION, width, height, seed, (int32_t)samplerType, sampleCount };
+	std::string temporaryPath = path + ".tmp";
+
+	{
+		std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)records.data(), records.size() * sizeof(PixelRecord));
+		if (!file)
+		{
+			return false;
+		}
+	}
+
+	// std::rename won't replace an existing file on Windows; elsewhere it
+	// does, atomically
+#ifdef _WIN32
+	return MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+}
+
+bool AccumulationBuffer::LoadCheckpoint(const std::string& path)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	CheckpointHeader header;
+
+	if (!file.read((char*)&header, sizeof(header)) ||
+		header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION ||
+		header.width != width || header.height != height || header.samplerType != (int32_t)samplerType ||
+		(samplerType != SamplerType::Random && header.sampleCount != sampleCount))
+	{
+		return false;
+	}
+
+	std::vector<PixelRecord> records(estimates.size());
+	if (!file.read((char*)records.data(), records.size() * sizeof(PixelRecord)))
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < estimates.size(); ++i)
+	{
+		const PixelRecord& record = records[i];
+		estimates[i].sum = Vec3(record.sum[0], record.sum[1], record.sum[2]);
+		estimates[i].luminanceMean = record.luminanceMean;
+		estimates[i].luminanceM2 = record.luminanceM2;
+		estimates[i].samplesTaken = record.samplesTaken;
+	}
+
+	seed = header.seed;
+	return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Framebuffer.h"
+#include "SampleSequence.h"
+
+struct RenderSettings;
+
+// Below this, RelativeError() measures the error relative to this value
+// instead of the pixel's own brightness; otherwise dark pixels would never
+// converge.
+const float ADAPTIVE_MIN_LUMINANCE = 0.1f;
+
+inline float Luminance(const Vec3& color)
+{
+	return 0.2126f * color.x() + 0.7152f * color.y() + 0.0722f * color.z();
+}
+
+// Running sum of a pixel's samples, plus the running mean and variance of
+// their luminance (Welford's algorithm), which adaptive sampling uses to
+// decide when the pixel has had enough.
+struct PixelEstimate
+{
+	Vec3 sum;
+	float luminanceMean = 0.0f;
+	float luminanceM2 = 0.0f;		// sum of squared differences from the mean
+	int32_t samplesTaken = 0;
+
+	inline void Add(const Vec3& sample)
+	{
+		sum += sample;
+		samplesTaken++;
+
+		float luminance = Luminance(sample);
+		float delta = luminance - luminanceMean;
+		luminanceMean += delta / (float)samplesTaken;
+		luminanceM2 += delta * (luminance - luminanceMean);
+	}
+
+	inline Vec3 Mean() const { return samplesTaken > 0 ? sum / (float)samplesTaken : Vec3(); }
+
+	// Standard error of the mean luminance, relative to the mean itself
+	inline float RelativeError() const
+	{
+		if (samplesTaken < 2)
+		{
+			return FLT_MAX;
+		}
+
+		float variance = luminanceM2 / (float)(samplesTaken - 1);
+		return sqrtf(variance / (float)samplesTaken) / Maxf(luminanceMean, ADAPTIVE_MIN_LUMINANCE);
+	}
+};
+
+// The estimates of every pixel of an image. It holds everything needed to
+// carry on rendering: a pixel's next sample index is the number of samples
+// it has taken, and since each (pixel, sample index) pair has its own
+// random stream, rendering samples [0, n) and later [n, m) gives exactly
+// the same image as rendering [0, m) in one go.
+//
+// Checkpoints are little endian binary files: a header (magic, version,
+// size, seed, sampler, sample count) followed by the pixel estimates.
+
+class AccumulationBuffer
+{
+public:
+	// The seed, sampler and sample count are what the samples are drawn
+	// with (see SampleSequence.h)
+	AccumulationBuffer(int width, int height, uint64_t seed, SamplerType samplerType, int sampleCount) :
+		width{ width }, height{ height }, seed{ seed }, samplerType{ samplerType }, sampleCount{ sampleCount },
+		estimates((size_t)width * height) {}
+	explicit AccumulationBuffer(const RenderSettings& settings);
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+	uint64_t Seed() const { return seed; }
+	uint64_t TotalSamples() const;
+
+	inline PixelEstimate& At(int x, int y) { return estimates[(size_t)y * width + x]; }
+	inline const PixelEstimate& At(int x, int y) const { return estimates[(size_t)y * width + x]; }
+
+	// Writes the mean of every pixel to the framebuffer
+	void Resolve(Framebuffer& framebuffer) const;
+
+	// Debug view of where the samples went: black is none, white is
+	// maxSamples (or more) per pixel
+	void ResolveSampleCounts(Framebuffer& framebuffer, int maxSamples) const;
+
+	// Saves to a temporary file first, and only then replaces "path", so a
+	// crash while saving leaves the previous checkpoint intact.
+	bool SaveCheckpoint(const std::string& path) const;
+
+	// Takes the checkpoint's seed; fails unless the size and sampler are
+	// the same, and - for any sampler but Random, whose samples don't
+	// depend on it - the sample count
+	bool LoadCheckpoint(const std::string& path);
+
+private:
+	int width;
+	int height;
+	uint64_t seed;
+	SamplerType samplerType;
+	int sampleCount;
+	std::vector<PixelEstimate> estimates;
+};
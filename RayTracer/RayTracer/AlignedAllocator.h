@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Allocator for std::vector that starts the array on an ALIGNMENT byte
+// boundary - a cache line by default - so that hot SoA arrays never have a
+// SIMD_WIDTH group of floats straddling two lines more than necessary.
+// C++14 has no aligned operator new, so the block is over-allocated and the
+// original pointer is kept just in front of the aligned one.
+
+template <typename T, size_t ALIGNMENT = 64>
+struct AlignedAllocator
+{
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind { typedef AlignedAllocator<U, ALIGNMENT> other; };
+
+	AlignedAllocator() = default;
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, ALIGNMENT>&) {}
+
+	T* allocate(size_t count)
+	{
+		void* block = malloc(count * sizeof(T) + ALIGNMENT + sizeof(void*));
+		if (block == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+
+		uintptr_t aligned = ((uintptr_t)block + sizeof(void*) + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1);
+		((void**)aligned)[-1] = block;
+		return (T*)aligned;
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		if (p != nullptr)
+		{
+			free(((void**)p)[-1]);
+		}
+	}
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, ALIGNMENT>&) const { return true; }
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U, ALIGNMENT>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
@@ -0,0 +1,60 @@
+#include "pch.h"
+#include "Arena.h"
+#include <cstdint>
+
+void* Arena::Allocate(size_t size, size_t alignment)
+{
+	// Big requests get a block of their own, so that they don't waste the
+	// rest of the current one
+	if (size > blockSize / 4)
+	{
+		char* memory = AlignedAllocator<char, BLOCK_ALIGNMENT>().allocate(size);
+		blocks.insert(blocks.empty() ? blocks.end() : blocks.end() - 1, Block{ memory, size });
+		bytesUsed += size;
+		return memory;
+	}
+
+	uintptr_t aligned = ((uintptr_t)next + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	if (next == nullptr || aligned + size > (uintptr_t)end)
+	{
+		char* memory = AlignedAllocator<char, BLOCK_ALIGNMENT>().allocate(blockSize);
+		blocks.push_back(Block{ memory, blockSize });
+		next = memory;
+		end = memory + blockSize;
+		aligned = (uintptr_t)memory;
+	}
+
+	bytesUsed += size;
+	next = (char*)(aligned + size);
+	return (void*)aligned;
+}
+
+void Arena::Clear()
+{
+	for (Finalizer* finalizer = finalizers; finalizer != nullptr; finalizer = finalizer->next)
+	{
+		finalizer->destroy(finalizer->object);
+	}
+
+	for (const auto& block : blocks)
+	{
+		AlignedAllocator<char, BLOCK_ALIGNMENT>().deallocate(block.memory, block.size);
+	}
+
+	blocks.clear();
+	next = nullptr;
+	end = nullptr;
+	bytesUsed = 0;
+	finalizers = nullptr;
+}
+
+size_t Arena::BytesReserved() const
+{
+	size_t total = 0;
+	for (const auto& block : blocks)
+	{
+		total += block.size;
+	}
+
+	return total;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "AlignedAllocator.h"
+
+// A bump allocator for things that live exactly as long as the scene.
+// Memory comes in large, cache line aligned blocks, and is handed out
+// front to back, so objects created one after the other end up next to
+// each other; nothing is freed individually. Clear() (or the destructor)
+// releases every block at once.
+//
+// Objects made with New() whose type has a destructor get a small record
+// in the arena, and Clear() runs those destructors, newest first, before
+// dropping the blocks; trivially destructible data costs nothing to free.
+
+class Arena
+{
+public:
+	static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+	static const size_t BLOCK_ALIGNMENT = 64;
+
+	explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE) : blockSize{ blockSize } {}
+	~Arena() { Clear(); }
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	// "alignment" must be a power of two, no larger than BLOCK_ALIGNMENT.
+	// Requests larger than a block get a block of their own.
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	template <typename T, typename... Args>
+	T* New(Args&&... args)
+	{
+		Finalizer* finalizer = nullptr;
+		if (!std::is_trivially_destructible<T>::value)
+		{
+			finalizer = static_cast<Finalizer*>(Allocate(sizeof(Finalizer), alignof(Finalizer)));
+		}
+
+		T* object = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+		if (finalizer != nullptr)
+		{
+			finalizer->destroy = &Destroy<T>;
+			finalizer->object = object;
+			finalizer->next = finalizers;
+			finalizers = finalizer;
+		}
+
+		return object;
+	}
+
+	void Clear();
+
+	size_t BlockCount() const { return blocks.size(); }
+	size_t BytesReserved() const;
+	size_t BytesUsed() const { return bytesUsed; }
+
+private:
+	struct Block
+	{
+		char* memory;
+		size_t size;
+	};
+
+	struct Finalizer
+	{
+		void (*destroy)(void*);
+		void* object;
+		Finalizer* next;
+	};
+
+	template <typename T>
+	static void Destroy(void* object) { static_cast<T*>(object)->~T(); }
+
+	size_t blockSize;
+	std::vector<Block> blocks;
+	char* next = nullptr;			// the free part of the newest block
+	char* end = nullptr;
+	size_t bytesUsed = 0;
+	Finalizer* finalizers = nullptr;
+};
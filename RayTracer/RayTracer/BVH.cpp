@@ -0,0 +1,192 @@
+#include "pch.h"
+#include "BVH.h"
+#include <algorithm>
+
+namespace
+{
+	const int BIN_COUNT = 16;
+
+	// Relative cost of visiting a node vs. intersecting a primitive
+	const float TRAVERSAL_COST = 1.0f;
+	const float INTERSECTION_COST = 1.0f;
+
+	// Past this depth nodes are split at the median, which keeps the
+	// tree shallow enough for the fixed size traversal stack.
+	const int MEDIAN_SPLIT_DEPTH = 40;
+
+	struct Bin
+	{
+		AABB bounds;
+		int count = 0;
+	};
+}
+
+void BVH::Clear()
+{
+	nodes.clear();
+	primitiveOrder.clear();
+}
+
+void BVH::Build(const std::vector<AABB>& primitiveBounds, int maxLeafSize)
+{
+	Clear();
+	this->maxLeafSize = maxLeafSize;
+
+	int primitiveCount = (int)primitiveBounds.size();
+	if (primitiveCount == 0)
+	{
+		return;
+	}
+
+	std::vector<Vec3> centroids;
+	centroids.reserve(primitiveCount);
+	primitiveOrder.reserve(primitiveCount);
+
+	for (int i = 0; i < primitiveCount; ++i)
+	{
+		centroids.push_back(primitiveBounds[i].Centroid());
+		primitiveOrder.push_back(i);
+	}
+
+	nodes.reserve(primitiveCount * 2);
+	nodes.push_back(BVHNode());
+	BuildNode(0, 0, primitiveCount, 0, primitiveBounds, centroids);
+}
+
+void BVH::BuildNode(int nodeIndex, int first, int count, int depth,
+					const std::vector<AABB>& primitiveBounds,
+					const std::vector<Vec3>& centroids)
+{
+	AABB bounds;
+	AABB centroidBounds;
+
+	for (int i = first; i < first + count; ++i)
+	{
+		bounds.Grow(primitiveBounds[primitiveOrder[i]]);
+		centroidBounds.Grow(centroids[primitiveOrder[i]]);
+	}
+
+	nodes[nodeIndex].bounds = bounds;
+	nodes[nodeIndex].leftFirst = first;
+	nodes[nodeIndex].count = count;
+
+	if (count == 1)
+	{
+		return;
+	}
+
+	// Find the cheapest binned split over all three axes
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestSplit = 0;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float axisMin = centroidBounds.min[axis];
+		float axisExtent = centroidBounds.max[axis] - axisMin;
+
+		if (axisExtent <= 0.0f)
+		{
+			continue;
+		}
+
+		Bin bins[BIN_COUNT];
+		float binScale = BIN_COUNT / axisExtent;
+
+		for (int i = first; i < first + count; ++i)
+		{
+			int primitive = primitiveOrder[i];
+			int bin = std::min(BIN_COUNT - 1, (int)((centroids[primitive][axis] - axisMin) * binScale));
+			bins[bin].count++;
+			bins[bin].bounds.Grow(primitiveBounds[primitive]);
+		}
+
+		// Sweep from the right to get the cost of everything right of each
+		// split plane, then from the left to combine it with the other side.
+
+		float rightCost[BIN_COUNT];
+		AABB rightBounds;
+		int rightCount = 0;
+
+		for (int i = BIN_COUNT - 1; i > 0; --i)
+		{
+			rightBounds.Grow(bins[i].bounds);
+			rightCount += bins[i].count;
+			rightCost[i] = rightCount * rightBounds.SurfaceArea();
+		}
+
+		AABB leftBounds;
+		int leftCount = 0;
+
+		for (int split = 1; split < BIN_COUNT; ++split)
+		{
+			leftBounds.Grow(bins[split - 1].bounds);
+			leftCount += bins[split - 1].count;
+
+			float cost = leftCount * leftBounds.SurfaceArea() + rightCost[split];
+			if (leftCount > 0 && leftCount < count && cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	if (bestAxis < 0)
+	{
+		// Every centroid is in the same spot; nothing to split
+		return;
+	}
+
+	float area = bounds.SurfaceArea();
+	float leafCost = INTERSECTION_COST * count;
+	float splitCost = TRAVERSAL_COST + INTERSECTION_COST * bestCost / std::max(area, FLT_MIN);
+
+	if (count <= maxLeafSize && leafCost <= splitCost)
+	{
+		return;
+	}
+
+	int* begin = primitiveOrder.data() + first;
+	int* end = begin + count;
+	int* middle;
+
+	if (depth < MEDIAN_SPLIT_DEPTH)
+	{
+		float axisMin = centroidBounds.min[bestAxis];
+		float binScale = BIN_COUNT / (centroidBounds.max[bestAxis] - axisMin);
+
+		middle = std::partition(begin, end, [&](int primitive)
+		{
+			int bin = std::min(BIN_COUNT - 1, (int)((centroids[primitive][bestAxis] - axisMin) * binScale));
+			return bin < bestSplit;
+		});
+	}
+	else
+	{
+		int axis = centroidBounds.LongestAxis();
+		middle = begin + count / 2;
+		std::nth_element(begin, middle, end, [&](int a, int b)
+		{
+			return centroids[a][axis] < centroids[b][axis];
+		});
+	}
+
+	int leftCount = (int)(middle - begin);
+	if (leftCount == 0 || leftCount == count)
+	{
+		return;
+	}
+
+	int leftChild = (int)nodes.size();
+	nodes.push_back(BVHNode());
+	nodes.push_back(BVHNode());
+
+	nodes[nodeIndex].leftFirst = leftChild;
+	nodes[nodeIndex].count = 0;
+
+	BuildNode(leftChild, first, leftCount, depth + 1, primitiveBounds, centroids);
+	BuildNode(leftChild + 1, first + leftCount, count - leftCount, depth + 1, primitiveBounds, centroids);
+}
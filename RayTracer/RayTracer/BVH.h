@@ -0,0 +1,257 @@
+#pragma once
+#include <utility>
+#include <vector>
+#include "AABB.h"
+#include "RayPacket.h"
+
+// Bounding volume hierarchy, built top-down with the surface area heuristic
+// (binned, as in Wald's "On fast Construction of SAH-based Bounding Volume
+// Hierarchies"). The BVH only knows about primitive bounds; after Build(),
+// PrimitiveOrder() tells the owner how to reorder its primitives so that
+// every leaf refers to a contiguous range of them.
+
+struct BVHNode
+{
+	AABB bounds;
+	int leftFirst;	// inner node: index of the left child (the right one follows it)
+					// leaf: index of the first primitive
+	int count;		// number of primitives in a leaf, 0 for inner nodes
+
+	inline bool IsLeaf() const { return count > 0; }
+};
+
+class BVH
+{
+public:
+	// Leaves hold up to maxLeafSize primitives, fewer where the SAH says
+	// splitting them is cheaper.
+	void Build(const std::vector<AABB>& primitiveBounds, int maxLeafSize = MAX_LEAF_SIZE);
+	void Clear();
+
+	bool IsEmpty() const { return nodes.empty(); }
+	int NodeCount() const { return (int)nodes.size(); }
+	const std::vector<BVHNode>& Nodes() const { return nodes; }
+	const std::vector<int>& PrimitiveOrder() const { return primitiveOrder; }
+
+	// Closest-hit traversal. "intersectLeaf(first, count, tMax)" tests the
+	// primitives of a leaf, shrinks tMax if it finds anything closer and
+	// returns whether it did; nodes further away than tMax are skipped.
+	template <typename IntersectLeaf>
+	bool Traverse(const Ray& ray, float& tMax, IntersectLeaf&& intersectLeaf) const
+	{
+		return TraverseNodes<false>(ray, tMax, intersectLeaf);
+	}
+
+	// Any-hit traversal, for occlusion: stops at the first leaf for which
+	// "isLeafHit(first, count, tMax)" returns true.
+	template <typename IsLeafHit>
+	bool TraverseAny(const Ray& ray, float tMax, IsLeafHit&& isLeafHit) const
+	{
+		return TraverseNodes<true>(ray, tMax, isLeafHit);
+	}
+
+	// Packet traversal; "tMax" holds one distance per ray of the packet.
+	// A node is visited if at least one ray hits it; "firstActive" is the
+	// first such ray - the ones before it are known to miss. The leaf
+	// callback, intersectLeaf(first, count, firstActive), tests rays
+	// [firstActive, packet.size) and shrinks their tMax.
+	template <typename IntersectLeaf>
+	void TraversePacket(const RayPacket& packet, float* tMax, IntersectLeaf&& intersectLeaf) const
+	{
+		if (nodes.empty() || packet.size == 0)
+		{
+			return;
+		}
+
+		PacketStackEntry stack[MAX_STACK_DEPTH];
+		int stackSize = 0;
+		int nodeIndex = 0;
+		int firstActive = 0;
+		float packetTMax = MaxDistance(tMax, 0, packet.size);
+
+		while (true)
+		{
+			const BVHNode& node = nodes[nodeIndex];
+			int active = packet.MayHit(node.bounds, packetTMax) ? FirstHit(packet, tMax, node.bounds, firstActive) : -1;
+
+			if (active >= 0)
+			{
+				if (node.IsLeaf())
+				{
+					intersectLeaf(node.leftFirst, node.count, active);
+					packetTMax = MaxDistance(tMax, active, packet.size);
+				}
+				else
+				{
+					// Visit the child that the first active ray enters first
+					int nearChild = node.leftFirst;
+					int farChild = node.leftFirst + 1;
+
+					float tNear, tFar;
+					const Ray& ray = packet.rays[active];
+					if (!nodes[nearChild].bounds.Intersect(ray.Origin(), packet.inverseDirections[active], tMax[active], tNear))
+					{
+						tNear = FLT_MAX;
+					}
+
+					if (!nodes[farChild].bounds.Intersect(ray.Origin(), packet.inverseDirections[active], tMax[active], tFar))
+					{
+						tFar = FLT_MAX;
+					}
+
+					if (tFar < tNear)
+					{
+						std::swap(nearChild, farChild);
+					}
+
+					stack[stackSize++] = PacketStackEntry{ farChild, active };
+					nodeIndex = nearChild;
+					firstActive = active;
+					continue;
+				}
+			}
+
+			if (stackSize == 0)
+			{
+				return;
+			}
+
+			--stackSize;
+			nodeIndex = stack[stackSize].node;
+			firstActive = stack[stackSize].firstActive;
+		}
+	}
+
+	static const int MAX_STACK_DEPTH = 64;
+	static const int MAX_LEAF_SIZE = 4;
+
+private:
+	struct StackEntry
+	{
+		int node;
+		float tEntry;
+	};
+
+	struct PacketStackEntry
+	{
+		int node;
+		int firstActive;
+	};
+
+	template <bool IS_ANY_HIT, typename IntersectLeaf>
+	bool TraverseNodes(const Ray& ray, float& tMax, IntersectLeaf& intersectLeaf) const
+	{
+		if (nodes.empty())
+		{
+			return false;
+		}
+
+		const Vec3& origin = ray.Origin();
+		Vec3 inverseDirection(1.0f / ray.Direction().x(), 1.0f / ray.Direction().y(), 1.0f / ray.Direction().z());
+
+		float tEntry;
+		if (!nodes[0].bounds.Intersect(origin, inverseDirection, tMax, tEntry))
+		{
+			return false;
+		}
+
+		StackEntry stack[MAX_STACK_DEPTH];
+		int stackSize = 0;
+		int nodeIndex = 0;
+		bool isHit = false;
+
+		while (true)
+		{
+			const BVHNode& node = nodes[nodeIndex];
+
+			if (node.IsLeaf())
+			{
+				if (intersectLeaf(node.leftFirst, node.count, tMax))
+				{
+					if (IS_ANY_HIT)
+					{
+						return true;
+					}
+
+					isHit = true;
+				}
+			}
+			else
+			{
+				int nearChild = node.leftFirst;
+				int farChild = node.leftFirst + 1;
+
+				float tNear, tFar;
+				bool isNearHit = nodes[nearChild].bounds.Intersect(origin, inverseDirection, tMax, tNear);
+				bool isFarHit = nodes[farChild].bounds.Intersect(origin, inverseDirection, tMax, tFar);
+
+				if (isNearHit && isFarHit)
+				{
+					if (tFar < tNear)
+					{
+						std::swap(nearChild, farChild);
+					}
+
+					stack[stackSize++] = StackEntry{ farChild, tFar };
+					nodeIndex = nearChild;
+					continue;
+				}
+
+				if (isNearHit || isFarHit)
+				{
+					nodeIndex = isNearHit ? nearChild : farChild;
+					continue;
+				}
+			}
+
+			// Pop the next node, unless something closer than
+			// its entry point has been found since it was pushed
+
+			do
+			{
+				if (stackSize == 0)
+				{
+					return isHit;
+				}
+
+				--stackSize;
+			} while (stack[stackSize].tEntry > tMax);
+
+			nodeIndex = stack[stackSize].node;
+		}
+	}
+
+	static inline int FirstHit(const RayPacket& packet, const float* tMax, const AABB& bounds, int firstActive)
+	{
+		float tEntry;
+		for (int i = firstActive; i < packet.size; ++i)
+		{
+			if (bounds.Intersect(packet.rays[i].Origin(), packet.inverseDirections[i], tMax[i], tEntry))
+			{
+				return i;
+			}
+		}
+
+		return -1;
+	}
+
+	static inline float MaxDistance(const float* tMax, int first, int last)
+	{
+		float result = 0.0f;
+		for (int i = first; i < last; ++i)
+		{
+			result = Maxf(result, tMax[i]);
+		}
+
+		return result;
+	}
+
+	void BuildNode(int nodeIndex, int first, int count, int depth,
+				   const std::vector<AABB>& primitiveBounds,
+				   const std::vector<Vec3>& centroids);
+
+	int maxLeafSize = MAX_LEAF_SIZE;
+
+	std::vector<BVHNode> nodes;
+	std::vector<int> primitiveOrder;
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Positional arguments come first (e.g. "RayTracer 64 16"), followed by
+// any number of "--name value" options or bare "--name" switches.
+
+class CommandLine
+{
+public:
+	CommandLine(int argc, char* argv[]) :
+		CommandLine(argc > 1 ? std::vector<std::string>(argv + 1, argv + argc) : std::vector<std::string>()) {}
+
+	// Words that have already been split up, without the program's name;
+	// e.g. a render server request (see RenderServer.h)
+	explicit CommandLine(const std::vector<std::string>& args)
+	{
+		for (size_t i = 0; i < args.size(); ++i)
+		{
+			const std::string& arg = args[i];
+			if (IsOption(arg))
+			{
+				bool hasValue = i + 1 < args.size() && !IsOption(args[i + 1]);
+				options.push_back(Option{ arg.substr(2), hasValue ? args[++i] : "" });
+			}
+			else
+			{
+				positional.push_back(arg);
+			}
+		}
+	}
+
+	const std::vector<std::string>& Positional() const { return positional; }
+
+	bool Has(const std::string& name) const { return Find(name) != nullptr; }
+
+	std::string GetString(const std::string& name, const std::string& defaultValue) const
+	{
+		auto option = Find(name);
+		return option != nullptr && !option->value.empty() ? option->value : defaultValue;
+	}
+
+	int GetInt(const std::string& name, int defaultValue) const
+	{
+		auto option = Find(name);
+		return option != nullptr && !option->value.empty() ? std::stoi(option->value) : defaultValue;
+	}
+
+	float GetFloat(const std::string& name, float defaultValue) const
+	{
+		auto option = Find(name);
+		return option != nullptr && !option->value.empty() ? std::stof(option->value) : defaultValue;
+	}
+
+	uint64_t GetUInt64(const std::string& name, uint64_t defaultValue) const
+	{
+		auto option = Find(name);
+		return option != nullptr && !option->value.empty() ? std::stoull(option->value, nullptr, 0) : defaultValue;
+	}
+
+private:
+	struct Option
+	{
+		std::string name;
+		std::string value;
+	};
+
+	static bool IsOption(const std::string& arg)
+	{
+		return arg.size() > 2 && arg[0] == '-' && arg[1] == '-';
+	}
+
+	const Option* Find(const std::string& name) const
+	{
+		for (const auto& option : options)
+		{
+			if (option.name == name)
+			{
+				return &option;
+			}
+		}
+
+		return nullptr;
+	}
+
+	std::vector<std::string> positional;
+	std::vector<Option> options;
+};
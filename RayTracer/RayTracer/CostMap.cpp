@@ -0,0 +1,147 @@
+#include "pch.h"
+#include "CostMap.h"
+#include <algorithm>
+#include "ImageEncoder.h"
+#include "Utilities.h"
+
+namespace
+{
+	const CostChannel CHANNELS[] = { CostChannel::Time, CostChannel::Rays, CostChannel::Tests, CostChannel::Depth };
+	const char* CHANNEL_NAMES[] = { "time", "rays", "tests", "depth" };
+
+	// Black, purple, red, yellow, white
+	Vec3 FalseColor(float value)
+	{
+		static const Vec3 stops[] = {
+			Vec3(0.0f, 0.0f, 0.0f), Vec3(0.4f, 0.0f, 0.6f), Vec3(0.9f, 0.1f, 0.1f), Vec3(1.0f, 0.9f, 0.0f), Vec3(1.0f, 1.0f, 1.0f)
+		};
+		const int lastStop = 4;
+
+		float position = Minf(Maxf(value, 0.0f), 1.0f) * lastStop;
+		int stop = std::min((int)position, lastStop - 1);
+		return Vec3::Lerp(stops[stop], stops[stop + 1], position - stop);
+	}
+}
+
+float PixelCost::Get(CostChannel channel) const
+{
+	switch (channel)
+	{
+	case CostChannel::Time: return seconds;
+	case CostChannel::Rays: return rays;
+	case CostChannel::Tests: return tests;
+	case CostChannel::Depth: return pathCount > 0.0f ? depthSum / pathCount : 0.0f;
+	}
+
+	return 0.0f;
+}
+
+PixelCost CostProbe::Elapsed() const
+{
+	PixelCost cost;
+#ifdef RT_STATS
+	Counts counters = Counters();
+	cost.rays = (float)(counters.rays - startCounters.rays);
+	cost.tests = (float)(counters.tests - startCounters.tests);
+	cost.depthSum = (float)(counters.depthSum - startCounters.depthSum);
+	cost.pathCount = (float)(counters.pathCount - startCounters.pathCount);
+#endif
+	cost.seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	return cost;
+}
+
+#ifdef RT_STATS
+CostProbe::Counts CostProbe::Counters()
+{
+	const RenderStats& stats = Stats::Local();
+
+	Counts counters;
+	counters.rays = stats.RayCount();
+	counters.tests = stats.TestCount();
+	counters.depthSum = stats.DepthSum();
+	counters.pathCount = stats.PathCount();
+	return counters;
+}
+#endif
+
+void CostMap::Add(int x, int y, int regionWidth, int regionHeight, const PixelCost& cost)
+{
+	float weight = 1.0f / (float)(regionWidth * regionHeight);
+
+	for (int row = y; row < y + regionHeight; ++row)
+	{
+		for (int column = x; column < x + regionWidth; ++column)
+		{
+			costs[(size_t)row * width + column].Add(cost, weight);
+		}
+	}
+}
+
+Framebuffer CostMap::Resolve(CostChannel channel) const
+{
+	Framebuffer framebuffer(width, height);
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			float value = At(x, y).Get(channel);
+			framebuffer.Set(x, y, Vec3(value, value, value));
+		}
+	}
+
+	return framebuffer;
+}
+
+Framebuffer CostMap::ResolveFalseColor(CostChannel channel) const
+{
+	std::vector<float> values;
+	values.reserve(costs.size());
+	for (const auto& cost : costs)
+	{
+		values.push_back(cost.Get(channel));
+	}
+
+	// A few very expensive pixels shouldn't leave everything else black
+	auto percentile = values.begin() + (values.size() * 99) / 100;
+	std::nth_element(values.begin(), percentile, values.end());
+	float scale = *percentile > 0.0f ? 1.0f / *percentile : 0.0f;
+
+	Framebuffer framebuffer(width, height);
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			framebuffer.Set(x, y, FalseColor(At(x, y).Get(channel) * scale));
+		}
+	}
+
+	return framebuffer;
+}
+
+bool CostMap::WriteImages(const std::string& prefix) const
+{
+	bool isWritten = true;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		CostChannel channel = CHANNELS[i];
+		bool hasData = std::any_of(costs.begin(), costs.end(), [channel](const PixelCost& cost) { return cost.Get(channel) > 0.0f; });
+		if (!hasData)
+		{
+			continue;
+		}
+
+		std::string name = prefix + "_" + CHANNEL_NAMES[i];
+
+		OutputFile colorFile(name + ImageFileExtension(ImageFormat::BinaryPPM), true);
+		WriteImage(ResolveFalseColor(channel), ImageFormat::BinaryPPM, colorFile.GetStream());
+
+		OutputFile rawFile(name + ImageFileExtension(ImageFormat::PFM), true);
+		WriteImage(Resolve(channel), ImageFormat::PFM, rawFile.GetStream());
+
+		isWritten = isWritten && colorFile.GetStream() && rawFile.GetStream();
+	}
+
+	return isWritten;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Framebuffer.h"
+#include "RenderStats.h"
+
+// Where in the frame the time goes: the wall time, rays, intersection tests
+// and path depths that went into each pixel, over every pass of a render.
+//
+// Time is always measured; the other channels come from the RenderStats
+// counters, so they stay zero unless RT_STATS is defined. The recursive
+// renderer measures each pixel on its own. Packets and the wavefront trace
+// many pixels together, so there the cost of a whole 8x8 block or tile is
+// spread evenly over its pixels.
+
+enum class CostChannel
+{
+	Time,		// seconds
+	Rays,
+	Tests,		// sphere, triangle and instance tests
+	Depth		// average path depth
+};
+
+struct PixelCost
+{
+	float seconds = 0.0f;
+	float rays = 0.0f;
+	float tests = 0.0f;
+	float depthSum = 0.0f;
+	float pathCount = 0.0f;
+
+	inline void Add(const PixelCost& other, float weight)
+	{
+		seconds += other.seconds * weight;
+		rays += other.rays * weight;
+		tests += other.tests * weight;
+		depthSum += other.depthSum * weight;
+		pathCount += other.pathCount * weight;
+	}
+
+	float Get(CostChannel channel) const;
+};
+
+// Measures whatever the calling thread does between its construction and
+// Elapsed()
+class CostProbe
+{
+public:
+	CostProbe() : start{ std::chrono::steady_clock::now() }
+	{
+#ifdef RT_STATS
+		startCounters = Counters();
+#endif
+	}
+
+	PixelCost Elapsed() const;
+
+private:
+	std::chrono::steady_clock::time_point start;
+#ifdef RT_STATS
+	// The thread's running totals; kept exact, as only their difference
+	// is small enough for a float
+	struct Counts
+	{
+		int64_t rays;
+		int64_t tests;
+		int64_t depthSum;
+		int64_t pathCount;
+	};
+
+	static Counts Counters();
+	Counts startCounters;
+#endif
+};
+
+class CostMap
+{
+public:
+	CostMap(int width, int height) : width{ width }, height{ height }, costs((size_t)width * height) {}
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+	const PixelCost& At(int x, int y) const { return costs[(size_t)y * width + x]; }
+
+	// Spreads "cost" evenly over the given rectangle of pixels. Different
+	// threads may add to different pixels at the same time.
+	void Add(int x, int y, int regionWidth, int regionHeight, const PixelCost& cost);
+
+	// The channel's raw values, in all three components
+	Framebuffer Resolve(CostChannel channel) const;
+	// The same in false color, from black (0) through red and yellow to
+	// white at the 99th percentile and above
+	Framebuffer ResolveFalseColor(CostChannel channel) const;
+
+	// Writes <prefix>_<channel>.ppm (false color) and .pfm (raw) for each
+	// channel that has any data; false if a file couldn't be written
+	bool WriteImages(const std::string& prefix) const;
+
+private:
+	int width;
+	int height;
+	std::vector<PixelCost> costs;
+};
@@ -0,0 +1,818 @@
+#include "pch.h"
+#include "Distributed.h"
+#include "RayTracer.h"
+#include "Trace.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Messages are a type and a payload size, followed by the payload. Values
+// are written as they are in memory, so - like checkpoints - all the
+// machines involved have to be little endian.
+
+namespace
+{
+	enum class MessageType : uint32_t
+	{
+		Hello = 1,		// worker: protocol version, thread count
+		Setup,			// coordinator: render settings, scene parameters, heartbeat interval
+		Ready,			// worker: the scene is built
+		Job,			// coordinator: job id, tile, end sample, pixel estimates
+		Result,			// worker: job id, tile, pixel estimates
+		Shutdown,		// coordinator: exit
+		Heartbeat		// worker: still there
+	};
+
+	struct MessageHeader
+	{
+		uint32_t type;
+		uint32_t size;
+	};
+
+	const uint32_t MAX_MESSAGE_SIZE = 256u << 20;
+
+	class MessageWriter
+	{
+	public:
+		template <typename T>
+		void Put(T value)
+		{
+			size_t offset = bytes.size();
+			bytes.resize(offset + sizeof(T));
+			std::memcpy(&bytes[offset], &value, sizeof(T));
+		}
+
+		void PutTile(const Tile& tile)
+		{
+			Put<int32_t>(tile.x); Put<int32_t>(tile.y); Put<int32_t>(tile.width); Put<int32_t>(tile.height);
+		}
+
+		void PutEstimates(const AccumulationBuffer& accumulation, const Tile& tile)
+		{
+			for (int y = tile.y; y < tile.y + tile.height; ++y)
+			{
+				for (int x = tile.x; x < tile.x + tile.width; ++x)
+				{
+					const PixelEstimate& estimate = accumulation.At(x, y);
+					Put(estimate.sum.x()); Put(estimate.sum.y()); Put(estimate.sum.z());
+					Put(estimate.luminanceMean);
+					Put(estimate.luminanceM2);
+					Put<int32_t>(estimate.samplesTaken);
+				}
+			}
+		}
+
+		bool Send(const Socket& socket, MessageType type) const
+		{
+			MessageHeader header{ (uint32_t)type, (uint32_t)bytes.size() };
+			return socket.SendAll(&header, sizeof(header)) && (bytes.empty() || socket.SendAll(bytes.data(), bytes.size()));
+		}
+
+	private:
+		std::vector<char> bytes;
+	};
+
+	// Reading past the end leaves IsValid() false and returns zeros
+	class MessageReader
+	{
+	public:
+		bool Receive(const Socket& socket, MessageType& type)
+		{
+			MessageHeader header;
+			if (!socket.ReceiveAll(&header, sizeof(header)) || header.size > MAX_MESSAGE_SIZE)
+			{
+				return false;
+			}
+
+			type = (MessageType)header.type;
+			bytes.resize(header.size);
+			offset = 0;
+			isValid = true;
+			return header.size == 0 || socket.ReceiveAll(bytes.data(), bytes.size());
+		}
+
+		template <typename T>
+		T Get()
+		{
+			T value{};
+			if (offset + sizeof(T) > bytes.size())
+			{
+				isValid = false;
+				return value;
+			}
+
+			std::memcpy(&value, &bytes[offset], sizeof(T));
+			offset += sizeof(T);
+			return value;
+		}
+
+		Tile GetTile()
+		{
+			Tile tile;
+			tile.x = Get<int32_t>(); tile.y = Get<int32_t>(); tile.width = Get<int32_t>(); tile.height = Get<int32_t>();
+			return tile;
+		}
+
+		bool IsInside(const Tile& tile, const AccumulationBuffer& accumulation) const
+		{
+			return tile.x >= 0 && tile.y >= 0 && tile.width > 0 && tile.height > 0 &&
+				   tile.x + tile.width <= accumulation.Width() && tile.y + tile.height <= accumulation.Height();
+		}
+
+		// Checks that the whole tile is there before writing any of it
+		bool GetEstimates(AccumulationBuffer& accumulation, const Tile& tile)
+		{
+			const size_t recordSize = 5 * sizeof(float) + sizeof(int32_t);
+			if (!isValid || !IsInside(tile, accumulation) || offset + recordSize * tile.width * tile.height > bytes.size())
+			{
+				isValid = false;
+				return false;
+			}
+
+			for (int y = tile.y; y < tile.y + tile.height; ++y)
+			{
+				for (int x = tile.x; x < tile.x + tile.width; ++x)
+				{
+					PixelEstimate& estimate = accumulation.At(x, y);
+					float sumX = Get<float>();
+					float sumY = Get<float>();
+					float sumZ = Get<float>();
+					estimate.sum = Vec3(sumX, sumY, sumZ);
+					estimate.luminanceMean = Get<float>();
+					estimate.luminanceM2 = Get<float>();
+					estimate.samplesTaken = Get<int32_t>();
+				}
+			}
+
+			return true;
+		}
+
+		bool IsValid() const { return isValid; }
+
+	private:
+		std::vector<char> bytes;
+		size_t offset = 0;
+		bool isValid = true;
+	};
+
+	// Everything but the thread count, which is each worker's own
+	void PutSetup(MessageWriter& message, const RenderSettings& settings, const SceneParameters& scene)
+	{
+		message.Put<int32_t>(settings.width);
+		message.Put<int32_t>(settings.height);
+		message.Put<int32_t>(settings.sampleCount);
+		message.Put<int32_t>(settings.maxDepth);
+		message.Put<int32_t>(settings.rouletteDepth);
+		message.Put(settings.rouletteMinSurvival);
+		message.Put<int32_t>(settings.tileSize);
+		message.Put<uint64_t>(settings.seed);
+		message.Put<uint8_t>(settings.usePackets);
+		message.Put<uint8_t>(settings.useWavefront);
+		message.Put(settings.adaptiveThreshold);
+		message.Put<int32_t>((int32_t)settings.samplerType);
+
+		message.Put<uint8_t>(scene.isGenerated);
+		message.Put<uint64_t>(scene.seed);
+		message.Put<int32_t>(scene.sphereCount);
+		message.Put<int32_t>(scene.meshCount);
+		message.Put<int32_t>(scene.meshTriangleCount);
+		message.Put<int32_t>(scene.instanceCount);
+		message.Put<int32_t>(scene.materialCount);
+		message.Put<int32_t>(scene.clusterCount);
+		message.Put(scene.depth);
+		message.Put(scene.objectSize);
+	}
+
+	void GetSetup(MessageReader& message, RenderSettings& settings, SceneParameters& scene)
+	{
+		settings.width = message.Get<int32_t>();
+		settings.height = message.Get<int32_t>();
+		settings.sampleCount = message.Get<int32_t>();
+		settings.maxDepth = message.Get<int32_t>();
+		settings.rouletteDepth = message.Get<int32_t>();
+		settings.rouletteMinSurvival = message.Get<float>();
+		settings.tileSize = message.Get<int32_t>();
+		settings.seed = message.Get<uint64_t>();
+		settings.usePackets = message.Get<uint8_t>() != 0;
+		settings.useWavefront = message.Get<uint8_t>() != 0;
+		settings.adaptiveThreshold = message.Get<float>();
+		settings.samplerType = (SamplerType)message.Get<int32_t>();
+
+		scene.isGenerated = message.Get<uint8_t>() != 0;
+		scene.seed = message.Get<uint64_t>();
+		scene.sphereCount = message.Get<int32_t>();
+		scene.meshCount = message.Get<int32_t>();
+		scene.meshTriangleCount = message.Get<int32_t>();
+		scene.instanceCount = message.Get<int32_t>();
+		scene.materialCount = message.Get<int32_t>();
+		scene.clusterCount = message.Get<int32_t>();
+		scene.depth = message.Get<float>();
+		scene.objectSize = message.Get<float>();
+	}
+
+	double SecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Sends a heartbeat every "interval" from a thread of its own, so that
+	// the coordinator can tell a long tile from a lost worker
+	class HeartbeatSender
+	{
+	public:
+		HeartbeatSender(const Socket& socket, std::mutex& sendMutex, std::chrono::milliseconds interval) :
+			thread{ [this, &socket, &sendMutex, interval] { Run(socket, sendMutex, interval); } } {}
+
+		~HeartbeatSender()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				isStopping = true;
+			}
+
+			condition.notify_all();
+			thread.join();
+		}
+
+	private:
+		void Run(const Socket& socket, std::mutex& sendMutex, std::chrono::milliseconds interval)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!condition.wait_for(lock, interval, [this] { return isStopping; }))
+			{
+				std::lock_guard<std::mutex> sendLock(sendMutex);
+				MessageWriter().Send(socket, MessageType::Heartbeat);
+			}
+		}
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool isStopping = false;
+		std::thread thread;		// last, so that it starts with the rest in place
+	};
+
+#ifdef _WIN32
+	bool StartProcess(const std::vector<std::string>& arguments, uintptr_t& process)
+	{
+		std::string commandLine;
+		for (const auto& argument : arguments)
+		{
+			commandLine += (commandLine.empty() ? "\"" : " \"") + argument + "\"";
+		}
+
+		STARTUPINFOA startupInfo;
+		PROCESS_INFORMATION processInfo;
+		std::memset(&startupInfo, 0, sizeof(startupInfo));
+		startupInfo.cb = sizeof(startupInfo);
+
+		if (!CreateProcessA(nullptr, &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &processInfo))
+		{
+			return false;
+		}
+
+		CloseHandle(processInfo.hThread);
+		process = (uintptr_t)processInfo.hProcess;
+		return true;
+	}
+
+	// Gives it a few seconds to exit on its own
+	void EndProcess(uintptr_t process)
+	{
+		HANDLE handle = (HANDLE)process;
+		if (WaitForSingleObject(handle, 5000) != WAIT_OBJECT_0)
+		{
+			TerminateProcess(handle, 1);
+			WaitForSingleObject(handle, INFINITE);
+		}
+
+		CloseHandle(handle);
+	}
+#else
+	bool StartProcess(const std::vector<std::string>& arguments, uintptr_t& process)
+	{
+		std::vector<char*> argv;
+		for (const auto& argument : arguments)
+		{
+			argv.push_back(const_cast<char*>(argument.c_str()));
+		}
+
+		argv.push_back(nullptr);
+
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			execvp(argv[0], argv.data());
+			_exit(127);
+		}
+
+		process = (uintptr_t)pid;
+		return pid > 0;
+	}
+
+	void EndProcess(uintptr_t process)
+	{
+		pid_t pid = (pid_t)process;
+		for (int attempt = 0; attempt < 50; ++attempt)
+		{
+			if (waitpid(pid, nullptr, WNOHANG) != 0)
+			{
+				return;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+	}
+#endif
+}
+
+bool Coordinator::Listen(int port, bool isPublic)
+{
+	listener = Socket::Listen(port, isPublic);
+	return listener.IsValid();
+}
+
+int Coordinator::StartLocalWorkers(const std::string& executablePath, int count, int threadsPerWorker)
+{
+	std::string address = "127.0.0.1:" + std::to_string(Port());
+	int startedCount = 0;
+
+	for (int i = 0; i < count; ++i)
+	{
+		uintptr_t process;
+		if (StartProcess({ executablePath, "--worker", address, "--threads", std::to_string(threadsPerWorker) }, process))
+		{
+			processes.push_back(process);
+			startedCount++;
+		}
+	}
+
+	return startedCount;
+}
+
+int Coordinator::WaitForWorkers(int count, double timeout)
+{
+	auto start = Clock::now();
+	std::vector<const Socket*> sockets;
+	std::vector<bool> isReadable;
+
+	// No jobs yet; all a worker can send is Ready
+	Pass idle;
+	idle.firstJobId = nextJobId;
+	AccumulationBuffer noImage(0, 0, 0, SamplerType::Random, 0);
+
+	while (ReadyWorkerCount() < count && SecondsSince(start) < timeout)
+	{
+		sockets.clear();
+		for (const auto& worker : workers)
+		{
+			sockets.push_back(&worker.socket);
+		}
+
+		sockets.push_back(&listener);
+		int remaining = (int)((timeout - SecondsSince(start)) * 1000.0) + 1;
+		Socket::WaitReadable(sockets, remaining, isReadable);
+
+		size_t workerCount = workers.size();
+		for (size_t i = workerCount; i-- > 0;)
+		{
+			if (isReadable[i] && !HandleMessage(workers[i], idle, noImage))
+			{
+				DropWorker(i, idle, "failed to start");
+			}
+		}
+
+		if (isReadable[workerCount])
+		{
+			AcceptWorker();
+		}
+	}
+
+	return ReadyWorkerCount();
+}
+
+int Coordinator::ReadyWorkerCount() const
+{
+	return (int)std::count_if(workers.begin(), workers.end(), [](const Worker& worker) { return worker.isReady; });
+}
+
+// The worker says hello first, so anything else that connects is turned
+// away before it is counted; one that says nothing only holds things up
+// for WORKER_RECEIVE_TIMEOUT
+bool Coordinator::AcceptWorker()
+{
+	Worker worker;
+	worker.socket = listener.Accept();
+	if (!worker.socket.IsValid() || !worker.socket.SetReceiveTimeout(WORKER_RECEIVE_TIMEOUT))
+	{
+		return false;
+	}
+
+	MessageReader hello;
+	MessageType type;
+	if (!hello.Receive(worker.socket, type) || type != MessageType::Hello ||
+		hello.Get<int32_t>() != DISTRIBUTED_PROTOCOL_VERSION)
+	{
+		return false;
+	}
+
+	worker.threadCount = std::max(1, (int)hello.Get<int32_t>());
+
+	MessageWriter setup;
+	PutSetup(setup, settings, scene);
+	setup.Put<int32_t>(std::max(1, (int)(workerTimeout * 1000.0 / 4.0)));
+	if (!hello.IsValid() || !setup.Send(worker.socket, MessageType::Setup))
+	{
+		return false;
+	}
+
+	worker.lastHeard = Clock::now();
+	workers.push_back(std::move(worker));
+	return true;
+}
+
+bool Coordinator::RenderProgressive(const Renderer& scheduler, AccumulationBuffer& accumulation, int passSampleCount,
+									const std::function<void(const AccumulationBuffer&)>& onPassDone)
+{
+	for (auto passes = scheduler.SchedulePass(accumulation, passSampleCount); !passes.empty();
+		 passes = scheduler.SchedulePass(accumulation, passSampleCount))
+	{
+		TraceScope scope("distributed pass", "render");
+		scope.AddArg("tiles", (int64_t)passes.size());
+
+		Pass pass;
+		pass.firstJobId = nextJobId;
+		for (const auto& tilePass : passes)
+		{
+			Job job;
+			job.pass = tilePass;
+			pass.pending.push_back((int)pass.jobs.size());
+			pass.jobs.push_back(job);
+		}
+
+		nextJobId += (int)passes.size();
+
+		if (!RenderPass(pass, accumulation))
+		{
+			return false;
+		}
+
+		if (onPassDone)
+		{
+			onPassDone(accumulation);
+		}
+	}
+
+	return true;
+}
+
+bool Coordinator::RenderPass(Pass& pass, AccumulationBuffer& accumulation)
+{
+	const int POLL_MILLISECONDS = 100;
+	std::vector<const Socket*> sockets;
+	std::vector<bool> isReadable;
+
+	while (pass.doneCount < (int)pass.jobs.size())
+	{
+		if (workers.empty())
+		{
+			return false;
+		}
+
+		for (size_t i = workers.size(); i-- > 0;)
+		{
+			if (!AssignJobs(workers[i], pass, accumulation))
+			{
+				DropWorker(i, pass, "couldn't be sent its tiles");
+			}
+		}
+
+		// The listener goes last, so that the workers' indices match
+		sockets.clear();
+		for (const auto& worker : workers)
+		{
+			sockets.push_back(&worker.socket);
+		}
+
+		sockets.push_back(&listener);
+		Socket::WaitReadable(sockets, POLL_MILLISECONDS, isReadable);
+
+		size_t workerCount = workers.size();
+		for (size_t i = workerCount; i-- > 0;)
+		{
+			if (isReadable[i] && !HandleMessage(workers[i], pass, accumulation))
+			{
+				DropWorker(i, pass, "disconnected");
+			}
+			else if (!workers[i].jobs.empty() && SecondsSince(workers[i].lastHeard) > workerTimeout)
+			{
+				DropWorker(i, pass, "timed out");
+			}
+		}
+
+		if (isReadable[workerCount] && AcceptWorker())
+		{
+			std::cout << "Worker " << WorkerCount() << " joined" << std::endl;
+		}
+	}
+
+	return true;
+}
+
+// Jobs nobody has yet first; then copies of the longest running ones
+bool Coordinator::AssignJobs(Worker& worker, Pass& pass, const AccumulationBuffer& accumulation)
+{
+	auto isRenderingTile = [&worker](const Tile& tile)
+	{
+		return std::any_of(worker.jobs.begin(), worker.jobs.end(),
+						   [&tile](const RunningJob& job) { return job.x == tile.x && job.y == tile.y; });
+	};
+
+	while (worker.isReady && (int)worker.jobs.size() < worker.threadCount)
+	{
+		int jobIndex = -1;
+
+		for (auto pending = pass.pending.begin(); pending != pass.pending.end(); ++pending)
+		{
+			if (!isRenderingTile(pass.jobs[*pending].pass.tile))
+			{
+				jobIndex = *pending;
+				pass.pending.erase(pending);
+				break;
+			}
+		}
+
+		if (jobIndex < 0)
+		{
+			for (int i = 0; i < (int)pass.jobs.size(); ++i)
+			{
+				const Job& job = pass.jobs[i];
+				if (!job.isDone && job.runningCount == 1 && !isRenderingTile(job.pass.tile) &&
+					(jobIndex < 0 || job.startTime < pass.jobs[jobIndex].startTime))
+				{
+					jobIndex = i;
+				}
+			}
+
+			if (jobIndex < 0)
+			{
+				return true;
+			}
+
+			duplicateJobCount++;
+		}
+
+		if (!SendJob(worker, pass, jobIndex, accumulation))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Coordinator::SendJob(Worker& worker, Pass& pass, int jobIndex, const AccumulationBuffer& accumulation)
+{
+	Job& job = pass.jobs[jobIndex];
+	const Tile& tile = job.pass.tile;
+
+	MessageWriter message;
+	message.Put<int32_t>(pass.firstJobId + jobIndex);
+	message.PutTile(tile);
+	message.Put<int32_t>(job.pass.endSample);
+	message.PutEstimates(accumulation, tile);
+
+	// A worker that has been idle is only late from now on
+	if (worker.jobs.empty())
+	{
+		worker.lastHeard = Clock::now();
+	}
+
+	if (job.runningCount++ == 0)
+	{
+		job.startTime = Clock::now();
+	}
+
+	worker.jobs.push_back(RunningJob{ pass.firstJobId + jobIndex, tile.x, tile.y });
+	return message.Send(worker.socket, MessageType::Job);
+}
+
+bool Coordinator::HandleMessage(Worker& worker, Pass& pass, AccumulationBuffer& accumulation)
+{
+	MessageReader message;
+	MessageType type;
+	if (!message.Receive(worker.socket, type))
+	{
+		return false;
+	}
+
+	worker.lastHeard = Clock::now();
+
+	if (type == MessageType::Heartbeat)
+	{
+		return true;
+	}
+
+	if (type == MessageType::Ready)
+	{
+		worker.isReady = true;
+		return true;
+	}
+
+	if (type != MessageType::Result)
+	{
+		return false;
+	}
+
+	int id = message.Get<int32_t>();
+	Tile tile = message.GetTile();
+
+	auto running = std::find_if(worker.jobs.begin(), worker.jobs.end(), [id](const RunningJob& job) { return job.id == id; });
+	if (!message.IsValid() || running == worker.jobs.end())
+	{
+		return false;
+	}
+
+	worker.jobs.erase(running);
+
+	// Copies of jobs from earlier passes are simply dropped
+	int jobIndex = id - pass.firstJobId;
+	if (jobIndex < 0)
+	{
+		return true;
+	}
+
+	Job& job = pass.jobs[jobIndex];
+	job.runningCount--;
+
+	if (job.isDone)
+	{
+		return true;
+	}
+
+	if (tile.x != job.pass.tile.x || tile.y != job.pass.tile.y ||
+		tile.width != job.pass.tile.width || tile.height != job.pass.tile.height ||
+		!message.GetEstimates(accumulation, tile))
+	{
+		return false;
+	}
+
+	job.isDone = true;
+	pass.doneCount++;
+	return true;
+}
+
+// Its jobs go back to the front of the queue, unless a copy is still
+// running elsewhere
+void Coordinator::DropWorker(size_t index, Pass& pass, const char* reason)
+{
+	int requeuedCount = 0;
+
+	for (const auto& running : workers[index].jobs)
+	{
+		int jobIndex = running.id - pass.firstJobId;
+		if (jobIndex < 0)
+		{
+			continue;
+		}
+
+		Job& job = pass.jobs[jobIndex];
+		if (--job.runningCount == 0 && !job.isDone)
+		{
+			pass.pending.push_front(jobIndex);
+			requeuedCount++;
+		}
+	}
+
+	std::cout << "Dropped a worker that " << reason << "; " << requeuedCount << " of its tiles go to the others" << std::endl;
+
+	workers.erase(workers.begin() + index);
+	lostWorkerCount++;
+}
+
+void Coordinator::Shutdown()
+{
+	for (auto& worker : workers)
+	{
+		MessageWriter().Send(worker.socket, MessageType::Shutdown);
+	}
+
+	workers.clear();
+	listener.Close();
+
+	for (uintptr_t process : processes)
+	{
+		EndProcess(process);
+	}
+
+	processes.clear();
+}
+
+int RunWorker(const std::string& host, int port, int threadCount, int tileLimit)
+{
+	Trace::SetThreadName("worker");
+
+	Socket socket;
+	auto start = std::chrono::steady_clock::now();
+	while (!(socket = Socket::Connect(host, port)).IsValid())
+	{
+		if (SecondsSince(start) > WORKER_CONNECT_TIMEOUT)
+		{
+			std::cout << "Worker: can't reach the coordinator at " << host << ":" << port << std::endl;
+			return 1;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+
+	MessageWriter hello;
+	hello.Put<int32_t>(DISTRIBUTED_PROTOCOL_VERSION);
+	hello.Put<int32_t>(threadCount);
+
+	MessageReader setup;
+	MessageType type;
+	if (!hello.Send(socket, MessageType::Hello) || !setup.Receive(socket, type) || type != MessageType::Setup)
+	{
+		return 1;
+	}
+
+	RenderSettings settings;
+	SceneParameters scene;
+	GetSetup(setup, settings, scene);
+	std::chrono::milliseconds heartbeatInterval(std::max(1, (int)setup.Get<int32_t>()));
+	settings.threadCount = threadCount;
+	if (!setup.IsValid())
+	{
+		return 1;
+	}
+
+	MaterialStorage materials;
+	MeshStorage meshes;
+	auto world = BuildWorld(scene, &materials, &meshes);
+	Renderer renderer(world.get(), MakeCamera(settings.width, settings.height), settings);
+	AccumulationBuffer accumulation(settings);
+	ThreadPool pool(threadCount);
+
+	if (!MessageWriter().Send(socket, MessageType::Ready))
+	{
+		return 1;
+	}
+
+	// Results go out from the pool's threads as soon as they are done,
+	// and heartbeats from a thread of their own, while this thread waits
+	// for the next job
+	std::mutex sendMutex;
+	HeartbeatSender heartbeat(socket, sendMutex, heartbeatInterval);
+	int jobCount = 0;
+
+	for (;;)
+	{
+		MessageReader message;
+		if (!message.Receive(socket, type) || type == MessageType::Shutdown ||
+			(type == MessageType::Job && tileLimit >= 0 && ++jobCount > tileLimit))
+		{
+			pool.Wait();
+			return type == MessageType::Shutdown ? 0 : 1;
+		}
+
+		if (type != MessageType::Job)
+		{
+			continue;
+		}
+
+		int id = message.Get<int32_t>();
+		Tile tile = message.GetTile();
+		int endSample = message.Get<int32_t>();
+		if (!message.GetEstimates(accumulation, tile))
+		{
+			pool.Wait();
+			return 1;
+		}
+
+		pool.Submit([&, id, tile, endSample]
+		{
+			renderer.RenderTile(tile, accumulation, endSample);
+
+			MessageWriter result;
+			result.Put<int32_t>(id);
+			result.PutTile(tile);
+			result.PutEstimates(accumulation, tile);
+
+			std::lock_guard<std::mutex> lock(sendMutex);
+			result.Send(socket, MessageType::Result);
+		});
+	}
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Accumulation.h"
+#include "Renderer.h"
+#include "SceneGenerator.h"
+#include "Socket.h"
+
+// Rendering one image on several processes, local or remote. A Coordinator
+// listens on a TCP port; workers (RunWorker) connect to it, are sent the
+// render settings and scene parameters, build the scene once, and then
+// render whatever tiles they are given for as long as they are connected.
+//
+// A job is one Renderer::TilePass: the coordinator sends the tile's pixel
+// estimates so far, and the worker sends them back brought up to the
+// pass's endSample. Since every (pixel, sample) has its own random stream,
+// the result is exactly what a single process would have rendered, no
+// matter which worker got which tile - adaptive passes included.
+//
+// Workers get as many jobs at a time as they have threads, and send a
+// heartbeat four times per workerTimeout however long their tiles take. A
+// worker that disconnects, or isn't heard from for workerTimeout seconds
+// while it has jobs, is dropped and its jobs go to the others. Once no
+// job is left to hand out, idle workers are also given copies of the jobs
+// still running elsewhere, and whichever copy comes back first is used;
+// so a slow machine holds up the end of a pass no longer than a fast one
+// would.
+
+const int DISTRIBUTED_PROTOCOL_VERSION = 2;
+const double DEFAULT_WORKER_TIMEOUT = 60.0;		// seconds
+const double WORKER_CONNECT_TIMEOUT = 10.0;		// how long a worker keeps trying to reach the coordinator
+const int WORKER_RECEIVE_TIMEOUT = 5000;		// milliseconds the coordinator waits for a hello, or the rest of a message
+
+class Coordinator
+{
+public:
+	Coordinator(const RenderSettings& settings, const SceneParameters& scene, double workerTimeout = DEFAULT_WORKER_TIMEOUT) :
+		settings{ settings }, scene{ scene }, workerTimeout{ workerTimeout } {}
+	~Coordinator() { Shutdown(); }
+
+	// Port 0 picks a free one; isPublic lets workers on other machines in
+	bool Listen(int port, bool isPublic);
+	int Port() const { return listener.LocalPort(); }
+
+	// Starts "count" copies of the executable as local workers, with
+	// threadsPerWorker threads each; returns how many could be started
+	int StartLocalWorkers(const std::string& executablePath, int count, int threadsPerWorker);
+
+	// Blocks until "count" workers have connected and built their scenes, or
+	// for at most timeout seconds; returns how many have. More may join
+	// later, during a render.
+	int WaitForWorkers(int count, double timeout);
+
+	int WorkerCount() const { return (int)workers.size(); }
+	int ReadyWorkerCount() const;
+	int LostWorkerCount() const { return lostWorkerCount; }
+	int DuplicateJobCount() const { return duplicateJobCount; }
+
+	// Like Renderer::RenderProgressive, with the tiles rendered by the
+	// workers; "scheduler" only decides what to render next, so it need
+	// not have a world. Returns false if every worker was lost, with the
+	// accumulation buffer holding the tiles that did come back - it can be
+	// carried on from, locally or otherwise.
+	bool RenderProgressive(const Renderer& scheduler, AccumulationBuffer& accumulation, int passSampleCount,
+						   const std::function<void(const AccumulationBuffer&)>& onPassDone);
+
+	// Tells the workers to exit, and waits for the local ones to
+	void Shutdown();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Job
+	{
+		Renderer::TilePass pass;
+		bool isDone = false;
+		int runningCount = 0;
+		Clock::time_point startTime;
+	};
+
+	// Job ids run on across passes, so that a late copy of a job from an
+	// earlier pass can't be taken for one of the current pass. A worker is
+	// never sent a tile it is still rendering, so its tiles don't overlap.
+	struct RunningJob
+	{
+		int id;
+		int x;
+		int y;
+	};
+
+	struct Worker
+	{
+		Socket socket;
+		int threadCount = 0;
+		bool isReady = false;			// has built its scene
+		std::vector<RunningJob> jobs;
+		Clock::time_point lastHeard;
+	};
+
+	struct Pass
+	{
+		std::vector<Job> jobs;
+		std::deque<int> pending;		// indices of the jobs no one is rendering
+		int firstJobId;
+		int doneCount = 0;
+	};
+
+	bool AcceptWorker();
+	bool RenderPass(Pass& pass, AccumulationBuffer& accumulation);
+	bool AssignJobs(Worker& worker, Pass& pass, const AccumulationBuffer& accumulation);
+	bool SendJob(Worker& worker, Pass& pass, int jobIndex, const AccumulationBuffer& accumulation);
+	bool HandleMessage(Worker& worker, Pass& pass, AccumulationBuffer& accumulation);
+	void DropWorker(size_t index, Pass& pass, const char* reason);
+
+	RenderSettings settings;
+	SceneParameters scene;
+	double workerTimeout;
+
+	Socket listener;
+	std::vector<Worker> workers;
+	std::vector<uintptr_t> processes;		// the local workers' process handles (ids)
+	int nextJobId = 0;
+	int lostWorkerCount = 0;
+	int duplicateJobCount = 0;
+};
+
+// Connects to the coordinator at host:port and renders tiles for it with
+// threadCount threads, until told to stop. Returns 0 then, 1 if the
+// coordinator couldn't be reached or the connection failed.
+//
+// With tileLimit >= 0, the worker drops the connection as soon as it is
+// sent more than tileLimit jobs, as if it had crashed; for tests.
+int RunWorker(const std::string& host, int port, int threadCount, int tileLimit = -1);
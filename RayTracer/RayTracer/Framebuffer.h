@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include "Vec3.h"
+
+// Pixels are stored in image order: row 0 is the top of the picture,
+// which is how the PPM writer wants them. The camera's "j" runs the
+// other way (0 is the bottom row), hence the flip in the renderer.
+
+class Framebuffer
+{
+public:
+	Framebuffer(int width, int height) : width{ width }, height{ height }, pixels((size_t)width * height) {}
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+
+	inline const Vec3& Get(int x, int y) const { return pixels[(size_t)y * width + x]; }
+	inline void Set(int x, int y, const Vec3& color) { pixels[(size_t)y * width + x] = color; }
+	inline const Vec3* Row(int y) const { return &pixels[(size_t)y * width]; }
+
+	void PrintTo(std::ostream& stream) const
+	{
+		for (const auto& pixel : pixels)
+		{
+			pixel.PrintRGB(stream);
+		}
+	}
+
+private:
+	int width;
+	int height;
+	std::vector<Vec3> pixels;
+};
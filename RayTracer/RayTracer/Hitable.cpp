@@ -1,177 +1,428 @@
 #include "pch.h"
 #include "Hitable.h"
 #include "Mesh.h"
-
-const float EPSILON = 0.000001f;
+#include "RenderStats.h"
+#include "Trace.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
 
 bool Triangle::Raycast(const Ray& ray, OUT HitInfo& hitInfo) const
 {
-	// Moeller - Trumbore algorithm, as found on Wikipedia (https://en.wikipedia.org/wiki/MllerTrumbore_intersection_algorithm),
-	// with added backface check
+	float t;
+	if (!IntersectTriangle(Vec3A(ray.Origin()), Vec3A(ray.Direction()), a, edgeAB, edgeAC, normal, hitInfo.ignoreBackFaces, t))
+	{
+		return false;
+	}
+
+	hitInfo.point = ray.At(t);
+	hitInfo.normal = normal.ToVec3();
+	hitInfo.distance = t;
+	hitInfo.materialPtr = material;
 
-	if (hitInfo.ignoreBackFaces && ray.Direction().Dot(normal) > 0.0f)
+	return true;
+}
+
+bool Sphere::Raycast(const Ray& ray, OUT HitInfo& hitInfo) const
+{
+	float t;
+	if (!IntersectSphere(Vec3A(ray.Origin()), Vec3A(ray.Direction()), origin, radius, hitInfo.ignoreBackFaces, t))
 	{
 		return false;
 	}
 
-	Vec3 rayXAC = ray.Direction().Cross(edgeAC);
-	float a = edgeAB.Dot(rayXAC);
-	if (a > -EPSILON && a < EPSILON)
+	hitInfo.point = ray.At(t);
+	hitInfo.normal = (Vec3A(hitInfo.point) - origin).Normalize().ToVec3();
+	hitInfo.distance = t;
+	hitInfo.materialPtr = material;
+
+	return true;
+}
+
+bool HitableList::Raycast(const Ray& ray, float tMin, float tMax, OUT HitInfo& hitInfo) const
+{
+	// A range that doesn't start at the origin is handled by moving the
+	// origin there, and moving the hit distance back afterwards
+	if (tMin > 0.0f)
+	{
+		if (!Raycast(Ray(ray.At(tMin), ray.Direction()), 0.0f, tMax - tMin, OUT hitInfo))
+		{
+			return false;
+		}
+
+		hitInfo.distance += tMin;
+		return true;
+	}
+
+	ClosestHit closest;
+	closest.distance = tMax;
+	bool ignoreBackFaces = hitInfo.ignoreBackFaces;
+
+	if (!HasAccelerationStructure())
 	{
-		return false;	// Ray is parallel to the triangle
+		IntersectTriangles(0, triangles.Count(), ray, ignoreBackFaces, closest);
+		IntersectSpheres(0, spheres.Count(), ray, ignoreBackFaces, closest);
+		IntersectInstances(0, InstanceCount(), ray, ignoreBackFaces, closest);
 	}
+	else
+	{
+		// Both traversals clip against closest.distance, so whatever the
+		// triangles hit first also culls the spheres behind it.
 
-	float f = 1.0f / a;
-	Vec3 s = ray.Origin() - this->a;
-	float u = f * s.Dot(rayXAC);
+		triangleBVH.Traverse(ray, closest.distance, [&](int first, int count, float&)
+		{
+			int previous = closest.index;
+			IntersectTriangles(first, count, ray, ignoreBackFaces, closest);
+			return closest.index != previous;
+		});
 
-	Vec3 q = s.Cross(edgeAB);
-	float v = f * ray.Direction().Dot(q);
+		sphereBVH.Traverse(ray, closest.distance, [&](int first, int count, float&)
+		{
+			int previous = closest.index;
+			IntersectSpheres(first, count, ray, ignoreBackFaces, closest);
+			return closest.index != previous;
+		});
 
-	// See Matt Godbolt's talk about how this might
-	// matter for branch prediction (CppCon 2019)
+		TraverseInstances(ray, ignoreBackFaces, closest);
+	}
 
-	if (u < 0.0f || u > 1.0f || v < 0.0f || u + v > 1.0f)
+	if (closest.type == HitableType::None)
 	{
 		return false;
 	}
 
-	float t = f * edgeAC.Dot(q);
+	ResolveHit(ray, closest, OUT hitInfo);
+	return true;
+}
 
-	if (t > EPSILON && t < 1.0f / EPSILON)
+bool HitableList::Occluded(const Ray& ray, float tMax, bool ignoreBackFaces) const
+{
+	if (!HasAccelerationStructure())
 	{
-		hitInfo.point = ray.At(t);
-		hitInfo.normal = normal;
-		hitInfo.materialPtr = material;
+		float distance = tMax;
+		return triangles.IntersectRange(0, triangles.Count(), ray, ignoreBackFaces, distance) >= 0 ||
+			   IsAnySphereHit(0, spheres.Count(), ray, ignoreBackFaces, tMax) ||
+			   IsAnyInstanceHit(0, InstanceCount(), ray, ignoreBackFaces, tMax);
+	}
 
-		return true;
+	// Triangle leaves are tested SIMD_WIDTH at a time anyway, so they go
+	// through the closest-hit kernel; any hit it reports will do.
+	bool isOccluded = triangleBVH.TraverseAny(ray, tMax, [&](int first, int count, float& distance)
+	{
+		float leafMax = distance;
+		return triangles.IntersectRange(first, count, ray, ignoreBackFaces, leafMax) >= 0;
+	});
+
+	if (!isOccluded)
+	{
+		isOccluded = sphereBVH.TraverseAny(ray, tMax, [&](int first, int count, float& distance)
+		{
+			return IsAnySphereHit(first, count, ray, ignoreBackFaces, distance);
+		});
 	}
 
-	return false;
+	if (!isOccluded)
+	{
+		isOccluded = instanceBVH.TraverseAny(ray, tMax, [&](int first, int count, float& distance)
+		{
+			return IsAnyInstanceHit(first, count, ray, ignoreBackFaces, distance);
+		});
+	}
+
+	return isOccluded;
 }
 
-bool Sphere::Raycast(const Ray& ray, OUT HitInfo& hitInfo) const
+void HitableList::RaycastPacket(const RayPacket& packet, bool ignoreBackFaces, OUT HitInfo* hits, OUT bool* isHit) const
 {
-	// if backfaces are to be ignored, and the ray starts closer
-	// to the origin than the radius => we're inside the sphere,
-	// no need to go on.
-
-	if (hitInfo.ignoreBackFaces && Contains(ray.Origin()))
+	if (!HasAccelerationStructure())
 	{
-		return false;
-	}
+		for (int i = 0; i < packet.size; ++i)
+		{
+			hits[i].ignoreBackFaces = ignoreBackFaces;
+			isHit[i] = Raycast(packet.rays[i], OUT hits[i]);
+		}
 
-	// 	Sphere equation: x * x + y * y + z * z == R * R
-	//	If the sphere is at (cx, cy, cz):
-	//	(x-cx)^2 + (y-cy)^2 + (z-cz)^2 == R^2
-	//	Conveniently, with vectors:
-	//	a vector pointing from the origin (C) to a point (p) on
-	//	the sphere's surface is p-C
-	//	but dot(p-C, p-C) is exactly (px - cx)^2 + (py - cy)^2 + (pz-cz)^2
-	//	
-	//  So if (dot(p-C, p-C) == R^2), then p is on the surface.
-	//
-	//	We have a ray, where p becomes
-	//	a + t * b, where a is the ray's origin, and b its direction
-	//
-	// So then:
-	// dot((a + t * b - C), (a + t * b - C)) == R^2
-	//
-	// expanding this, and taking advantage of the dot product
-	// we get the equasion:
-	//
-	// dot(b,b) * t^2 + 2 * dot(b, a-c) * t + dot(a-c, a-c) - R^2 = 0
-	//
-	// So this is a simple quadratic equation.
+		return;
+	}
 
-	Vec3 fromOriginToRayStart = ray.Origin() - origin;
+	ClosestHit closest[RayPacket::MAX_SIZE];
+	float distances[RayPacket::MAX_SIZE];
 
-	float a = ray.Direction().SqrMagnitude();
-	float b = 2.0f * ray.Direction().Dot(fromOriginToRayStart);
-	float c = fromOriginToRayStart.SqrMagnitude() - squaredRadius;
-	float d = b * b - 4.0f * a * c;
+	for (int i = 0; i < packet.size; ++i)
+	{
+		distances[i] = FLT_MAX;
+	}
 
-	// When casting a ray from inside, e.g. ray origin == origin:
-	// a = 1f;
-	// b = 0f;
-	// c = -4f;	   (because radius is, say, 2f)
-	// d = 20f;		
+	triangleBVH.TraversePacket(packet, distances, [&](int first, int count, int firstActive)
+	{
+		for (int i = firstActive; i < packet.size; ++i)
+		{
+			int index = triangles.IntersectRange(first, count, packet.rays[i], ignoreBackFaces, distances[i]);
+			if (index >= 0)
+			{
+				closest[i].type = HitableType::Triangle;
+				closest[i].index = index;
+			}
+		}
+	});
 
-	float t = -1.0f;
+	sphereBVH.TraversePacket(packet, distances, [&](int first, int count, int firstActive)
+	{
+		for (int i = firstActive; i < packet.size; ++i)
+		{
+			closest[i].distance = distances[i];
+			IntersectSpheres(first, count, packet.rays[i], ignoreBackFaces, closest[i]);
+			distances[i] = closest[i].distance;
+		}
+	});
 
-	if (d > 0.0f)
+	// Instances have a transform each, so the packet's rays wouldn't stay
+	// together in mesh space anyway; they go one at a time.
+	for (int i = 0; i < packet.size; ++i)
 	{
-		float sqrt = sqrtf(d);
-		float t0 = (-b + sqrt) / (a * 2.0f);
-		float t1 = (-b - sqrt) / (a * 2.0f);
+		closest[i].distance = distances[i];
+		TraverseInstances(packet.rays[i], ignoreBackFaces, closest[i]);
 
-		if (t0 > 0.0f && t1 > 0.0f) { t = t0 < t1 ? t0 : t1; }
-		else { t = t0 < t1 ? t1 : t0; }
+		isHit[i] = closest[i].type != HitableType::None;
+		if (isHit[i])
+		{
+			ResolveHit(packet.rays[i], closest[i], OUT hits[i]);
+		}
+	}
+}
 
-		hitInfo.point = ray.At(t);
-		hitInfo.normal = (hitInfo.point - origin).Normalize();
-		hitInfo.materialPtr = material;
+void HitableList::IntersectSpheres(int first, int count, const Ray& ray, bool ignoreBackFaces, ClosestHit& closest) const
+{
+	int index = spheres.IntersectRange(first, count, ray, ignoreBackFaces, closest.distance);
+	if (index >= 0)
+	{
+		closest.type = HitableType::Sphere;
+		closest.index = index;
 	}
+}
 
-	return t > 0.001f;
+void HitableList::IntersectTriangles(int first, int count, const Ray& ray, bool ignoreBackFaces, ClosestHit& closest) const
+{
+	int index = triangles.IntersectRange(first, count, ray, ignoreBackFaces, closest.distance);
+	if (index >= 0)
+	{
+		closest.type = HitableType::Triangle;
+		closest.index = index;
+	}
 }
 
-bool HitableList::Raycast(const Ray& ray, OUT HitInfo& hitInfo) const
+void HitableList::IntersectInstances(int first, int count, const Ray& ray, bool ignoreBackFaces, ClosestHit& closest) const
 {
-	float closestHitDistanceSquared = -1.0f;
-	HitInfo closestHit;
+	RT_STAT_ADD(instanceTests, count);
 
-	for (const auto& hitable : hitables)
+	for (int i = first; i < first + count; ++i)
 	{
-		if (hitable->Raycast(ray, OUT hitInfo))
+		const MeshInstance& instance = instances[i];
+		int triangle = instance.mesh->Intersect(ToMeshSpace(instance, ray), ignoreBackFaces, closest.distance);
+		if (triangle >= 0)
 		{
-			float dstSquared = (ray.Origin() - hitInfo.point).SqrMagnitude();
-			if (closestHitDistanceSquared < 0.0f || closestHitDistanceSquared > dstSquared)
-			{
-				closestHit = hitInfo;
-				closestHitDistanceSquared = dstSquared;
-			}
+			closest.type = HitableType::Instance;
+			closest.index = i;
+			closest.triangle = triangle;
+			RT_STAT_ADD(instanceHits, 1);
 		}
 	}
+}
 
-	if (closestHitDistanceSquared > 0.0f)
+// Like the triangles, spheres go through the closest-hit kernel; any hit
+// it reports will do.
+bool HitableList::IsAnySphereHit(int first, int count, const Ray& ray, bool ignoreBackFaces, float tMax) const
+{
+	return spheres.IntersectRange(first, count, ray, ignoreBackFaces, tMax) >= 0;
+}
+
+bool HitableList::IsAnyInstanceHit(int first, int count, const Ray& ray, bool ignoreBackFaces, float tMax) const
+{
+	for (int i = first; i < first + count; ++i)
 	{
-		hitInfo = closestHit;
-		return true;
+		RT_STAT_ADD(instanceTests, 1);
+		if (instances[i].mesh->Occluded(ToMeshSpace(instances[i], ray), ignoreBackFaces, tMax))
+		{
+			RT_STAT_ADD(instanceHits, 1);
+			return true;
+		}
 	}
 
 	return false;
 }
 
-HitableList::~HitableList()
+// An affine transform keeps the ray's parametrization, so distances in mesh
+// space and in world space are the same "t"
+Ray HitableList::ToMeshSpace(const MeshInstance& instance, const Ray& ray) const
 {
-	for (auto& ptr : hitables)
+	return Ray(instance.localToWorld.InverseTransformPoint(ray.Origin()),
+			   instance.localToWorld.InverseTransformVector(ray.Direction()));
+}
+
+void HitableList::TraverseInstances(const Ray& ray, bool ignoreBackFaces, ClosestHit& closest) const
+{
+	instanceBVH.Traverse(ray, closest.distance, [&](int first, int count, float&)
+	{
+		int previous = closest.index;
+		HitableType previousType = closest.type;
+		IntersectInstances(first, count, ray, ignoreBackFaces, closest);
+		return closest.index != previous || closest.type != previousType;
+	});
+}
+
+void HitableList::ResolveHit(const Ray& ray, const ClosestHit& closest, OUT HitInfo& hitInfo) const
+{
+	hitInfo.point = ray.At(closest.distance);
+	hitInfo.distance = closest.distance;
+
+	if (closest.type == HitableType::Sphere)
+	{
+		hitInfo.normal = spheres.Normal(closest.index, hitInfo.point);
+		hitInfo.materialPtr = materials[spheres.Material(closest.index)];
+	}
+	else if (closest.type == HitableType::Triangle)
 	{
-		delete ptr;
-	} 
+		hitInfo.normal = triangles.Normal(closest.index);
+		hitInfo.materialPtr = materials[triangles.Material(closest.index)];
+	}
+	else
+	{
+		const MeshInstance& instance = instances[closest.index];
+		Vec3 localNormal = instance.mesh->Triangles().Normal(closest.triangle);
+		hitInfo.normal = instance.localToWorld.TransformNormal(localNormal).Normalize();
+		hitInfo.materialPtr = materials[instance.material];
+	}
+}
+
+void HitableList::BuildAccelerationStructure()
+{
+	TraceScope scope("build BVH", "scene");
+	scope.AddArg("spheres", spheres.Count());
+	scope.AddArg("triangles", triangles.Count());
+	scope.AddArg("instances", InstanceCount());
+
+	std::vector<AABB> bounds;
+
+	bounds.reserve(spheres.Count());
+	for (int i = 0; i < spheres.Count(); ++i)
+	{
+		bounds.push_back(spheres.Bounds(i));
+	}
+
+	sphereBVH.Build(bounds);
+	spheres.Reorder(sphereBVH.PrimitiveOrder());
+
+	bounds.clear();
+	bounds.reserve(triangles.Count());
+	for (int i = 0; i < triangles.Count(); ++i)
+	{
+		bounds.push_back(triangles.Bounds(i));
+	}
+
+	// A leaf's triangles are tested together, SIMD_WIDTH at a time
+	triangleBVH.Build(bounds, std::max(BVH::MAX_LEAF_SIZE, SIMD_WIDTH));
+	triangles.Reorder(triangleBVH.PrimitiveOrder());
+
+	// The top level: one box per instance, in world space. Leaves hold a
+	// single instance, as each one means a change of space.
+	bounds.clear();
+	bounds.reserve(instances.size());
+	for (const auto& instance : instances)
+	{
+		instance.source->Finalize();
+		bounds.push_back(instance.localToWorld.TransformBounds(instance.mesh->Bounds()));
+	}
+
+	instanceBVH.Build(bounds, 1);
+
+	std::vector<MeshInstance> ordered;
+	ordered.reserve(instances.size());
+	for (int index : instanceBVH.PrimitiveOrder())
+	{
+		ordered.push_back(instances[index]);
+	}
+
+	instances.swap(ordered);
+}
+
+void HitableList::InvalidateAccelerationStructure()
+{
+	sphereBVH.Clear();
+	triangleBVH.Clear();
+	instanceBVH.Clear();
+}
+
+// Meshes are counted once, however many times they are placed
+size_t HitableList::MemoryFootprint() const
+{
+	std::vector<const MeshBVH*> meshes;
+	for (const auto& instance : instances)
+	{
+		meshes.push_back(instance.mesh);
+	}
+
+	std::sort(meshes.begin(), meshes.end());
+	meshes.erase(std::unique(meshes.begin(), meshes.end()), meshes.end());
+
+	size_t meshFootprint = 0;
+	for (auto mesh : meshes)
+	{
+		meshFootprint += mesh->MemoryFootprint();
+	}
+
+	return spheres.MemoryFootprint() + triangles.MemoryFootprint() + meshFootprint +
+		   instances.size() * sizeof(MeshInstance) +
+		   (sphereBVH.NodeCount() + triangleBVH.NodeCount() + instanceBVH.NodeCount()) * sizeof(BVHNode);
+}
+
+MaterialIndex HitableList::GetMaterialIndex(AMaterial* material)
+{
+	auto found = materialIndices.find(material);
+	if (found != materialIndices.end())
+	{
+		return found->second;
+	}
+
+	// Past this, the index would wrap around to some other material
+	if (materials.size() >= (size_t)MAX_MATERIAL_COUNT)
+	{
+		throw std::length_error("more than " + std::to_string(MAX_MATERIAL_COUNT) + " materials in one scene");
+	}
+
+	MaterialIndex index = (MaterialIndex)materials.size();
+	materials.push_back(material);
+	materialIndices.emplace(material, index);
+	return index;
 }
 
 int HitableList::AddSphere(const Vec3& origin, float radius, AMaterial* material)
 {
-	hitables.push_back(new Sphere(origin, radius, material));
-	return hitables.size();
+	InvalidateAccelerationStructure();
+	spheres.Add(origin, radius, GetMaterialIndex(material));
+	return Count();
 }
 
 int HitableList::AddTriangle(const Vec3& a, const Vec3& b, const Vec3& c, AMaterial* material)
 {
-	hitables.push_back(new Triangle(a, b, c, material));
-	return hitables.size();
+	InvalidateAccelerationStructure();
+	triangles.Add(a, b, c, GetMaterialIndex(material));
+	return Count();
 }
 
-int HitableList::AddMesh(Mesh* meshPtr, AMaterial* material, const Vec3& worldOffset)
+int HitableList::AddInstance(Mesh* meshPtr, AMaterial* material, const Transform& localToWorld)
 {
-	for (const auto& triangle : meshPtr->GetTriangles(material))
+	const MeshBVH& mesh = meshPtr->GetBVH();
+	if (mesh.IsEmpty())
 	{
-		Vec3 a = triangle.A() + worldOffset;
-		Vec3 b = triangle.B() + worldOffset;
-		Vec3 c = triangle.C() + worldOffset;
-		hitables.push_back(new Triangle(a, b, c, material));
+		return Count();
 	}
 
-	return hitables.size();
+	InvalidateAccelerationStructure();
+	instances.push_back(MeshInstance{ &mesh, localToWorld, GetMaterialIndex(material), meshPtr });
+	return Count();
+}
+
+int HitableList::AddMesh(Mesh* meshPtr, AMaterial* material, const Vec3& worldOffset)
+{
+	return AddInstance(meshPtr, material, Transform::Translation(worldOffset));
 }
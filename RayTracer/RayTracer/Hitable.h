@@ -1,17 +1,23 @@
 #pragma once
 #include "Ray.h"
+#include "BVH.h"
+#include "PrimitiveStore.h"
+#include "Transform.h"
+#include <unordered_map>
 #include <vector>
 
 #define OUT
 
 struct AMaterial;
 class Mesh;
+class MeshBVH;
 
 enum class HitableType
 {
 	None,
 	Sphere,
-	Triangle
+	Triangle,
+	Instance
 };
 
 class HitInfo
@@ -19,6 +25,7 @@ class HitInfo
 public:
 	Vec3 point;
 	Vec3 normal;
+	float distance;			// along the ray, in units of ray.Direction()
 	AMaterial* materialPtr;
 	bool ignoreBackFaces = true;
 };
@@ -29,6 +36,7 @@ public:
 	virtual ~AHitable() = default;
 
 	virtual bool Raycast(const Ray& ray, OUT HitInfo& hitInfo) const = 0;
+	virtual AABB Bounds() const = 0;
 	HitableType GetType() const { return type; }
 	AMaterial* GetMaterial() { return material; }
 
@@ -37,6 +45,9 @@ protected:
 	AMaterial* material = nullptr;
 };
 
+// Standalone Sphere and Triangle keep their geometry as Vec3A, so their
+// tests run on SSE registers (see Vec4.h).
+
 class Triangle : public AHitable
 {
 public:
@@ -45,26 +56,30 @@ public:
 		type = HitableType::Triangle;
 		material = mat;
 
-		edgeAB = b - a;
-		edgeAC = c - a;
+		edgeAB = this->b - this->a;
+		edgeAC = this->c - this->a;
 		normal = edgeAB.Cross(edgeAC).Normalize();
 	}
 
-	const Vec3& A() const noexcept { return a; }
-	const Vec3& B() const noexcept { return b; }
-	const Vec3& C() const noexcept { return c; }
+	Vec3 A() const noexcept { return a.ToVec3(); }
+	Vec3 B() const noexcept { return b.ToVec3(); }
+	Vec3 C() const noexcept { return c.ToVec3(); }
 
 	bool Raycast(const Ray& ray, OUT HitInfo& hitInfo) const override;
+	AABB Bounds() const override
+	{
+		return AABB(Min(Min(a, b), c).ToVec3(), Max(Max(a, b), c).ToVec3());
+	}
 
 private:
-	Vec3 a;
-	Vec3 b;
-	Vec3 c;
+	Vec3A a;
+	Vec3A b;
+	Vec3A c;
 
-	Vec3 edgeAB;
-	Vec3 edgeAC;
+	Vec3A edgeAB;
+	Vec3A edgeAC;
 
-	Vec3 normal;
+	Vec3A normal;
 };
 
 class Sphere : public AHitable
@@ -77,34 +92,116 @@ public:
 		squaredRadius = radius * radius; 
 	}
 
-	const Vec3& Origin() const { return origin; }
+	Vec3 Origin() const { return origin.ToVec3(); }
 	float Radius() const { return radius; }
 
 	bool Raycast(const Ray& ray, OUT HitInfo& hitInfo) const override;
+	AABB Bounds() const override
+	{
+		Vec3A extent(radius, radius, radius);
+		return AABB((origin - extent).ToVec3(), (origin + extent).ToVec3());
+	}
+
 	bool Contains(const Vec3& point) const
 	{
-		return (point - origin).SqrMagnitude() <= squaredRadius;
+		return (Vec3A(point) - origin).SqrMagnitude() <= squaredRadius;
 	}
 	
 private:
-	Vec3 origin;
+	Vec3A origin;
 	float radius;
 	float squaredRadius;
 };
 
+// The scene. Spheres and triangles are kept in flat arrays (see
+// PrimitiveStore.h) rather than as individually allocated AHitables, and
+// are intersected without any virtual calls; Sphere and Triangle remain
+// available as standalone AHitables.
+//
+// Meshes are instanced: the scene only stores a transform and a material
+// per placement, plus a top level BVH over the placements, and rays are
+// taken into mesh space to be tested against the mesh's own MeshBVH.
+
 class HitableList
 {
 public:
-	~HitableList();
-
+	// Each returns the new Count(). A primitive whose material would be the
+	// scene's MAX_MATERIAL_COUNT + 1st isn't added; std::length_error is
+	// thrown instead.
+	//
+	// Places the mesh with the given transform; nothing is copied, so
+	// placing the same mesh many times costs one MeshInstance each.
+	int AddInstance(Mesh* meshPtr, AMaterial* material, const Transform& localToWorld);
 	int AddMesh(Mesh* meshPtr, AMaterial* material, const Vec3& worldOffset);
 	int AddSphere(const Vec3& origin, float radius, AMaterial* material);
 	int AddTriangle(const Vec3& a, const Vec3& b, const Vec3& c, AMaterial* material);
 
-	int Count() const { return hitables.size(); }
-	bool Raycast(const Ray& ray, OUT HitInfo& hit) const;
+	int Count() const { return spheres.Count() + triangles.Count() + InstanceCount(); }
+	int InstanceCount() const { return (int)instances.size(); }
+	// Closest hit. Distances are in units of ray.Direction(); the second
+	// form only reports hits in (tMin, tMax). Primitives are tested against
+	// the best distance so far, and the point, normal and material are
+	// only worked out for the final winner.
+	bool Raycast(const Ray& ray, OUT HitInfo& hit) const { return Raycast(ray, 0.0f, FLT_MAX, OUT hit); }
+	bool Raycast(const Ray& ray, float tMin, float tMax, OUT HitInfo& hit) const;
+
+	// Any hit closer than tMax, for shadow and visibility rays: returns as
+	// soon as one is found, which need not be the closest.
+	bool Occluded(const Ray& ray, float tMax, bool ignoreBackFaces = true) const;
+
+	// Closest hits for a whole packet of coherent rays; "hits" and
+	// "isHit" need room for packet.size entries.
+	void RaycastPacket(const RayPacket& packet, bool ignoreBackFaces, OUT HitInfo* hits, OUT bool* isHit) const;
+
+	// Builds the BVHs over everything added so far. Until it is called -
+	// or after anything else is added - Raycast falls back to testing
+	// every primitive in turn.
+	void BuildAccelerationStructure();
+	bool HasAccelerationStructure() const { return !sphereBVH.IsEmpty() || !triangleBVH.IsEmpty() || !instanceBVH.IsEmpty(); }
+
+	const SphereStore& Spheres() const { return spheres; }
+	const TriangleStore& Triangles() const { return triangles; }
+	AMaterial* GetMaterial(MaterialIndex index) const { return materials[index]; }
+
+	size_t MemoryFootprint() const;
 
 private:
-	std::vector<AHitable*> hitables;
+	struct ClosestHit
+	{
+		HitableType type = HitableType::None;
+		int index = -1;
+		int triangle = -1;		// within the mesh, for instances
+		float distance;
+	};
+
+	struct MeshInstance
+	{
+		const MeshBVH* mesh;
+		Transform localToWorld;
+		MaterialIndex material;
+		Mesh* source;		// to bring "mesh" up to date if it has changed
+	};
+
+	MaterialIndex GetMaterialIndex(AMaterial* material);
+	void InvalidateAccelerationStructure();
+
+	void IntersectSpheres(int first, int count, const Ray& ray, bool ignoreBackFaces, ClosestHit& closest) const;
+	void IntersectTriangles(int first, int count, const Ray& ray, bool ignoreBackFaces, ClosestHit& closest) const;
+	void IntersectInstances(int first, int count, const Ray& ray, bool ignoreBackFaces, ClosestHit& closest) const;
+	void TraverseInstances(const Ray& ray, bool ignoreBackFaces, ClosestHit& closest) const;
+	bool IsAnySphereHit(int first, int count, const Ray& ray, bool ignoreBackFaces, float tMax) const;
+	bool IsAnyInstanceHit(int first, int count, const Ray& ray, bool ignoreBackFaces, float tMax) const;
+	Ray ToMeshSpace(const MeshInstance& instance, const Ray& ray) const;
+	void ResolveHit(const Ray& ray, const ClosestHit& closest, OUT HitInfo& hitInfo) const;
+
+	SphereStore spheres;
+	TriangleStore triangles;
+	std::vector<MeshInstance> instances;
+	std::vector<AMaterial*> materials;
+	std::unordered_map<const AMaterial*, MaterialIndex> materialIndices;
+
+	BVH sphereBVH;
+	BVH triangleBVH;
+	BVH instanceBVH;
 };
 
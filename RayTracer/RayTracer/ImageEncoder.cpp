@@ -0,0 +1,123 @@
+#include "pch.h"
+#include "ImageEncoder.h"
+#include "RayTracer.h"
+#include "SIMD.h"
+#include "Trace.h"
+#include <cstring>
+
+static_assert(sizeof(Vec3) == 3 * sizeof(float), "Rows of Vec3s are encoded as flat float arrays");
+
+namespace
+{
+	void AppendString(std::vector<char>& buffer, const std::string& text)
+	{
+		buffer.insert(buffer.end(), text.begin(), text.end());
+	}
+
+	void EncodeBinaryPPM(const Framebuffer& framebuffer, std::vector<char>& buffer)
+	{
+		std::ostringstream header;
+		header << "P6\n" << framebuffer.Width() << " " << framebuffer.Height() << "\n255\n";
+		AppendString(buffer, header.str());
+
+		size_t rowSize = 3 * (size_t)framebuffer.Width();
+		size_t start = buffer.size();
+		buffer.resize(start + rowSize * framebuffer.Height());
+
+		for (int y = 0; y < framebuffer.Height(); ++y)
+		{
+			QuantizeRow(framebuffer.Row(y), framebuffer.Width(), (uint8_t*)&buffer[start + y * rowSize]);
+		}
+	}
+
+	// PFM rows go from the bottom of the image to the top; a negative
+	// scale means little endian floats.
+	void EncodePFM(const Framebuffer& framebuffer, std::vector<char>& buffer)
+	{
+		std::ostringstream header;
+		header << "PF\n" << framebuffer.Width() << " " << framebuffer.Height() << "\n-1.0\n";
+		AppendString(buffer, header.str());
+
+		size_t rowSize = sizeof(Vec3) * (size_t)framebuffer.Width();
+		size_t start = buffer.size();
+		buffer.resize(start + rowSize * framebuffer.Height());
+
+		for (int y = 0; y < framebuffer.Height(); ++y)
+		{
+			size_t fileRow = framebuffer.Height() - 1 - y;
+			memcpy(&buffer[start + fileRow * rowSize], framebuffer.Row(y), rowSize);
+		}
+	}
+
+	void EncodeTextPPM(const Framebuffer& framebuffer, std::vector<char>& buffer)
+	{
+		std::ostringstream stream;
+		stream << CreatePPMHeader(framebuffer.Width(), framebuffer.Height());
+		framebuffer.PrintTo(stream);
+		AppendString(buffer, stream.str());
+	}
+}
+
+bool ParseImageFormat(const std::string& name, ImageFormat& format)
+{
+	if (name == "p3") { format = ImageFormat::TextPPM; return true; }
+	if (name == "p6") { format = ImageFormat::BinaryPPM; return true; }
+	if (name == "pfm") { format = ImageFormat::PFM; return true; }
+	return false;
+}
+
+const char* ImageFileExtension(ImageFormat format)
+{
+	return format == ImageFormat::PFM ? ".pfm" : ".ppm";
+}
+
+void QuantizeRow(const Vec3* pixels, int count, uint8_t* rgb)
+{
+	const float* values = (const float*)pixels;
+	int valueCount = 3 * count;
+
+	const SimdFloat scale = SimdFloat::Splat(255.0f);
+	const SimdFloat zero = SimdFloat::Splat(0.0f);
+
+	int32_t quantized[SIMD_WIDTH];
+	int i = 0;
+
+	// Max() comes first, so NaNs end up as 0
+	for (; i + SIMD_WIDTH <= valueCount; i += SIMD_WIDTH)
+	{
+		SimdFloat v = Min(Max(SimdFloat::Load(values + i) * scale, zero), scale);
+		v.StoreTruncated(quantized);
+
+		for (int lane = 0; lane < SIMD_WIDTH; ++lane)
+		{
+			rgb[i + lane] = (uint8_t)quantized[lane];
+		}
+	}
+
+	for (; i < valueCount; ++i)
+	{
+		rgb[i] = (uint8_t)(int)Minf(Maxf(values[i] * 255.0f, 0.0f), 255.0f);
+	}
+}
+
+std::vector<char> EncodeImage(const Framebuffer& framebuffer, ImageFormat format)
+{
+	TraceScope scope("encode image", "output");
+	std::vector<char> buffer;
+
+	switch (format)
+	{
+		case ImageFormat::TextPPM: EncodeTextPPM(framebuffer, buffer); break;
+		case ImageFormat::BinaryPPM: EncodeBinaryPPM(framebuffer, buffer); break;
+		case ImageFormat::PFM: EncodePFM(framebuffer, buffer); break;
+	}
+
+	return buffer;
+}
+
+void WriteImage(const Framebuffer& framebuffer, ImageFormat format, std::ostream& stream)
+{
+	TraceScope scope("write image", "output");
+	auto buffer = EncodeImage(framebuffer, format);
+	stream.write(buffer.data(), buffer.size());
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Framebuffer.h"
+
+// Turns a finished Framebuffer into an image file in memory, which is
+// then written with a single stream.write(). Binary PPM (P6) is the
+// default; the ASCII P3 that PrintRGB produces is kept for compatibility,
+// and PFM stores the raw floats for anyone who wants to tonemap later.
+
+enum class ImageFormat
+{
+	TextPPM,		// P3
+	BinaryPPM,		// P6
+	PFM
+};
+
+// Accepts "p3", "p6" and "pfm"; returns false for anything else.
+bool ParseImageFormat(const std::string& name, ImageFormat& format);
+const char* ImageFileExtension(ImageFormat format);
+
+// Clamps to [0, 1] and quantizes to 0..255, truncating just like
+// PrintRGB does; writes 3 * count bytes to "rgb".
+void QuantizeRow(const Vec3* pixels, int count, uint8_t* rgb);
+
+std::vector<char> EncodeImage(const Framebuffer& framebuffer, ImageFormat format);
+void WriteImage(const Framebuffer& framebuffer, ImageFormat format, std::ostream& stream);
@@ -0,0 +1,89 @@
+#include "pch.h"
+#include "Integrator.h"
+#include "Material.h"
+#include "RenderStats.h"
+
+Vec3 SampleSky(const Ray& ray)
+{
+	static const Vec3 missVectorVisualA{ 1.0f, 1.0f, 1.0f };
+	static const Vec3 missVectorVisualB{ 0.5f, 0.7f, 1.0f };
+
+	Vec3 unitVector = ray.Direction() / ray.Direction().Length();
+	float t = 0.5f * (unitVector.y() + 1.0f);
+	return Vec3::Lerp(missVectorVisualA, missVectorVisualB, t);
+}
+
+Vec3 ShadeHit(const Ray& ray, const HitInfo& hit, const HitableList* world, Sampler& sampler, int depth,
+			  const PathSettings& path, const Vec3& throughput)
+{
+	Ray scattered;
+	Vec3 attenuation;
+	sampler.StartBounce(depth);
+	if (hit.materialPtr->DoesScatter(ray, hit, sampler, attenuation, scattered))
+	{
+		RT_STAT_SCATTER(hit.materialPtr, true);
+
+		float survival = path.SurvivalProbability(depth, throughput * attenuation);
+		if (survival < 1.0f && sampler.Next1D() >= survival)
+		{
+			RT_STAT_PATH_END(depth, PathEnd::Roulette);
+			return Vec3();
+		}
+
+		attenuation = attenuation / survival;
+		return attenuation * SampleRecursiveWithMaterial(scattered, world, sampler, depth, path, throughput * attenuation);
+	}
+
+	RT_STAT_SCATTER(hit.materialPtr, false);
+	RT_STAT_PATH_END(depth, PathEnd::Absorbed);
+	return Vec3();
+}
+
+Vec3 SampleRecursiveWithMaterial(const Ray& ray, const HitableList* world, Sampler& sampler, int depth,
+								 const PathSettings& path, const Vec3& throughput)
+{
+	HitInfo hit;
+
+	depth += 1;
+	if (depth < path.maxDepth)
+	{
+		RT_STAT_RAYS(depth, 1);
+		if (world->Raycast(ray, OUT hit))
+		{
+			return ShadeHit(ray, hit, world, sampler, depth, path, throughput);
+		}
+	}
+
+	RT_STAT_PATH_END(depth, depth < path.maxDepth ? PathEnd::Escaped : PathEnd::Truncated);
+	return SampleSky(ray);
+}
+
+Vec3 SampleRecursive(const Ray& ray, const HitableList* world, Sampler& sampler, int depth, int maxDepth)
+{
+	HitInfo hit;
+
+	depth += 1;
+	if (depth < maxDepth)
+	{
+		if (world->Raycast(ray, OUT hit))
+		{
+			Vec3 direction = OrthonormalBasis(hit.normal).ToWorld(SampleCosineHemisphere(sampler.Next2D()).direction);
+			return SampleRecursive(Ray(hit.point, direction), world, sampler, depth, maxDepth) * 0.5f;
+		}
+	}
+
+	return SampleSky(ray);
+}
+
+Vec3 Sample(const Ray& ray, const HitableList* world)
+{
+	HitInfo hit;
+
+	if (world->Raycast(ray, OUT hit))
+	{
+		Vec3 normalClamped = hit.normal / 2.0f + Vec3(0.5f, 0.5f, 0.5f);
+		return Vec3(normalClamped.x(), normalClamped.y(), 1.0f - normalClamped.z());
+	}
+
+	return SampleSky(ray);
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "Ray.h"
+#include "Vec4.h"
+
+// The ray - primitive tests, shared by the AHitable classes and by the
+// flat primitive arrays in PrimitiveStore. They only compute the distance
+// along the ray; the hit point and normal are up to the caller.
+//
+// Each is written once for any vector type with Vec3's API: the Ray forms
+// run it on Vec3, the standalone Sphere and Triangle on Vec3A, whose
+// arithmetic is the same, so both give the same distances.
+
+const float EPSILON = 0.000001f;
+const float SPHERE_MIN_DISTANCE = 0.001f;
+
+template <typename Vector>
+inline bool IntersectTriangle(const Vector& rayOrigin, const Vector& rayDirection, const Vector& vertexA, const Vector& edgeAB,
+							  const Vector& edgeAC, const Vector& normal, bool ignoreBackFaces, float& t)
+{
+	// Moeller - Trumbore algorithm, as found on Wikipedia (https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm),
+	// with added backface check
+
+	if (ignoreBackFaces && rayDirection.Dot(normal) > 0.0f)
+	{
+		return false;
+	}
+
+	Vector rayXAC = rayDirection.Cross(edgeAC);
+	float a = edgeAB.Dot(rayXAC);
+	if (a > -EPSILON && a < EPSILON)
+	{
+		return false;	// Ray is parallel to the triangle
+	}
+
+	float f = 1.0f / a;
+	Vector s = rayOrigin - vertexA;
+	float u = f * s.Dot(rayXAC);
+
+	Vector q = s.Cross(edgeAB);
+	float v = f * rayDirection.Dot(q);
+
+	// See Matt Godbolt's talk about how this might
+	// matter for branch prediction (CppCon 2019)
+
+	if (u < 0.0f || u > 1.0f || v < 0.0f || u + v > 1.0f)
+	{
+		return false;
+	}
+
+	t = f * edgeAC.Dot(q);
+
+	return t > EPSILON && t < 1.0f / EPSILON;
+}
+
+template <typename Vector>
+inline bool IntersectSphere(const Vector& rayOrigin, const Vector& rayDirection, const Vector& origin, float radius,
+							bool ignoreBackFaces, float& t)
+{
+	float squaredRadius = radius * radius;
+	Vector fromOriginToRayStart = rayOrigin - origin;
+
+	// if backfaces are to be ignored, and the ray starts closer
+	// to the origin than the radius => we're inside the sphere,
+	// no need to go on.
+
+	if (ignoreBackFaces && fromOriginToRayStart.SqrMagnitude() <= squaredRadius)
+	{
+		return false;
+	}
+
+	// 	Sphere equation: x * x + y * y + z * z == R * R
+	//	If the sphere is at (cx, cy, cz):
+	//	(x-cx)^2 + (y-cy)^2 + (z-cz)^2 == R^2
+	//	Conveniently, with vectors:
+	//	a vector pointing from the origin (C) to a point (p) on
+	//	the sphere's surface is p-C
+	//	but dot(p-C, p-C) is exactly (px - cx)^2 + (py - cy)^2 + (pz-cz)^2
+	//
+	//  So if (dot(p-C, p-C) == R^2), then p is on the surface.
+	//
+	//	We have a ray, where p becomes
+	//	a + t * b, where a is the ray's origin, and b its direction
+	//
+	// So then:
+	// dot((a + t * b - C), (a + t * b - C)) == R^2
+	//
+	// expanding this, and taking advantage of the dot product
+	// we get the equasion:
+	//
+	// dot(b,b) * t^2 + 2 * dot(b, a-c) * t + dot(a-c, a-c) - R^2 = 0
+	//
+	// So this is a simple quadratic equation.
+
+	float a = rayDirection.SqrMagnitude();
+	float b = 2.0f * rayDirection.Dot(fromOriginToRayStart);
+	float c = fromOriginToRayStart.SqrMagnitude() - squaredRadius;
+	float d = b * b - 4.0f * a * c;
+
+	// When casting a ray from inside, e.g. ray origin == origin:
+	// a = 1f;
+	// b = 0f;
+	// c = -4f;	   (because radius is, say, 2f)
+	// d = 20f;
+
+	if (d <= 0.0f)
+	{
+		return false;
+	}
+
+	float sqrt = sqrtf(d);
+	float t0 = (-b + sqrt) / (a * 2.0f);
+	float t1 = (-b - sqrt) / (a * 2.0f);
+
+	if (t0 > 0.0f && t1 > 0.0f) { t = t0 < t1 ? t0 : t1; }
+	else { t = t0 < t1 ? t1 : t0; }
+
+	return t > SPHERE_MIN_DISTANCE;
+}
+
+inline bool IntersectTriangle(const Ray& ray, const Vec3& vertexA, const Vec3& edgeAB, const Vec3& edgeAC,
+							  const Vec3& normal, bool ignoreBackFaces, float& t)
+{
+	return IntersectTriangle(ray.Origin(), ray.Direction(), vertexA, edgeAB, edgeAC, normal, ignoreBackFaces, t);
+}
+
+inline bool IntersectSphere(const Ray& ray, const Vec3& origin, float radius, bool ignoreBackFaces, float& t)
+{
+	return IntersectSphere(ray.Origin(), ray.Direction(), origin, radius, ignoreBackFaces, t);
+}
@@ -0,0 +1,189 @@
+#include "pch.h"
+#include "RayTracer.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+int main(int argc, char* argv[])
+{
+	CommandLine commandLine(argc, argv);
+	const auto& args = commandLine.Positional();
+
+	if (args.size() > 0)
+	{
+		settings.sampleCount = std::stoi(args[0]);
+	}
+
+	if (args.size() > 1)
+	{
+		settings.maxDepth = std::stoi(args[1]);
+	}
+
+	settings.threadCount = commandLine.GetInt("threads", settings.threadCount);
+	settings.tileSize = commandLine.GetInt("tile", settings.tileSize);
+	settings.seed = commandLine.GetUInt64("seed", settings.seed);
+	settings.usePackets = commandLine.Has("packets");
+	settings.useWavefront = commandLine.Has("wavefront");
+	if (settings.usePackets && settings.useWavefront)
+	{
+		std::cout << "Use either --packets or --wavefront, not both" << std::endl;
+		return 1;
+	}
+	if (commandLine.Has("adaptive"))
+	{
+		settings.adaptiveThreshold = commandLine.GetFloat("adaptive", SUGGESTED_ADAPTIVE_THRESHOLD);
+	}
+	settings.rouletteDepth = commandLine.GetInt("roulette-depth", settings.rouletteDepth);
+	settings.rouletteMinSurvival = commandLine.GetFloat("roulette-survival", settings.rouletteMinSurvival);
+
+	// A worker gets everything else from its coordinator (see Distributed.h)
+	if (commandLine.Has("worker"))
+	{
+		std::string address = commandLine.GetString("worker", "");
+		size_t colon = address.rfind(':');
+		if (colon == std::string::npos)
+		{
+			std::cout << "Use --worker host:port" << std::endl;
+			return 1;
+		}
+
+		return RunWorker(address.substr(0, colon), std::stoi(address.substr(colon + 1)), settings.threadCount);
+	}
+
+	distributed.workerCount = commandLine.GetInt("workers", distributed.workerCount);
+	distributed.remoteWorkerCount = commandLine.GetInt("remote-workers", distributed.remoteWorkerCount);
+	distributed.port = commandLine.GetInt("port", distributed.port);
+	distributed.workerTimeout = commandLine.GetFloat("worker-timeout", (float)distributed.workerTimeout);
+	distributed.executablePath = argv[0];
+
+	progressive.passSampleCount = commandLine.GetInt("pass", progressive.passSampleCount);
+	progressive.checkpointPath = commandLine.GetString("checkpoint", progressive.checkpointPath);
+	progressive.checkpointInterval = commandLine.GetInt("checkpoint-interval", progressive.checkpointInterval);
+	progressive.resume = commandLine.Has("resume");
+	progressive.sampleMapPath = commandLine.GetString("sample-map", progressive.sampleMapPath);
+
+	sceneParameters.isGenerated = commandLine.GetString("scene", "demo") == "generated";
+	sceneParameters.seed = commandLine.GetUInt64("scene-seed", sceneParameters.seed);
+	sceneParameters.sphereCount = commandLine.GetInt("spheres", sceneParameters.sphereCount);
+	sceneParameters.meshCount = commandLine.GetInt("meshes", sceneParameters.meshCount);
+	sceneParameters.meshTriangleCount = commandLine.GetInt("mesh-triangles", sceneParameters.meshTriangleCount);
+	sceneParameters.instanceCount = commandLine.GetInt("instances", sceneParameters.instanceCount);
+	sceneParameters.materialCount = commandLine.GetInt("materials", sceneParameters.materialCount);
+	sceneParameters.clusterCount = commandLine.GetInt("clusters", sceneParameters.clusterCount);
+	sceneParameters.depth = commandLine.GetFloat("scene-depth", sceneParameters.depth);
+	sceneParameters.objectSize = commandLine.GetFloat("object-size", sceneParameters.objectSize);
+
+	if (sceneParameters.materialCount > MAX_MATERIAL_COUNT)
+	{
+		std::cout << "A scene can have at most " << MAX_MATERIAL_COUNT << " materials" << std::endl;
+		return 1;
+	}
+
+	if (commandLine.Has("sampler") && !ParseSamplerType(commandLine.GetString("sampler", ""), settings.samplerType))
+	{
+		std::cout << "Unknown sampler; use random, stratified, halton, sobol or blue-noise" << std::endl;
+		return 1;
+	}
+
+	// A render server gets its jobs from stdin, or from clients connecting
+	// to a local port (see RenderServer.h); the options so far are their
+	// defaults
+	if (commandLine.Has("serve"))
+	{
+		if (commandLine.Has("port"))
+		{
+			return RunServer(settings, sceneParameters, commandLine.GetInt("port", 0));
+		}
+
+#ifdef _WIN32
+		// Images can come back on stdout
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		return RunServer(settings, sceneParameters, std::cin, std::cout);
+	}
+
+	ImageFormat format = ImageFormat::BinaryPPM;
+	if (commandLine.Has("format") && !ParseImageFormat(commandLine.GetString("format", ""), format))
+	{
+		std::cout << "Unknown image format; use p3, p6 or pfm" << std::endl;
+		return 1;
+	}
+
+	std::string tracePath = commandLine.GetString("trace", "");
+	if (!tracePath.empty())
+	{
+		Trace::SetThreadName("main");
+		Trace::Enable();
+	}
+
+	// Next to the image: test_time.ppm, test_time.pfm, ...
+	const std::string imageName = "test";
+	if (commandLine.Has("cost-map"))
+	{
+		progressive.costMapPrefix = imageName;
+	}
+
+	std::cout << "Taking " << settings.sampleCount << " " << SamplerTypeName(settings.samplerType)
+			  << " samples per pixel; max depth: " << settings.maxDepth
+			  << "; threads: " << settings.threadCount << "; seed: " << settings.seed << std::endl;
+
+#ifdef RT_STATS
+	// --roulette-report: render without Russian roulette first, to compare
+	// path lengths against
+	bool isRouletteReport = commandLine.Has("roulette-report") && settings.rouletteDepth > 0;
+	RenderStats statsWithoutRoulette;
+	if (isRouletteReport)
+	{
+		RenderSettings rouletteSettings = settings;
+		settings.rouletteDepth = 0;
+		std::cout << "Without Russian roulette:" << std::endl;
+		RenderSimpleWorld(320, 200);
+		statsWithoutRoulette = Stats::Collect();
+		Stats::Reset();
+		settings = rouletteSettings;
+		std::cout << "With Russian roulette from depth " << settings.rouletteDepth << ":" << std::endl;
+	}
+#else
+	if (commandLine.Has("roulette-report"))
+	{
+		std::cout << "No roulette report: this build doesn't count path lengths (see RenderStats.h)" << std::endl;
+	}
+#endif
+
+	Stopwatch s("Main", true);
+	auto framebuffer = RenderSimpleWorld(320, 200);
+	OutputFile imageFile(imageName + ImageFileExtension(format), format != ImageFormat::TextPPM);
+	WriteImage(framebuffer, format, imageFile.GetStream());
+
+	if (!tracePath.empty() && !Trace::WriteChromeTrace(tracePath))
+	{
+		std::cout << "Failed to write trace '" << tracePath << "'" << std::endl;
+	}
+
+	std::string statsPath = commandLine.GetString("stats-json", "");
+#ifdef RT_STATS
+	RenderStats stats = Stats::Collect();
+	stats.PrintSummary(std::cout);
+
+	if (isRouletteReport)
+	{
+		double fullLength = statsWithoutRoulette.AveragePathLength();
+		double saved = fullLength - stats.AveragePathLength();
+		std::cout << "Russian roulette saved " << saved << " of " << fullLength << " rays per path ("
+				  << (fullLength > 0.0 ? 100.0 * saved / fullLength : 0.0) << "%)" << std::endl;
+	}
+
+	if (!statsPath.empty())
+	{
+		OutputFile statsFile(statsPath);
+		stats.WriteJson(statsFile.GetStream());
+	}
+#else
+	if (!statsPath.empty())
+	{
+		std::cout << "No statistics to write: this build doesn't collect them (see RenderStats.h)" << std::endl;
+	}
+#endif
+}
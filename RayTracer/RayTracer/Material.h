@@ -1,5 +1,9 @@
 #pragma once
+#include <memory>
+#include <string>
+#include "Arena.h"
 #include "Hitable.h"
+#include "Sampling.h"
 #include "Utilities.h"
 
 struct AMaterial
@@ -7,7 +11,7 @@ struct AMaterial
 public:
 	AMaterial(const std::string& name) : name{ name } {}
 
-	virtual bool DoesScatter(const Ray& ray, const HitInfo& hit,
+	virtual bool DoesScatter(const Ray& ray, const HitInfo& hit, Sampler& sampler,
 							 OUT Vec3& attenuation,
 							 OUT Ray& scatteredRay) const = 0;
 
@@ -19,12 +23,14 @@ struct DiffuseMaterial : public AMaterial
 {
 public:
 	DiffuseMaterial(const std::string& name, const Vec3& a, float diffuseFactor) : AMaterial{ name }, albedo { a }, diffuseFactor{ diffuseFactor } {}
-	bool DoesScatter(const Ray& ray, const HitInfo& hit,
+	bool DoesScatter(const Ray& ray, const HitInfo& hit, Sampler& sampler,
 					 OUT Vec3& attenuation,
 					 OUT Ray& scatteredRay) const override
 	{
-		Vec3 target = hit.point + hit.normal + Utilities::GetRandomUnitVector();
-		scatteredRay = Ray(hit.point, target - hit.point);
+		// Lambertian: sampling cos(theta) / pi, the cosine and the pdf cancel
+		// out and leave the albedo as the weight
+		DirectionSample sample = SampleCosineHemisphere(sampler.Next2D());
+		scatteredRay = Ray(hit.point, OrthonormalBasis(hit.normal).ToWorld(sample.direction));
 		attenuation = albedo * diffuseFactor;
 		return true;
 	}
@@ -37,7 +43,7 @@ struct MetallicMaterial : public AMaterial
 {
 public:
 	MetallicMaterial(const std::string& name, const Vec3& albedo) : AMaterial{ name }, albedo { albedo } {}
-	bool DoesScatter(const Ray& ray, const HitInfo& hit,
+	bool DoesScatter(const Ray& ray, const HitInfo& hit, Sampler& /*sampler*/,
 					 OUT Vec3& attenuation,
 					 OUT Ray& scatteredRay) const override
 	{
@@ -51,17 +57,19 @@ public:
 	Vec3 albedo;
 };
 
+// Materials are built in place in the storage's arena, next to each other,
+// and all go when the storage does.
 class MaterialStorage
 {
 public:
 	MaterialStorage()
 	{
-		diffuse = std::make_unique<DiffuseMaterial>(DiffuseMaterial("def_diffuse", Vec3(1.0f, 0.6f, 0.6f), 0.8f));
-		metallic = std::make_unique<MetallicMaterial>(MetallicMaterial("def_metallic", Vec3(0.5f, 0.5f, 0.8f)));
+		diffuse = arena.New<DiffuseMaterial>("def_diffuse", Vec3(1.0f, 0.6f, 0.6f), 0.8f);
+		metallic = arena.New<MetallicMaterial>("def_metallic", Vec3(0.5f, 0.5f, 0.8f));
 	}
 
-	AMaterial* GetDiffuse() { return diffuse.get(); }
-	AMaterial* GetMetallic() { return metallic.get(); }
+	AMaterial* GetDiffuse() { return diffuse; }
+	AMaterial* GetMetallic() { return metallic; }
 
 	void CreateMaterial(const std::string& name, bool diffuse, Vec3 albedo, float diffuseParam)
 	{
@@ -71,33 +79,32 @@ public:
 
 	void CreateDiffuseMaterial(const std::string& name, Vec3 albedo, float diffuseParam)
 	{
-		auto mat = std::make_unique<DiffuseMaterial>(DiffuseMaterial(name, albedo, diffuseParam));
-		storage.push_back(std::move(mat));
+		storage.push_back(arena.New<DiffuseMaterial>(name, albedo, diffuseParam));
 	}
 
 	void CreateMetallicMaterial(const std::string& name, Vec3 albedo)
 	{
-		auto mat = std::make_unique<MetallicMaterial>(MetallicMaterial(name, albedo));
-		storage.push_back(std::move(mat));
+		storage.push_back(arena.New<MetallicMaterial>(name, albedo));
 	}
 
 	AMaterial* Get(const std::string& name)
 	{
-		for (auto& material : storage)
+		for (auto material : storage)
 		{
 			if (material->name == name)
 			{
-				return material.get();
+				return material;
 			}
 		}
 
 		return nullptr;
 	}
 
-
 private:
-	std::unique_ptr<AMaterial> diffuse;
-	std::unique_ptr<AMaterial> metallic;
+	Arena arena;	// first, so that it outlives the pointers into it
+
+	AMaterial* diffuse;
+	AMaterial* metallic;
 
-	std::vector<std::unique_ptr<AMaterial>> storage;
+	std::vector<AMaterial*> storage;
 };
@@ -0,0 +1,54 @@
+#include "pch.h"
+#include "Mesh.h"
+#include "Trace.h"
+#include <algorithm>
+
+void MeshBVH::Build(const std::vector<Vec3>& vertices, const std::vector<int>& indices)
+{
+	TraceScope scope("build mesh BVH", "scene");
+	scope.AddArg("triangles", (int64_t)indices.size() / 3);
+	triangles = TriangleStore();
+
+	for (size_t index = 0; index + 2 < indices.size(); index += 3)
+	{
+		// The material comes from the instance
+		triangles.Add(vertices[indices[index]], vertices[indices[index + 1]], vertices[indices[index + 2]], 0);
+	}
+
+	std::vector<AABB> bounds;
+	bounds.reserve(triangles.Count());
+	for (int i = 0; i < triangles.Count(); ++i)
+	{
+		bounds.push_back(triangles.Bounds(i));
+	}
+
+	bvh.Build(bounds, std::max(BVH::MAX_LEAF_SIZE, SIMD_WIDTH));
+	triangles.Reorder(bvh.PrimitiveOrder());
+}
+
+int MeshBVH::Intersect(const Ray& ray, bool ignoreBackFaces, float& tMax) const
+{
+	int closest = -1;
+
+	bvh.Traverse(ray, tMax, [&](int first, int count, float& leafMax)
+	{
+		int index = triangles.IntersectRange(first, count, ray, ignoreBackFaces, leafMax);
+		if (index >= 0)
+		{
+			closest = index;
+		}
+
+		return index >= 0;
+	});
+
+	return closest;
+}
+
+bool MeshBVH::Occluded(const Ray& ray, bool ignoreBackFaces, float tMax) const
+{
+	return bvh.TraverseAny(ray, tMax, [&](int first, int count, float& distance)
+	{
+		float leafMax = distance;
+		return triangles.IntersectRange(first, count, ray, ignoreBackFaces, leafMax) >= 0;
+	});
+}
@@ -1,12 +1,93 @@
 #pragma once
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
+#include "Arena.h"
 #include "Vec3.h"
-#include "Hitable.h";
+#include "Hitable.h"
 
+// The bottom level of the instancing scheme: a mesh's triangles and a BVH
+// over them, both in the mesh's own space. It is built once per mesh and
+// shared by every instance of it (see HitableList::AddInstance).
+
+class MeshBVH
+{
+public:
+	void Build(const std::vector<Vec3>& vertices, const std::vector<int>& indices);
+
+	bool IsEmpty() const { return bvh.IsEmpty(); }
+	const TriangleStore& Triangles() const { return triangles; }
+	AABB Bounds() const { return bvh.IsEmpty() ? AABB() : bvh.Nodes()[0].bounds; }
+	size_t MemoryFootprint() const { return triangles.MemoryFootprint() + bvh.NodeCount() * sizeof(BVHNode); }
+
+	// Returns the index of the closest triangle hit nearer than tMax (-1 if
+	// none), updating tMax; "ray" is in mesh space.
+	int Intersect(const Ray& ray, bool ignoreBackFaces, float& tMax) const;
+	bool Occluded(const Ray& ray, bool ignoreBackFaces, float tMax) const;
+
+private:
+	TriangleStore triangles;
+	BVH bvh;
+};
+
+// Changing a mesh makes its BVH out of date; it is rebuilt by the next
+// Finalize() or GetBVH(), or when a HitableList it is placed in builds its
+// acceleration structure. Changing a mesh isn't thread safe, but
+// finalizing it is, so it can be placed from several threads at once.
 class Mesh
 {
 public:
 	Mesh(const std::string& name) : name{ name } {}
+
+	int AddVertex(const Vec3& vertex)
+	{
+		isBVHCurrent = false;
+		vertices.push_back(vertex);
+		return (int)vertices.size() - 1;
+	}
+
+	void SetVertex(int index, const Vec3& vertex)
+	{
+		isBVHCurrent = false;
+		vertices[index] = vertex;
+	}
+
+	void AddTriangle(int a, int b, int c)
+	{
+		isBVHCurrent = false;
+		indices.push_back(a);
+		indices.push_back(b);
+		indices.push_back(c);
+	}
+
+	void Reserve(size_t vertexCount, size_t triangleCount)
+	{
+		vertices.reserve(vertexCount);
+		indices.reserve(3 * triangleCount);
+	}
+
+	const std::vector<Vec3>& Vertices() const { return vertices; }
+	const std::vector<int>& Indices() const { return indices; }
+	int TriangleCount() const { return (int)indices.size() / 3; }
+
+	// Builds the BVH, unless it is up to date
+	void Finalize()
+	{
+		std::lock_guard<std::mutex> lock(bvhMutex);
+		if (!isBVHCurrent)
+		{
+			bvh.Build(vertices, indices);
+			isBVHCurrent = true;
+		}
+	}
+
+	const MeshBVH& GetBVH()
+	{
+		Finalize();
+		return bvh;
+	}
+
 	std::vector<Triangle> GetTriangles(AMaterial* material) const
 	{
 		std::vector<Triangle> tris;
@@ -29,26 +110,34 @@ public:
 
 	const std::string name;
 
+private:
 	std::vector<Vec3> vertices;
 	std::vector<int> indices;
+
+	std::mutex bvhMutex;
+	MeshBVH bvh;
+	bool isBVHCurrent = false;
 };
 
+// Like MaterialStorage, keeps its meshes side by side in an arena; their
+// vertices, indices and BVHs are separate arrays of their own.
 class MeshStorage
 {
 public:
 	Mesh* Create(const std::string& name)
 	{
-		storage.push_back(std::make_unique<Mesh>(name));
-		return Get(name);
+		Mesh* mesh = arena.New<Mesh>(name);
+		storage.push_back(mesh);
+		return mesh;
 	}
 
 	Mesh* Get(const std::string& name)
 	{
-		for (auto& mesh : storage)
+		for (auto mesh : storage)
 		{
 			if (mesh->name == name)
 			{
-				return mesh.get();
+				return mesh;
 			}
 		}
 
@@ -56,5 +145,6 @@ public:
 	}
 
 private:
-	std::vector<std::unique_ptr<Mesh>> storage;
+	Arena arena;
+	std::vector<Mesh*> storage;
 };
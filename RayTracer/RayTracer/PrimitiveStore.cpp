@@ -0,0 +1,46 @@
+#include "pch.h"
+#include "PrimitiveStore.h"
+
+namespace
+{
+	template <typename T, typename Allocator>
+	void Permute(std::vector<T, Allocator>& values, const std::vector<int>& order)
+	{
+		std::vector<T, Allocator> permuted;
+		permuted.reserve(values.size());
+
+		for (int index : order)
+		{
+			permuted.push_back(values[index]);
+		}
+
+		values.swap(permuted);
+	}
+}
+
+void SphereStore::Reorder(const std::vector<int>& order)
+{
+	for (auto array : HotArrays())
+	{
+		Permute(*array, order);
+		array->resize(array->size() + PADDING, 0.0f);
+	}
+
+	Permute(materials, order);
+}
+
+void TriangleStore::Reorder(const std::vector<int>& order)
+{
+	for (auto array : HotArrays())
+	{
+		Permute(*array, order);
+		array->resize(array->size() + PADDING, 0.0f);
+	}
+
+	for (auto array : { &aX, &aY, &aZ, &abX, &abY, &abZ, &acX, &acY, &acZ, &normalX, &normalY, &normalZ })
+	{
+		Permute(*array, order);
+	}
+
+	Permute(materials, order);
+}
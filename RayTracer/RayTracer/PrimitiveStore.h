@@ -0,0 +1,221 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "AABB.h"
+#include "AlignedAllocator.h"
+#include "Intersection.h"
+#include "SIMD.h"
+
+// Flat, structure-of-arrays storage for the primitives of a HitableList.
+// Every attribute lives in its own contiguous array, so walking a range of
+// primitives streams through memory instead of chasing a pointer (and a
+// vtable) per primitive. Materials are referred to by a 16 bit index into
+// the owning HitableList's material table.
+
+typedef uint16_t MaterialIndex;
+
+// How many different materials one HitableList can refer to
+const int MAX_MATERIAL_COUNT = std::numeric_limits<MaterialIndex>::max() + 1;
+
+// Like the triangles' below, the sphere arrays are 64 byte aligned and
+// padded with SIMD_WIDTH - 1 zeroed entries for IntersectRange; a sphere
+// of radius zero never reports a hit.
+
+class SphereStore
+{
+public:
+	SphereStore()
+	{
+		for (auto array : HotArrays())
+		{
+			array->assign(PADDING, 0.0f);
+		}
+	}
+
+	int Add(const Vec3& origin, float radius, MaterialIndex material)
+	{
+		originX.insert(originX.end() - PADDING, origin.x());
+		originY.insert(originY.end() - PADDING, origin.y());
+		originZ.insert(originZ.end() - PADDING, origin.z());
+		radii.insert(radii.end() - PADDING, radius);
+		materials.push_back(material);
+		return Count() - 1;
+	}
+
+	int Count() const { return (int)materials.size(); }
+	size_t MemoryFootprint() const { return Count() * (4 * sizeof(float) + sizeof(MaterialIndex)); }
+
+	inline Vec3 Origin(int i) const { return Vec3(originX[i], originY[i], originZ[i]); }
+	inline float Radius(int i) const { return radii[i]; }
+	inline MaterialIndex Material(int i) const { return materials[i]; }
+
+	inline AABB Bounds(int i) const
+	{
+		Vec3 extent(radii[i], radii[i], radii[i]);
+		return AABB(Origin(i) - extent, Origin(i) + extent);
+	}
+
+	inline bool Intersect(int i, const Ray& ray, bool ignoreBackFaces, float& t) const
+	{
+		return IntersectSphere(ray, Origin(i), radii[i], ignoreBackFaces, t);
+	}
+
+	inline Vec3 Normal(int i, const Vec3& point) const
+	{
+		return (point - Origin(i)).Normalize();
+	}
+
+	// Tests spheres [first, first + count) and returns the index of the
+	// closest one nearer than tMax (-1 if none), updating tMax to its
+	// distance. Uses SIMD_WIDTH spheres per step, and gives the same
+	// distances as Intersect().
+	int IntersectRange(int first, int count, const Ray& ray, bool ignoreBackFaces, float& tMax) const;
+
+	// The same, one sphere at a time; kept around to verify the above.
+	int IntersectRangeScalar(int first, int count, const Ray& ray, bool ignoreBackFaces, float& tMax) const;
+
+	void Reorder(const std::vector<int>& order);
+
+private:
+	static const int PADDING = SIMD_WIDTH - 1;
+
+	std::vector<AlignedVector<float>*> HotArrays()
+	{
+		return { &originX, &originY, &originZ, &radii };
+	}
+
+	AlignedVector<float> originX;
+	AlignedVector<float> originY;
+	AlignedVector<float> originZ;
+	AlignedVector<float> radii;
+	std::vector<MaterialIndex> materials;
+};
+
+// Triangles are kept twice. The hot arrays hold only what IntersectRange
+// reads: for each triangle, the 3x4 affine transform (Woop et al., "Real
+// Time Ray Tracing of Dynamic Scenes") taking world space to the triangle's
+// unit space, where the triangle is (0,0,0), (1,0,0), (0,1,0) and its plane
+// is z = 0. A test is then a handful of dot products, with no cross product
+// or reciprocal per triangle. The cold arrays keep the vertex, edges and
+// normal, and are only read for a hit (shading) or at build time (bounds).
+//
+// The hot arrays are 64 byte aligned and padded with SIMD_WIDTH - 1 zeroed
+// entries, so that IntersectRange can always load full SIMD registers, even
+// for the last few triangles; a zeroed transform never reports a hit.
+
+class TriangleStore
+{
+public:
+	TriangleStore()
+	{
+		for (auto array : HotArrays())
+		{
+			array->assign(PADDING, 0.0f);
+		}
+	}
+
+	int Add(const Vec3& a, const Vec3& b, const Vec3& c, MaterialIndex material)
+	{
+		Vec3 edgeAB = b - a;
+		Vec3 edgeAC = c - a;
+		Vec3 normal = edgeAB.Cross(edgeAC).Normalize();
+
+		aX.push_back(a.x()); aY.push_back(a.y()); aZ.push_back(a.z());
+		abX.push_back(edgeAB.x()); abY.push_back(edgeAB.y()); abZ.push_back(edgeAB.z());
+		acX.push_back(edgeAC.x()); acY.push_back(edgeAC.y()); acZ.push_back(edgeAC.z());
+		normalX.push_back(normal.x()); normalY.push_back(normal.y()); normalZ.push_back(normal.z());
+		materials.push_back(material);
+
+		float transform[12];
+		ComputeUnitTransform(a, edgeAB, edgeAC, transform);
+		auto hotArrays = HotArrays();
+		for (int i = 0; i < 12; ++i)
+		{
+			hotArrays[i]->insert(hotArrays[i]->end() - PADDING, transform[i]);
+		}
+
+		return Count() - 1;
+	}
+
+	int Count() const { return (int)materials.size(); }
+	size_t MemoryFootprint() const { return Count() * (24 * sizeof(float) + sizeof(MaterialIndex)); }
+
+	inline Vec3 A(int i) const { return Vec3(aX[i], aY[i], aZ[i]); }
+	inline Vec3 EdgeAB(int i) const { return Vec3(abX[i], abY[i], abZ[i]); }
+	inline Vec3 EdgeAC(int i) const { return Vec3(acX[i], acY[i], acZ[i]); }
+	inline Vec3 Normal(int i) const { return Vec3(normalX[i], normalY[i], normalZ[i]); }
+	inline MaterialIndex Material(int i) const { return materials[i]; }
+
+	inline AABB Bounds(int i) const
+	{
+		Vec3 a = A(i);
+		Vec3 b = a + EdgeAB(i);
+		Vec3 c = a + EdgeAC(i);
+		return AABB(Min(Min(a, b), c), Max(Max(a, b), c));
+	}
+
+	inline bool Intersect(int i, const Ray& ray, bool ignoreBackFaces, float& t) const
+	{
+		return IntersectTriangle(ray, A(i), EdgeAB(i), EdgeAC(i), Normal(i), ignoreBackFaces, t);
+	}
+
+	// Tests triangles [first, first + count) and returns the index of the
+	// closest one nearer than tMax (-1 if none), updating tMax to its
+	// distance. Uses SIMD_WIDTH triangles per step, on the hot arrays only.
+	int IntersectRange(int first, int count, const Ray& ray, bool ignoreBackFaces, float& tMax) const;
+
+	// The same, one triangle at a time with Moeller - Trumbore on the cold
+	// arrays; kept around to verify the above.
+	int IntersectRangeScalar(int first, int count, const Ray& ray, bool ignoreBackFaces, float& tMax) const;
+
+	void Reorder(const std::vector<int>& order);
+
+private:
+	static const int PADDING = SIMD_WIDTH - 1;
+
+	// Rows of the inverse of the matrix whose columns are edgeAB, edgeAC and
+	// their cross product n, with the translation folded in. Degenerate
+	// triangles get a zero transform, which never hits.
+	static void ComputeUnitTransform(const Vec3& a, const Vec3& edgeAB, const Vec3& edgeAC, float transform[12])
+	{
+		Vec3 n = edgeAB.Cross(edgeAC);
+		float determinant = n.SqrMagnitude();
+		if (!(determinant > 0.0f))
+		{
+			for (int i = 0; i < 12; ++i)
+			{
+				transform[i] = 0.0f;
+			}
+
+			return;
+		}
+
+		Vec3 rows[3] = { edgeAC.Cross(n), n.Cross(edgeAB), n };
+		for (int r = 0; r < 3; ++r)
+		{
+			Vec3 row = rows[r] * (1.0f / determinant);
+			transform[r * 4 + 0] = row.x();
+			transform[r * 4 + 1] = row.y();
+			transform[r * 4 + 2] = row.z();
+			transform[r * 4 + 3] = -row.Dot(a);
+		}
+	}
+
+	std::vector<AlignedVector<float>*> HotArrays()
+	{
+		return { &uX, &uY, &uZ, &uW, &vX, &vY, &vZ, &vW, &wX, &wY, &wZ, &wW };
+	}
+
+	// Hot: world to unit triangle space, one row per unit axis
+	AlignedVector<float> uX, uY, uZ, uW;
+	AlignedVector<float> vX, vY, vZ, vW;
+	AlignedVector<float> wX, wY, wZ, wW;
+
+	// Cold
+	std::vector<float> aX, aY, aZ;
+	std::vector<float> abX, abY, abZ;
+	std::vector<float> acX, acY, acZ;
+	std::vector<float> normalX, normalY, normalZ;
+	std::vector<MaterialIndex> materials;
+};
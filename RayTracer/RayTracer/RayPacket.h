@@ -0,0 +1,102 @@
+#pragma once
+#include "AABB.h"
+
+// A bundle of up to MAX_SIZE coherent rays - typically the primary rays of
+// an 8x8 pixel block - that are traced through the BVH together: a node is
+// fetched once for the whole packet, and skipped altogether if the packet's
+// interval bounds (see Finalize()) prove that no ray in it can hit the box.
+
+struct RayPacket
+{
+	static const int MAX_SIZE = 64;
+
+	void Clear() { size = 0; }
+
+	void Add(const Ray& ray)
+	{
+		rays[size] = ray;
+		inverseDirections[size] = Vec3(1.0f / ray.Direction().x(), 1.0f / ray.Direction().y(), 1.0f / ray.Direction().z());
+		size++;
+	}
+
+	// Computes the origin and inverse direction intervals of the packet;
+	// call after the last Add().
+	void Finalize()
+	{
+		minOrigin = maxOrigin = rays[0].Origin();
+		minInverseDirection = maxInverseDirection = inverseDirections[0];
+
+		for (int i = 1; i < size; ++i)
+		{
+			minOrigin = Min(minOrigin, rays[i].Origin());
+			maxOrigin = Max(maxOrigin, rays[i].Origin());
+			minInverseDirection = Min(minInverseDirection, inverseDirections[i]);
+			maxInverseDirection = Max(maxInverseDirection, inverseDirections[i]);
+		}
+
+		// Interval culling only works if, along every axis, all rays
+		// enter the box through the same slab plane. Rays parallel to an
+		// axis (infinite inverse direction) would turn the interval
+		// products into NaNs, so those packets aren't culled either.
+		hasCommonSigns = true;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			hasCommonSigns = hasCommonSigns &&
+							 (minInverseDirection[axis] > 0.0f) == (maxInverseDirection[axis] > 0.0f) &&
+							 fabsf(minInverseDirection[axis]) <= FLT_MAX &&
+							 fabsf(maxInverseDirection[axis]) <= FLT_MAX;
+		}
+	}
+
+	// Conservative test: false means none of the rays can hit the box
+	// closer than tMax.
+	inline bool MayHit(const AABB& box, float tMax) const
+	{
+		if (!hasCommonSigns)
+		{
+			return true;
+		}
+
+		float tEnter = 0.0f;
+		float tExit = tMax;
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			bool isPositive = minInverseDirection[axis] > 0.0f;
+			float enterPlane = isPositive ? box.min[axis] : box.max[axis];
+			float exitPlane = isPositive ? box.max[axis] : box.min[axis];
+
+			float enterLow, enterHigh, exitLow, exitHigh;
+			MultiplyIntervals(enterPlane - maxOrigin[axis], enterPlane - minOrigin[axis],
+							  minInverseDirection[axis], maxInverseDirection[axis], enterLow, enterHigh);
+			MultiplyIntervals(exitPlane - maxOrigin[axis], exitPlane - minOrigin[axis],
+							  minInverseDirection[axis], maxInverseDirection[axis], exitLow, exitHigh);
+
+			tEnter = Maxf(tEnter, enterLow);
+			tExit = Minf(tExit, exitHigh);
+		}
+
+		return tEnter <= tExit;
+	}
+
+	int size = 0;
+	Ray rays[MAX_SIZE];
+	Vec3 inverseDirections[MAX_SIZE];
+
+	Vec3 minOrigin;
+	Vec3 maxOrigin;
+	Vec3 minInverseDirection;
+	Vec3 maxInverseDirection;
+	bool hasCommonSigns = false;
+
+private:
+	static inline void MultiplyIntervals(float a0, float a1, float b0, float b1, float& low, float& high)
+	{
+		float p0 = a0 * b0;
+		float p1 = a0 * b1;
+		float p2 = a1 * b0;
+		float p3 = a1 * b1;
+		low = Minf(Minf(p0, p1), Minf(p2, p3));
+		high = Maxf(Maxf(p0, p1), Maxf(p2, p3));
+	}
+};
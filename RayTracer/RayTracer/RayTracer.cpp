@@ -1,32 +1,12 @@
 #include "pch.h"
 #include "RayTracer.h"
+#include <chrono>
 #include <memory>
 
-const int DEFAULT_MAX_DEPTH = 32;
-const int DEFAULT_SAMPLE_COUNT = 10;
-const int DEFAULT_SAME_SAMPLE_LIMIT = 12;
-
-int sampleCount = DEFAULT_SAMPLE_COUNT;
-int maxDepth = DEFAULT_MAX_DEPTH;
-
-int main(int argc, char* argv[])
-{
-	if (argc > 1)
-	{
-		sampleCount = std::stoi(argv[1]);
-	}
-
-	if (argc > 2)
-	{
-		maxDepth = std::stoi(argv[2]);
-	}
-
-	std::cout << "Taking " << sampleCount << " samples per pixel; max depth: " << maxDepth << std::endl;
-
-	Stopwatch s("Main", true);
-	OutputFile imageFile("test.ppm");
-	PrintSimpleWorldTestTo(320, 200, imageFile.GetStream());
-}
+RenderSettings settings;
+ProgressiveSettings progressive;
+SceneParameters sceneParameters;
+DistributedSettings distributed;
 
 float Lerpf(float a, float b, float normalizedValue)
 {
@@ -54,18 +34,16 @@ void PrintSimpleBackgroundTestTo(int width, int height, std::ostream& stream)
 
 void AddIndices(Mesh* mesh, int a, int b, int c)
 {
-	mesh->indices.push_back(a);
-	mesh->indices.push_back(b);
-	mesh->indices.push_back(c);
+	mesh->AddTriangle(a, b, c);
 }
 
 void CreateI(MeshStorage* storage)
 {
 	auto mesh = storage->Create("I");
-	mesh->vertices.push_back(Vec3(0.0f, 0.0f, 0.5f));					// 0
-	mesh->vertices.push_back(Vec3(0.0f, 1.6f, 0.0f));	// 1
-	mesh->vertices.push_back(Vec3(0.2f, 1.6f, 0.0f));	// 2
-	mesh->vertices.push_back(Vec3(0.2f, 0.0f, 0.5f));	// 3
+	mesh->AddVertex(Vec3(0.0f, 0.0f, 0.5f));					// 0
+	mesh->AddVertex(Vec3(0.0f, 1.6f, 0.0f));	// 1
+	mesh->AddVertex(Vec3(0.2f, 1.6f, 0.0f));	// 2
+	mesh->AddVertex(Vec3(0.2f, 0.0f, 0.5f));	// 3
 
 	AddIndices(mesh, 0, 1, 2);
 	AddIndices(mesh, 0, 2, 3);
@@ -74,18 +52,18 @@ void CreateI(MeshStorage* storage)
 void CreateX(MeshStorage* storage)
 {
 	auto mesh = storage->Create("X");
-	mesh->vertices.push_back(Vec3(0.0f, 0.0f, 0.5f));	// 0
-	mesh->vertices.push_back(Vec3(0.4f, 0.8f, 0.25f));	// 1
-	mesh->vertices.push_back(Vec3(0.5f, 0.7f, 0.3f));	// 2	
-	mesh->vertices.push_back(Vec3(0.1f, 0.0f, 0.5f));	// 3
-	mesh->vertices.push_back(Vec3(0.0f, 1.6f, 0.0f));	// 4
-	mesh->vertices.push_back(Vec3(0.1f, 1.6f, 0.0f));	// 5
-	mesh->vertices.push_back(Vec3(0.5f, 0.9f, 0.2f));	// 6
-	mesh->vertices.push_back(Vec3(0.9f, 1.6f, 0.0f));	// 7
-	mesh->vertices.push_back(Vec3(1.0f, 1.6f, 0.0f));	// 8
-	mesh->vertices.push_back(Vec3(0.6f, 0.8f, 0.25f));	// 9
-	mesh->vertices.push_back(Vec3(1.0f, 0.0f, 0.5f));	// 10
-	mesh->vertices.push_back(Vec3(0.9f, 0.0f, 0.5f));	// 11
+	mesh->AddVertex(Vec3(0.0f, 0.0f, 0.5f));	// 0
+	mesh->AddVertex(Vec3(0.4f, 0.8f, 0.25f));	// 1
+	mesh->AddVertex(Vec3(0.5f, 0.7f, 0.3f));	// 2	
+	mesh->AddVertex(Vec3(0.1f, 0.0f, 0.5f));	// 3
+	mesh->AddVertex(Vec3(0.0f, 1.6f, 0.0f));	// 4
+	mesh->AddVertex(Vec3(0.1f, 1.6f, 0.0f));	// 5
+	mesh->AddVertex(Vec3(0.5f, 0.9f, 0.2f));	// 6
+	mesh->AddVertex(Vec3(0.9f, 1.6f, 0.0f));	// 7
+	mesh->AddVertex(Vec3(1.0f, 1.6f, 0.0f));	// 8
+	mesh->AddVertex(Vec3(0.6f, 0.8f, 0.25f));	// 9
+	mesh->AddVertex(Vec3(1.0f, 0.0f, 0.5f));	// 10
+	mesh->AddVertex(Vec3(0.9f, 0.0f, 0.5f));	// 11
 
 	AddIndices(mesh, 0, 1, 2);	
 	AddIndices(mesh, 0, 2, 3);	// left leg
@@ -123,160 +101,178 @@ std::unique_ptr<HitableList> MakeWorld(MaterialStorage* matStorage, MeshStorage*
 	worldPtr->AddMesh(meshStorage->Get("I"), matStorage->Get("mirror"), Vec3(0.4f, 0.0f, 3.0f));
 	worldPtr->AddMesh(meshStorage->Get("I"), matStorage->Get("mirror"), Vec3(0.7f, 0.0f, 3.0f));
 
+	worldPtr->BuildAccelerationStructure();
+
 	return worldPtr;
 }
 
-Camera MakeCamera(int width, int height)
+std::unique_ptr<HitableList> BuildWorld(const SceneParameters& parameters, MaterialStorage* matStorage, MeshStorage* meshStorage)
 {
-	return Camera(Vec3(), width, height, 200.0f);
+	TraceScope scope("build scene", "scene");
+	if (!parameters.isGenerated)
+	{
+		return MakeWorld(matStorage, meshStorage);
+	}
+
+	SceneStatistics statistics;
+	auto world = GenerateScene(parameters, matStorage, meshStorage, OUT &statistics);
+	std::cout << "Generated scene (seed " << parameters.seed << "): " << DescribeScene(statistics) << std::endl;
+	return world;
 }
 
-float Rand01()
+Camera MakeCamera(int width, int height)
 {
-	static std::random_device randomDevice;
-	static std::default_random_engine randEngine(randomDevice());
-	static std::uniform_real_distribution<float> randomDistribution(0.0f, 1.0f);
-
-	return randomDistribution(randEngine);
+	return Camera(Vec3(), width, height, DEFAULT_PIXELS_PER_UNIT);
 }
 
-Vec3 GetRandomUnitVector()
+bool ResumeFromCheckpoint(const std::string& path, AccumulationBuffer& accumulation, RenderSettings& settings)
 {
-	Vec3 p;
-
-	do
+	if (!accumulation.LoadCheckpoint(path))
 	{
-		p = Vec3(Rand01() * 2.0f - 1.0f,
-				 Rand01() * 2.0f - 1.0f,
-				 Rand01() * 2.0f - 1.0f);
-	} while (p.SqrMagnitude() > 1.0f);
+		return false;
+	}
 
-	return p;
+	settings.seed = accumulation.Seed();
+	return true;
 }
 
-
-Vec3 SampleRecursiveWithMaterial(const Ray& ray, HitableList* world, int depth)
+// Returns false if it had to stop before the image was done
+bool RenderDistributed(const RenderSettings& frameSettings, const Renderer& scheduler, AccumulationBuffer& accumulation,
+					   int passSampleCount, const std::function<void(const AccumulationBuffer&)>& onPassDone)
 {
-	static HitInfo hit;
-	static Vec3 missVectorVisualA{ 1.0f, 1.0f, 1.0f };
-	static Vec3 missVectorVisualB{ 0.5f, 0.7f, 1.0f };
-
-	depth += 1;
-	if (depth < maxDepth)
+	Coordinator coordinator(frameSettings, sceneParameters, distributed.workerTimeout);
+	if (!coordinator.Listen(distributed.port, distributed.remoteWorkerCount > 0))
 	{
-		if (world->Raycast(ray, OUT hit))
-		{
-			Ray scattered;
-			Vec3 attenuation;
-			if (hit.materialPtr->DoesScatter(ray, hit, attenuation, scattered))
-			{
-				return attenuation * SampleRecursiveWithMaterial(scattered, world, depth);
-			}
-			else
-			{
-				return Vec3();
-			}
-		}
+		std::cout << "Can't listen on port " << distributed.port << std::endl;
+		return false;
 	}
 
-	Vec3 unitVector = ray.Direction() / ray.Direction().Length();
-	float t = 0.5f * (unitVector.y() + 1.0f);
-	return Vec3::Lerp(missVectorVisualA, missVectorVisualB, t);
-}
+	std::cout << "Waiting for workers on port " << coordinator.Port() << std::endl;
 
-Vec3 SampleRecursive(const Ray& ray, HitableList* world, int depth = 0)
-{
-	static HitInfo hit;
-	static Vec3 missVectorVisualA{ 1.0f, 1.0f, 1.0f };
-	static Vec3 missVectorVisualB{ 0.5f, 0.7f, 1.0f };
+	int threadsPerWorker = std::max(1, frameSettings.threadCount / std::max(1, distributed.workerCount));
+	int startedCount = coordinator.StartLocalWorkers(distributed.executablePath, distributed.workerCount, threadsPerWorker);
+	int workerCount = coordinator.WaitForWorkers(startedCount + distributed.remoteWorkerCount, distributed.workerTimeout);
+	std::cout << workerCount << " workers ready" << std::endl;
 
-	depth += 1;
-	if (depth < DEFAULT_MAX_DEPTH)
-	{
-		if (world->Raycast(ray, OUT hit))
-		{
-			Vec3 target = hit.point + hit.normal + GetRandomUnitVector();
-			return SampleRecursive(Ray(hit.point, target - hit.point), world, depth) * 0.5f;
-		}
-	}
+	bool isDone = workerCount > 0 && coordinator.RenderProgressive(scheduler, accumulation, passSampleCount, onPassDone);
+	std::cout << "Workers lost: " << coordinator.LostWorkerCount() << ", tiles rendered twice: "
+			  << coordinator.DuplicateJobCount() << std::endl;
 
-	Vec3 unitVector = ray.Direction() / ray.Direction().Length();
-	float t = 0.5f * (unitVector.y() + 1.0f);
-	return Vec3::Lerp(missVectorVisualA, missVectorVisualB, t);
+	return isDone;
 }
 
-Vec3 Sample(const Ray& ray, HitableList* world)
+Framebuffer RenderSimpleWorld(int width, int height)
 {
-	static HitInfo hit;
-	static Vec3 missVectorVisualA{ 1.0f, 1.0f, 1.0f };
-	static Vec3 missVectorVisualB{ 0.5f, 0.7f, 1.0f };
+	auto materials = std::make_unique<MaterialStorage>();
+	auto meshes = std::make_unique<MeshStorage>();
 
-	if (world->Raycast(ray, OUT hit))
+	// The workers build their own
+	std::unique_ptr<HitableList> world;
+	if (!distributed.IsEnabled())
 	{
-		Vec3 normalClamped = hit.normal / 2.0f + Vec3(0.5f, 0.5f, 0.5f);
-		return Vec3(normalClamped.x(), normalClamped.y(), 1.0f - normalClamped.z());
+		world = BuildWorld(sceneParameters, materials.get(), meshes.get());
 	}
-	else
+
+	auto camera = MakeCamera(width, height);
+
+	RenderSettings frameSettings = settings;
+	frameSettings.width = width;
+	frameSettings.height = height;
+
+	// Before anything is set up from frameSettings, which may take the
+	// checkpoint's seed
+	AccumulationBuffer accumulation(frameSettings);
+
+	if (progressive.resume)
 	{
-		Vec3 unitVector = ray.Direction() / ray.Direction().Length();
-		float t = 0.5f * (unitVector.y() + 1.0f);
-		return Vec3::Lerp(missVectorVisualA, missVectorVisualB, t);
+		if (ResumeFromCheckpoint(progressive.checkpointPath, accumulation, frameSettings))
+		{
+			std::cout << "Resuming from " << progressive.checkpointPath << " after " << accumulation.TotalSamples()
+					  << " samples; seed: " << accumulation.Seed() << std::endl;
+		}
+		else
+		{
+			std::cout << "Can't resume from '" << progressive.checkpointPath << "', starting from scratch" << std::endl;
+		}
 	}
-}
 
-void PrintSimpleWorldTestTo(int width, int height, std::ostream& stream)
-{
-	stream << CreatePPMHeader(320, 200);
+	Framebuffer framebuffer(width, height);
+	Renderer renderer(world.get(), camera, frameSettings);
 
-	auto materials = std::make_unique<MaterialStorage>();
-	auto meshes = std::make_unique<MeshStorage>();
+	// Only what is rendered in this process is measured
+	CostMap costMap(width, height);
+	if (!progressive.costMapPrefix.empty())
+	{
+		renderer.SetCostMap(&costMap);
+	}
 
-	auto world = MakeWorld(materials.get(), meshes.get());
-	auto worldPtr = world.get();
-	auto camera = MakeCamera(width, height);
+	auto lastCheckpoint = std::chrono::steady_clock::now();
+	auto checkpointInterval = std::chrono::seconds(progressive.checkpointInterval);
 
-	for (int j = height - 1; j >= 0; --j)
+	auto saveCheckpoint = [&](const AccumulationBuffer& buffer)
 	{
-		for (int i = 0; i < width; ++i)
+		if (!buffer.SaveCheckpoint(progressive.checkpointPath))
 		{
-			Vec3 pixelColor;
-			Vec3 previousSampleColour;
-			int sameSampleResultCount = 1;
+			std::cout << "Failed to write checkpoint '" << progressive.checkpointPath << "'" << std::endl;
+		}
 
-			int samplesTaken;
-			bool shouldContinue = true;
+		lastCheckpoint = std::chrono::steady_clock::now();
+	};
 
-			// If we get back the same colour for "n" samples, then stop
-			// shooting and taking samples.
+	auto onPassDone = [&](const AccumulationBuffer& buffer)
+	{
+		if (!progressive.checkpointPath.empty() && std::chrono::steady_clock::now() - lastCheckpoint >= checkpointInterval)
+		{
+			saveCheckpoint(buffer);
+		}
+	};
 
-			for (samplesTaken = 0; shouldContinue && samplesTaken < sampleCount; ++samplesTaken)
+	int passSampleCount = progressive.passSampleCount > 0 ? progressive.passSampleCount : frameSettings.sampleCount;
+	if (!distributed.IsEnabled() || !RenderDistributed(frameSettings, renderer, accumulation, passSampleCount, onPassDone))
+	{
+		if (world == nullptr)
+		{
+			std::cout << "Rendering the rest of the image here" << std::endl;
+			world = BuildWorld(sceneParameters, materials.get(), meshes.get());
+			renderer = Renderer(world.get(), camera, frameSettings);
+			if (!progressive.costMapPrefix.empty())
 			{
-				float u = float(i + Rand01()) / (float)width;
-				float v = float(j + Rand01()) / (float)height;
-				auto ray = camera.GetRay(u, v);
+				renderer.SetCostMap(&costMap);
+			}
+		}
 
-				Vec3 sampledColor = SampleRecursiveWithMaterial(ray, worldPtr, 0);
+		ThreadPool pool(frameSettings.threadCount);
+		renderer.RenderProgressive(pool, accumulation, passSampleCount, onPassDone);
+	}
 
-				if (sampledColor == previousSampleColour)
-				{
-					sameSampleResultCount++;
-					if (sameSampleResultCount >= DEFAULT_SAME_SAMPLE_LIMIT)
-					{
-						shouldContinue = false;
-					}
-				}
-				else
-				{
-					previousSampleColour = sampledColor;
-					sameSampleResultCount = 1;
-				}
+	if (!progressive.checkpointPath.empty())
+	{
+		saveCheckpoint(accumulation);
+	}
 
-				pixelColor += sampledColor;
-			}
+	std::cout << "Took " << accumulation.TotalSamples() << " samples in total ("
+			  << (double)accumulation.TotalSamples() / ((double)width * height) << " per pixel)" << std::endl;
 
-			(pixelColor / (float)samplesTaken).PrintRGB(stream);
-		}
+	if (!progressive.sampleMapPath.empty())
+	{
+		Framebuffer sampleMap(width, height);
+		accumulation.ResolveSampleCounts(sampleMap, renderer.MaxSamplesPerPixel());
+		OutputFile sampleMapFile(progressive.sampleMapPath, true);
+		WriteImage(sampleMap, ImageFormat::BinaryPPM, sampleMapFile.GetStream());
+	}
+
+	if (!progressive.costMapPrefix.empty() && !costMap.WriteImages(progressive.costMapPrefix))
+	{
+		std::cout << "Failed to write the cost maps '" << progressive.costMapPrefix << "_*'" << std::endl;
 	}
+
+	accumulation.Resolve(framebuffer);
+	return framebuffer;
+}
+
+void PrintSimpleWorldTestTo(int width, int height, std::ostream& stream)
+{
+	WriteImage(RenderSimpleWorld(width, height), ImageFormat::TextPPM, stream);
 }
 
 void PrintSimpleSphereTestTo(int width, int height, std::ostream & stream)
@@ -1,5 +1,6 @@
 #pragma once
 #include <iostream>
+#include <memory>
 #include <string>
 #include <sstream>
 #include <random>
@@ -9,6 +10,57 @@
 #include "Camera.h"
 #include "Material.h"
 #include "Mesh.h"
+#include "Renderer.h"
+#include "RenderStats.h"
+#include "Trace.h"
+#include "CommandLine.h"
+#include "Distributed.h"
+#include "RenderServer.h"
+#include "ImageEncoder.h"
+#include "SceneGenerator.h"
+
+const int DEFAULT_CHECKPOINT_INTERVAL = 60;
+const float DEFAULT_PIXELS_PER_UNIT = 200.0f;		// MakeCamera()'s zoom
+
+// Progressive mode renders the image in passes of passSampleCount samples
+// per pixel, saving the accumulation buffer to checkpointPath every
+// checkpointInterval seconds (and after the last pass); with "resume" it
+// carries on from that checkpoint, if there is one. If sampleMapPath is
+// set, the number of samples each pixel got is written there as a PPM; if
+// costMapPrefix is, the cost of each pixel (see CostMap.h) is written to
+// files whose names start with it.
+struct ProgressiveSettings
+{
+	int passSampleCount = 0;
+	std::string checkpointPath;
+	int checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+	bool resume = false;
+	std::string sampleMapPath;
+	std::string costMapPrefix;
+};
+
+// Distributed mode (see Distributed.h) hands the tiles to workerCount
+// local worker processes, started from executablePath, plus
+// remoteWorkerCount workers started by hand elsewhere with
+// "RayTracer --worker host:port", which connect on "port" (0: any free
+// one; only local workers can find that). If every worker is lost, the
+// rest of the image is rendered in this process.
+struct DistributedSettings
+{
+	int workerCount = 0;
+	int remoteWorkerCount = 0;
+	int port = 0;
+	double workerTimeout = DEFAULT_WORKER_TIMEOUT;
+	std::string executablePath;
+
+	bool IsEnabled() const { return workerCount + remoteWorkerCount > 0; }
+};
+
+// Set from the command line in main() (see Main.cpp)
+extern RenderSettings settings;
+extern ProgressiveSettings progressive;
+extern SceneParameters sceneParameters;
+extern DistributedSettings distributed;
 
 std::string CreatePPMHeader(int width, int height);
 void PrintRGB(float r, float g, float b, std::ostream& stream);
@@ -17,4 +69,14 @@ void PrintSimpleBackgroundTestTo(int width, int height, std::ostream& stream);
 void PrintSimpleSphereTestTo(int width, int height, std::ostream& stream);
 void PrintSimpleTriangleTestTo(int width, int height, std::ostream& stream);
 void PrintSimpleWorldTestTo(int width, int height, std::ostream& stream);
+std::unique_ptr<HitableList> MakeWorld(MaterialStorage* matStorage, MeshStorage* meshStorage);
+// MakeWorld, or GenerateScene if the parameters ask for it
+std::unique_ptr<HitableList> BuildWorld(const SceneParameters& parameters, MaterialStorage* matStorage, MeshStorage* meshStorage);
+Camera MakeCamera(int width, int height);
+// Loads the checkpoint at "path" into "accumulation", and gives "settings"
+// the seed it was begun with, so that a Renderer (or Coordinator) set up
+// from them carries on with exactly the same samples; false if there's no
+// checkpoint that fits them (see AccumulationBuffer::LoadCheckpoint)
+bool ResumeFromCheckpoint(const std::string& path, AccumulationBuffer& accumulation, RenderSettings& settings);
+Framebuffer RenderSimpleWorld(int width, int height);
 float Lerpf(float a, float b, float normalizedValue);
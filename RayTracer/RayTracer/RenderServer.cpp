@@ -0,0 +1,795 @@
+#include "pch.h"
+#include "RenderServer.h"
+#include "RayTracer.h"
+#include "Socket.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <sstream>
+
+namespace
+{
+	const int MAX_IMAGE_SIZE = 16384;
+
+	// A client is disconnected once it has sent this much without a line
+	// break, or has this many bytes of replies waiting for it to read them
+	const size_t MAX_REQUEST_LENGTH = 64u << 10;
+	const size_t MAX_CLIENT_BACKLOG = 256u << 20;
+
+	// How long the clients get to read their last replies, after "quit"
+	const int QUIT_FLUSH_MILLISECONDS = 10000;
+
+	std::string Milliseconds(std::chrono::steady_clock::time_point start)
+	{
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		return std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+	}
+
+	// One of RunServer()'s connections. Replies wait in its queue until
+	// the connection loop can send them without blocking, so a client that
+	// stops reading holds up no one but itself.
+	class Client
+	{
+	public:
+		Socket socket;					// non-blocking
+		std::string received;			// the start of the next request
+
+		// Safe from any thread. One reply is always taken, however long (an
+		// image); past that, a client that is MAX_CLIENT_BACKLOG bytes
+		// behind is given up on.
+		void Queue(const std::string& reply)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (isClosed || isFarBehind)
+			{
+				return;
+			}
+
+			if (!outgoing.empty() && outgoingSize + reply.size() > MAX_CLIENT_BACKLOG)
+			{
+				isFarBehind = true;
+				return;
+			}
+
+			outgoing.push_back(reply);
+			outgoingSize += reply.size();
+		}
+
+		bool IsFarBehind()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return isFarBehind;
+		}
+
+		bool HasOutgoing()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return !outgoing.empty();
+		}
+
+		// Sends as much as goes out right away; false if the connection failed
+		bool Flush()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			while (!outgoing.empty())
+			{
+				const std::string& reply = outgoing.front();
+				int sentCount = socket.Send(reply.data() + sentSize, reply.size() - sentSize);
+				if (sentCount <= 0)
+				{
+					return sentCount == 0;
+				}
+
+				sentSize += sentCount;
+				outgoingSize -= sentCount;
+				if (sentSize == reply.size())
+				{
+					outgoing.pop_front();
+					sentSize = 0;
+				}
+			}
+
+			return true;
+		}
+
+		// Replies from the jobs it leaves behind are dropped from now on
+		void Close()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			isClosed = true;
+			outgoing.clear();
+			outgoingSize = 0;
+			socket.Close();
+		}
+
+	private:
+		std::mutex mutex;
+		std::deque<std::string> outgoing;
+		size_t outgoingSize = 0;		// bytes not sent yet
+		size_t sentSize = 0;			// of outgoing.front()
+		bool isFarBehind = false;
+		bool isClosed = false;
+	};
+
+	// Lets other threads wake the connection loop up from its wait: a
+	// loopback connection to itself, that the loop waits on too
+	class Waker
+	{
+	public:
+		bool Open()
+		{
+			Socket listener = Socket::Listen(0, false);
+			if (!listener.IsValid() || !(sender = Socket::Connect("127.0.0.1", listener.LocalPort())).IsValid())
+			{
+				return false;
+			}
+
+			receiver = listener.Accept();
+			return receiver.IsValid() && sender.SetNonBlocking() && receiver.SetNonBlocking();
+		}
+
+		// Safe from any thread; if the byte doesn't fit, a wake-up is
+		// already pending
+		void Wake() const
+		{
+			char byte = 0;
+			sender.Send(&byte, 1);
+		}
+
+		const Socket& Receiver() const { return receiver; }
+
+		void Drain() const
+		{
+			char buffer[256];
+			while (receiver.Receive(buffer, sizeof(buffer)) > 0)
+			{
+			}
+		}
+
+	private:
+		Socket sender;
+		Socket receiver;
+	};
+}
+
+RenderServer::RenderServer(int threadCount, const RenderSettings& defaults, const SceneParameters& sceneDefaults,
+						   int sceneCacheSize) :
+	defaults{ defaults },
+	sceneDefaults{ sceneDefaults },
+	sceneCacheSize{ std::max(1, sceneCacheSize) },
+	sceneBuildCount{ 0 },
+	pool(threadCount)
+{
+	loader = std::thread(&RenderServer::LoaderLoop, this);
+}
+
+RenderServer::~RenderServer()
+{
+	Wait();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isStopping = true;
+	}
+
+	loaderCondition.notify_all();
+	loader.join();
+
+	// The tasks of cancelled tiles may still be queued; they find nothing
+	// to do, but they need the server to find that out
+	pool.Wait();
+}
+
+bool RenderServer::HandleRequest(const std::string& line, const Reply& reply)
+{
+	std::istringstream stream(line);
+	std::vector<std::string> words{ std::istream_iterator<std::string>(stream), std::istream_iterator<std::string>() };
+	if (words.empty() || words[0][0] == '#')
+	{
+		return true;
+	}
+
+	CommandLine request(words);
+	const std::string& command = words[0];
+
+	// std::stoi() and friends throw on anything that isn't a number
+	try
+	{
+		if (command == "quit")
+		{
+			return false;
+		}
+		else if (command == "render")
+		{
+			Render(request, reply);
+		}
+		else if (command == "cancel" && request.Positional().size() == 2)
+		{
+			Cancel(std::stoi(request.Positional()[1]), reply);
+		}
+		else
+		{
+			reply("error - unknown request '" + line + "'\n");
+		}
+	}
+	catch (const std::exception&)
+	{
+		reply("error - can't read '" + line + "'\n");
+	}
+
+	return true;
+}
+
+void RenderServer::Wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	jobsCondition.wait(lock, [this] { return jobs.empty(); });
+}
+
+bool RenderServer::IsQueuedBehind(const QueuedTile& a, const QueuedTile& b)
+{
+	return a.job->priority != b.job->priority ? a.job->priority < b.job->priority : a.order > b.order;
+}
+
+bool RenderServer::ParseSceneId(const std::string& id, SceneParameters& parameters, std::string& key) const
+{
+	parameters = sceneDefaults;
+
+	if (id == "demo")
+	{
+		parameters.isGenerated = false;
+		key = id;
+		return true;
+	}
+
+	const std::string generated = "generated";
+	if (id.compare(0, generated.size(), generated) != 0)
+	{
+		return false;
+	}
+
+	parameters.isGenerated = true;
+	if (id.size() > generated.size())
+	{
+		if (id[generated.size()] != ':')
+		{
+			return false;
+		}
+
+		parameters.seed = std::stoull(id.substr(generated.size() + 1), nullptr, 0);
+	}
+
+	key = generated + ":" + std::to_string(parameters.seed);
+	return true;
+}
+
+void RenderServer::Render(const CommandLine& request, const Reply& reply)
+{
+	RenderSettings jobSettings = defaults;
+	jobSettings.width = request.GetInt("width", defaults.width);
+	jobSettings.height = request.GetInt("height", defaults.height);
+	jobSettings.sampleCount = request.GetInt("samples", defaults.sampleCount);
+	jobSettings.maxDepth = request.GetInt("depth", defaults.maxDepth);
+	jobSettings.seed = request.GetUInt64("seed", defaults.seed);
+
+	Vec3 origin;
+	std::string cameraPosition = request.GetString("camera", "");
+	if (!cameraPosition.empty())
+	{
+		float x, y, z;
+		if (std::sscanf(cameraPosition.c_str(), "%f,%f,%f", &x, &y, &z) != 3)
+		{
+			reply("error - the camera is at --camera x,y,z\n");
+			return;
+		}
+
+		origin = Vec3(x, y, z);
+	}
+
+	float zoom = request.GetFloat("zoom", DEFAULT_PIXELS_PER_UNIT);
+	if (jobSettings.width < 1 || jobSettings.width > MAX_IMAGE_SIZE || jobSettings.height < 1 || jobSettings.height > MAX_IMAGE_SIZE ||
+		jobSettings.sampleCount < 1 || jobSettings.maxDepth < 1 || !(zoom > 0.0f))
+	{
+		reply("error - the size, samples, depth and zoom have to be positive\n");
+		return;
+	}
+
+	auto job = std::make_shared<Job>(Camera(origin, jobSettings.width, jobSettings.height, zoom));
+	job->settings = jobSettings;
+	job->priority = request.GetInt("priority", 0);
+	job->outputPath = request.GetString("out", "");
+	job->reply = reply;
+	job->startTime = Clock::now();
+
+	std::string sceneId = request.GetString("scene", "");
+	if (!ParseSceneId(sceneId, job->sceneParameters, job->sceneId))
+	{
+		reply("error - unknown scene '" + sceneId + "'; use demo or generated:SEED\n");
+		return;
+	}
+
+	if (job->outputPath.empty())
+	{
+		reply("error - no --out path (or - for the reply stream)\n");
+		return;
+	}
+
+	if (request.Has("format") && !ParseImageFormat(request.GetString("format", ""), job->format))
+	{
+		reply("error - unknown image format; use p3, p6 or pfm\n");
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job->id = nextJobId++;
+		jobs[job->id] = job;
+	}
+
+	// Before the loader can say anything about it
+	reply("accepted " + std::to_string(job->id) + "\n");
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		loadQueue.push_back(job);
+	}
+
+	loaderCondition.notify_one();
+}
+
+void RenderServer::Cancel(int id, const Reply& reply)
+{
+	std::shared_ptr<Job> job;
+	bool isIdle = false;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = jobs.find(id);
+		if (found != jobs.end())
+		{
+			job = found->second;
+			job->isCancelled = true;
+
+			tiles.erase(std::remove_if(tiles.begin(), tiles.end(), [&job](const QueuedTile& tile) { return tile.job == job; }),
+						tiles.end());
+			std::make_heap(tiles.begin(), tiles.end(), IsQueuedBehind);
+			job->queuedTileCount = 0;
+
+			// Otherwise whoever has it - the loader, or the thread with its
+			// last tile - finishes it
+			isIdle = job->tileCount > 0 && job->runningTileCount == 0;
+		}
+	}
+
+	if (job == nullptr)
+	{
+		reply("error " + std::to_string(id) + " no such job\n");
+	}
+	else if (isIdle)
+	{
+		FinishJob(job);
+	}
+}
+
+void RenderServer::LoaderLoop()
+{
+	Trace::SetThreadName("scene loader");
+
+	for (;;)
+	{
+		std::shared_ptr<Job> job;
+		bool isCancelled;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			loaderCondition.wait(lock, [this] { return isStopping || !loadQueue.empty(); });
+			if (loadQueue.empty())
+			{
+				return;
+			}
+
+			job = loadQueue.front();
+			loadQueue.pop_front();
+			isCancelled = job->isCancelled;
+		}
+
+		if (!isCancelled)
+		{
+			// E.g. a scene with more materials than a HitableList can hold
+			std::string description;
+			try
+			{
+				job->scene = GetScene(*job, description);
+			}
+			catch (const std::exception& exception)
+			{
+				job->reply("error " + std::to_string(job->id) + " can't build scene " + job->sceneId + ": " + exception.what() + "\n");
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					job->isFailed = true;
+				}
+
+				FinishJob(job);
+				continue;
+			}
+
+			job->reply("scene " + std::to_string(job->id) + " " + job->sceneId + " " + description + "\n");
+
+			job->renderer = std::make_unique<Renderer>(job->scene->world.get(), job->camera, job->settings);
+			job->accumulation = std::make_unique<AccumulationBuffer>(job->settings);
+		}
+
+		if (isCancelled || !QueueNextPass(job))
+		{
+			FinishJob(job);
+		}
+	}
+}
+
+std::shared_ptr<RenderServer::Scene> RenderServer::GetScene(const Job& job, std::string& description)
+{
+	auto found = scenes.find(job.sceneId);
+	if (found != scenes.end())
+	{
+		found->second->lastUsed = ++sceneUseCount;
+		description = "cached";
+		return found->second;
+	}
+
+	auto start = Clock::now();
+	auto scene = std::make_shared<Scene>();
+	{
+		TraceScope scope("build scene", "scene");
+		scene->world = job.sceneParameters.isGenerated ? GenerateScene(job.sceneParameters, &scene->materials, &scene->meshes)
+													   : MakeWorld(&scene->materials, &scene->meshes);
+	}
+
+	sceneBuildCount++;
+	description = "built " + Milliseconds(start);
+
+	// Scenes that jobs still hold on to can't be forgotten yet
+	while ((int)scenes.size() >= sceneCacheSize)
+	{
+		auto oldest = scenes.end();
+		for (auto entry = scenes.begin(); entry != scenes.end(); ++entry)
+		{
+			if (entry->second.use_count() == 1 && (oldest == scenes.end() || entry->second->lastUsed < oldest->second->lastUsed))
+			{
+				oldest = entry;
+			}
+		}
+
+		if (oldest == scenes.end())
+		{
+			break;
+		}
+
+		scenes.erase(oldest);
+	}
+
+	scene->lastUsed = ++sceneUseCount;
+	scenes[job.sceneId] = scene;
+	return scene;
+}
+
+// Returns false if there is nothing left to render, because the image is
+// done or the job was cancelled
+bool RenderServer::QueueNextPass(const std::shared_ptr<Job>& job)
+{
+	auto passes = job->renderer->SchedulePass(*job->accumulation, job->settings.sampleCount);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (passes.empty() || job->isCancelled)
+		{
+			return false;
+		}
+
+		for (const auto& pass : passes)
+		{
+			tiles.push_back(QueuedTile{ job, pass, nextTileOrder++ });
+			std::push_heap(tiles.begin(), tiles.end(), IsQueuedBehind);
+		}
+
+		job->queuedTileCount += (int)passes.size();
+		job->tileCount += (int)passes.size();
+	}
+
+	// A task per tile, which renders whichever tile is first in line by the
+	// time it runs
+	for (size_t i = 0; i < passes.size(); ++i)
+	{
+		pool.Submit([this] { RenderNextTile(); });
+	}
+
+	return true;
+}
+
+void RenderServer::RenderNextTile()
+{
+	QueuedTile next;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (tiles.empty())
+		{
+			return;		// its job was cancelled
+		}
+
+		std::pop_heap(tiles.begin(), tiles.end(), IsQueuedBehind);
+		next = std::move(tiles.back());
+		tiles.pop_back();
+
+		next.job->queuedTileCount--;
+		next.job->runningTileCount++;
+	}
+
+	Job& job = *next.job;
+	job.renderer->RenderTile(next.pass.tile, *job.accumulation, next.pass.endSample);
+
+	int doneCount;
+	int tileCount;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		doneCount = ++job.doneTileCount;
+		tileCount = job.tileCount;
+	}
+
+	// Still counted as running until it has said so, so that a cancelled
+	// job can't be reported cancelled before this
+	job.reply("progress " + std::to_string(job.id) + " " + std::to_string(doneCount) + " " + std::to_string(tileCount) + "\n");
+
+	bool isPassDone;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job.runningTileCount--;
+		isPassDone = job.queuedTileCount == 0 && job.runningTileCount == 0;
+	}
+
+	if (isPassDone && !QueueNextPass(next.job))
+	{
+		FinishJob(next.job);
+	}
+}
+
+void RenderServer::FinishJob(const std::shared_ptr<Job>& job)
+{
+	bool isCancelled;
+	bool isFailed;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (job->isFinished)
+		{
+			return;
+		}
+
+		job->isFinished = true;
+		isCancelled = job->isCancelled;
+		isFailed = job->isFailed;
+	}
+
+	std::string id = std::to_string(job->id);
+
+	// A failed job has already said why
+	if (isCancelled)
+	{
+		job->reply("cancelled " + id + "\n");
+	}
+	else if (!isFailed)
+	{
+		Framebuffer framebuffer(job->settings.width, job->settings.height);
+		job->accumulation->Resolve(framebuffer);
+		auto image = EncodeImage(framebuffer, job->format);
+
+		bool isWritten = true;
+		if (job->outputPath == "-")
+		{
+			job->reply("image " + id + " " + std::to_string(image.size()) + "\n" + std::string(image.begin(), image.end()));
+		}
+		else
+		{
+			OutputFile file(job->outputPath, true);
+			file.GetStream().write(image.data(), image.size());
+			isWritten = !file.GetStream().fail();
+		}
+
+		job->reply(isWritten ? "done " + id + " " + Milliseconds(job->startTime) + "\n"
+							 : "error " + id + " can't write '" + job->outputPath + "'\n");
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.erase(job->id);
+	}
+
+	jobsCondition.notify_all();
+}
+
+int RunServer(const RenderSettings& defaults, const SceneParameters& sceneDefaults, std::istream& input, std::ostream& output)
+{
+	std::mutex outputMutex;
+	auto reply = [&](const std::string& message)
+	{
+		std::lock_guard<std::mutex> lock(outputMutex);
+		output.write(message.data(), message.size());
+		output.flush();
+	};
+
+	RenderServer server(defaults.threadCount, defaults, sceneDefaults);
+
+	std::string line;
+	while (std::getline(input, line) && server.HandleRequest(line, reply))
+	{
+	}
+
+	server.Wait();
+	return 0;
+}
+
+int RunServer(const RenderSettings& defaults, const SceneParameters& sceneDefaults, int port)
+{
+	Socket listener = Socket::Listen(port, false);
+	if (!listener.IsValid())
+	{
+		std::cout << "Can't listen on port " << port << std::endl;
+		return 1;
+	}
+
+	Waker waker;
+	if (!waker.Open())
+	{
+		std::cout << "Can't connect the server to itself" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Listening on port " << listener.LocalPort() << std::endl;
+
+	// Jobs hold on to their client, to reply to, even after it has gone;
+	// they still run to the end, and write their files
+	std::vector<std::shared_ptr<Client>> clients;
+	RenderServer server(defaults.threadCount, defaults, sceneDefaults);
+
+	auto drop = [&clients](size_t index, const char* reason)
+	{
+		if (reason != nullptr)
+		{
+			std::cout << "Dropped a client that " << reason << std::endl;
+		}
+
+		clients[index]->Close();
+		clients.erase(clients.begin() + index);
+	};
+
+	// After "quit", replies still go out until the jobs have finished and
+	// their last replies have been sent, or for QUIT_FLUSH_MILLISECONDS
+	bool isQuitting = false;
+	std::atomic<bool> isFinished(false);
+	std::thread finisher;
+	std::chrono::steady_clock::time_point flushDeadline;
+
+	std::vector<const Socket*> sockets;
+	std::vector<bool> wantsToWrite;
+	std::vector<bool> isReadable;
+	std::vector<bool> isWritable;
+
+	for (;;)
+	{
+		bool hasFinished = isFinished.load();
+		bool hasOutgoing = false;
+		int timeout = -1;
+
+		if (hasFinished)
+		{
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(flushDeadline - std::chrono::steady_clock::now());
+			timeout = std::max(0, (int)remaining.count());
+		}
+
+		for (size_t i = clients.size(); i-- > 0;)
+		{
+			if (clients[i]->IsFarBehind())
+			{
+				drop(i, "fell too far behind on its replies");
+			}
+		}
+
+		// The waker and the listener go last, so that the clients' indices
+		// match
+		sockets.clear();
+		wantsToWrite.clear();
+		for (const auto& client : clients)
+		{
+			sockets.push_back(&client->socket);
+			wantsToWrite.push_back(client->HasOutgoing());
+			hasOutgoing = hasOutgoing || wantsToWrite.back();
+		}
+
+		if (hasFinished && (!hasOutgoing || timeout == 0))
+		{
+			break;
+		}
+
+		sockets.push_back(&waker.Receiver());
+		sockets.push_back(&listener);
+		wantsToWrite.resize(sockets.size(), false);
+		Socket::WaitReady(sockets, wantsToWrite, timeout, isReadable, isWritable);
+
+		if (isReadable[clients.size()])
+		{
+			waker.Drain();
+		}
+
+		for (size_t i = clients.size(); i-- > 0;)
+		{
+			auto client = clients[i];
+			if (isWritable[i] && !client->Flush())
+			{
+				drop(i, nullptr);
+				continue;
+			}
+
+			if (!isReadable[i])
+			{
+				continue;
+			}
+
+			char buffer[4096];
+			int receivedCount = client->socket.Receive(buffer, sizeof(buffer));
+			if (receivedCount <= 0)
+			{
+				drop(i, nullptr);
+				continue;
+			}
+
+			if (isQuitting)
+			{
+				continue;
+			}
+
+			client->received.append(buffer, receivedCount);
+			auto reply = [client, &waker](const std::string& message)
+			{
+				client->Queue(message);
+				waker.Wake();
+			};
+
+			size_t end;
+			while (!isQuitting && (end = client->received.find('\n')) != std::string::npos)
+			{
+				std::string line = client->received.substr(0, end);
+				client->received.erase(0, end + 1);
+				isQuitting = !server.HandleRequest(line, reply);
+			}
+
+			if (client->received.size() > MAX_REQUEST_LENGTH)
+			{
+				drop(i, "sent too long a request");
+			}
+		}
+
+		if (isQuitting && !finisher.joinable())
+		{
+			finisher = std::thread([&]
+			{
+				server.Wait();
+				flushDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(QUIT_FLUSH_MILLISECONDS);
+				isFinished = true;
+				waker.Wake();
+			});
+		}
+
+		if (!isQuitting && isReadable.back())
+		{
+			auto client = std::make_shared<Client>();
+			client->socket = listener.Accept();
+			if (client->socket.IsValid() && client->socket.SetNonBlocking())
+			{
+				clients.push_back(client);
+			}
+		}
+	}
+
+	finisher.join();
+	return 0;
+}
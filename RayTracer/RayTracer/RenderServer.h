@@ -0,0 +1,176 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Accumulation.h"
+#include "Camera.h"
+#include "CommandLine.h"
+#include "ImageEncoder.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "Renderer.h"
+#include "SceneGenerator.h"
+#include "ThreadPool.h"
+
+// A long-lived render process, for many small renders (thumbnails,
+// turntables) that would otherwise spend most of their time starting up.
+// Built scenes - materials, meshes, acceleration structures - are kept
+// between jobs, by scene id; jobs run side by side on one thread pool.
+//
+// Requests, one per line, in the command line's syntax:
+//   render --scene ID --out PATH [--width W] [--height H] [--samples N]
+//          [--depth N] [--camera X,Y,Z] [--zoom PIXELS_PER_UNIT]
+//          [--seed N] [--priority N] [--format p3|p6|pfm]
+//   cancel JOB
+//   quit
+// A scene id is "demo" (MakeWorld) or "generated:SEED" (GenerateScene,
+// with the server's own scene parameters otherwise). The server's render
+// settings are the defaults for everything a request leaves out. With
+// "--out -" the image comes back in the reply stream instead of going to
+// a file. "quit" finishes the jobs already accepted first.
+//
+// Replies, one per line (JOB is the id "accepted" gave):
+//   accepted JOB
+//   scene JOB ID cached | built MILLISECONDS
+//   progress JOB TILES_DONE TILES_QUEUED_SO_FAR
+//   image JOB BYTES        followed by the image file's BYTES bytes
+//   done JOB MILLISECONDS
+//   cancelled JOB
+//   error JOB|- MESSAGE
+//
+// The tiles of all the jobs wait in one queue, highest priority first
+// (first come, first served between equals), and each thread of the pool
+// takes the next tile from it whenever it is free; so a higher priority
+// job overtakes the others from the next tile on. Cancelling a job drops
+// its queued tiles; the ones already running are finished, then it is
+// reported cancelled.
+
+const int DEFAULT_SCENE_CACHE_SIZE = 8;
+
+class RenderServer
+{
+public:
+	// Gets a whole reply - one line, or the "image" line with its bytes -
+	// at a time; has to be safe to call from any thread
+	typedef std::function<void(const std::string& reply)> Reply;
+
+	// Scenes that aren't used by any job are forgotten, least recently used
+	// first, once there are more than sceneCacheSize of them.
+	RenderServer(int threadCount, const RenderSettings& defaults, const SceneParameters& sceneDefaults,
+				 int sceneCacheSize = DEFAULT_SCENE_CACHE_SIZE);
+
+	// Waits for the jobs that are still running
+	~RenderServer();
+
+	RenderServer(const RenderServer&) = delete;
+	RenderServer& operator=(const RenderServer&) = delete;
+
+	// Handles one request; returns false for "quit". What it says about a
+	// job later on goes to the same reply function, from the pool's threads.
+	bool HandleRequest(const std::string& line, const Reply& reply);
+
+	// Blocks until every job accepted so far has finished or been cancelled
+	void Wait();
+
+	// How many scenes had to be built, rather than found in the cache
+	int SceneBuildCount() const { return sceneBuildCount; }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Scene
+	{
+		MaterialStorage materials;
+		MeshStorage meshes;
+		std::unique_ptr<HitableList> world;
+		uint64_t lastUsed = 0;
+	};
+
+	// Everything but the counts and flags is set before the job is shared
+	// with the pool; those are guarded by the server's mutex
+	struct Job
+	{
+		Job(const Camera& camera) : camera{ camera } {}
+
+		int id = 0;
+		int priority = 0;
+		std::string sceneId;
+		SceneParameters sceneParameters;
+		RenderSettings settings;
+		Camera camera;
+		std::string outputPath;
+		ImageFormat format = ImageFormat::BinaryPPM;
+		Reply reply;
+		Clock::time_point startTime;
+
+		std::shared_ptr<Scene> scene;
+		std::unique_ptr<Renderer> renderer;
+		std::unique_ptr<AccumulationBuffer> accumulation;
+
+		int queuedTileCount = 0;
+		int runningTileCount = 0;
+		int doneTileCount = 0;
+		int tileCount = 0;
+		bool isCancelled = false;
+		bool isFailed = false;			// already reported as an error
+		bool isFinished = false;
+	};
+
+	struct QueuedTile
+	{
+		std::shared_ptr<Job> job;
+		Renderer::TilePass pass;
+		uint64_t order;
+	};
+
+	static bool IsQueuedBehind(const QueuedTile& a, const QueuedTile& b);
+
+	bool ParseSceneId(const std::string& id, SceneParameters& parameters, std::string& key) const;
+	void Render(const CommandLine& request, const Reply& reply);
+	void Cancel(int id, const Reply& reply);
+
+	void LoaderLoop();
+	std::shared_ptr<Scene> GetScene(const Job& job, std::string& description);
+	bool QueueNextPass(const std::shared_ptr<Job>& job);
+	void RenderNextTile();
+	void FinishJob(const std::shared_ptr<Job>& job);
+
+	RenderSettings defaults;
+	SceneParameters sceneDefaults;
+	int sceneCacheSize;
+
+	// Only the loader thread, which builds the scenes, uses the cache
+	std::map<std::string, std::shared_ptr<Scene>> scenes;
+	uint64_t sceneUseCount = 0;
+	std::atomic<int> sceneBuildCount;
+
+	std::mutex mutex;
+	std::condition_variable loaderCondition;
+	std::condition_variable jobsCondition;
+	std::deque<std::shared_ptr<Job>> loadQueue;		// waiting for their scenes
+	std::map<int, std::shared_ptr<Job>> jobs;		// not finished yet
+	std::vector<QueuedTile> tiles;					// a heap; see IsQueuedBehind
+	uint64_t nextTileOrder = 0;
+	int nextJobId = 1;
+	bool isStopping = false;
+
+	std::thread loader;
+	ThreadPool pool;		// last, so that it is gone before the rest
+};
+
+// Serves requests from "input" until "quit" or its end, replying on
+// "output"; or, given a port, any number of clients connecting to it on
+// the loopback interface, until one of them says "quit". A client that
+// sends a request of over 64 KB, or lets 256 MB of replies pile up
+// unread, is disconnected. Returns main()'s exit code.
+int RunServer(const RenderSettings& defaults, const SceneParameters& sceneDefaults, std::istream& input, std::ostream& output);
+int RunServer(const RenderSettings& defaults, const SceneParameters& sceneDefaults, int port);
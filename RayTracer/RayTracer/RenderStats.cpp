@@ -0,0 +1,282 @@
+#include "pch.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include "Material.h"
+
+namespace
+{
+	// Every thread's counters are registered here while the thread is
+	// alive, and added to "retired" when it exits
+	struct ThreadStats;
+
+	std::mutex registryMutex;
+	std::vector<ThreadStats*> liveThreads;
+	RenderStats retired;
+
+	struct ThreadStats
+	{
+		ThreadStats()
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			liveThreads.push_back(this);
+		}
+
+		~ThreadStats()
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			retired.Add(stats);
+			liveThreads.erase(std::find(liveThreads.begin(), liveThreads.end(), this));
+		}
+
+		RenderStats stats;
+		std::vector<const AMaterial*> materialKeys;		// parallel to stats.materials
+		int lastMaterial = -1;
+	};
+
+	thread_local ThreadStats threadStats;
+
+	double Percent(int64_t part, int64_t whole)
+	{
+		return whole > 0 ? 100.0 * part / whole : 0.0;
+	}
+
+	void PrintTests(std::ostream& stream, const char* name, int64_t tests, int64_t hits)
+	{
+		stream << "  " << name << ": " << tests << " tests, " << hits << " hits (" << Percent(hits, tests) << "%)" << std::endl;
+	}
+
+	std::string EscapeJson(const std::string& text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				escaped += '\\';
+			}
+
+			escaped += c;
+		}
+
+		return escaped;
+	}
+}
+
+void RenderStats::Add(const RenderStats& other)
+{
+	primaryRays += other.primaryRays;
+	secondaryRays += other.secondaryRays;
+	sphereTests += other.sphereTests;
+	sphereHits += other.sphereHits;
+	triangleTests += other.triangleTests;
+	triangleHits += other.triangleHits;
+	instanceTests += other.instanceTests;
+	instanceHits += other.instanceHits;
+	pathsEscaped += other.pathsEscaped;
+	pathsAbsorbed += other.pathsAbsorbed;
+	pathsTruncated += other.pathsTruncated;
+	pathsRouletted += other.pathsRouletted;
+	samplesTaken += other.samplesTaken;
+	samplesSavedByConvergence += other.samplesSavedByConvergence;
+	maxDepth = std::max(maxDepth, other.maxDepth);
+
+	for (int depth = 0; depth <= STATS_MAX_DEPTH; ++depth)
+	{
+		pathDepths[depth] += other.pathDepths[depth];
+	}
+
+	for (const auto& material : other.materials)
+	{
+		auto match = std::find_if(materials.begin(), materials.end(),
+								  [&](const MaterialStats& m) { return m.name == material.name; });
+		if (match == materials.end())
+		{
+			materials.push_back(material);
+		}
+		else
+		{
+			match->scatterCount += material.scatterCount;
+			match->absorbCount += material.absorbCount;
+		}
+	}
+}
+
+int64_t RenderStats::DepthSum() const
+{
+	int64_t sum = 0;
+	for (int depth = 0; depth <= STATS_MAX_DEPTH; ++depth)
+	{
+		sum += depth * pathDepths[depth];
+	}
+
+	return sum;
+}
+
+void RenderStats::PrintSummary(std::ostream& stream) const
+{
+	int64_t pathCount = PathCount();
+	std::ios::fmtflags flags = stream.flags();
+	std::streamsize precision = stream.precision();
+	stream << std::fixed << std::setprecision(2);
+
+	stream << "Rays: " << RayCount() << " (" << primaryRays << " primary, "
+		   << secondaryRays << " secondary)" << std::endl;
+
+	stream << "Intersections:" << std::endl;
+	PrintTests(stream, "spheres", sphereTests, sphereHits);
+	PrintTests(stream, "triangles", triangleTests, triangleHits);
+	PrintTests(stream, "instances", instanceTests, instanceHits);
+
+	stream << "Paths: " << pathCount << "; escaped " << Percent(pathsEscaped, pathCount) << "%, absorbed "
+		   << Percent(pathsAbsorbed, pathCount) << "%, truncated at max depth " << maxDepth << " "
+		   << Percent(pathsTruncated, pathCount) << "%, stopped by roulette " << Percent(pathsRouletted, pathCount)
+		   << "%; " << AveragePathLength() << " rays long on average" << std::endl;
+
+	stream << "Path depths:";
+	for (int depth = 0; depth <= STATS_MAX_DEPTH; ++depth)
+	{
+		if (pathDepths[depth] > 0)
+		{
+			stream << " " << depth << (depth == STATS_MAX_DEPTH ? "+" : "") << ": " << Percent(pathDepths[depth], pathCount) << "%";
+		}
+	}
+
+	stream << std::endl;
+
+	stream << "Materials (scattered / absorbed):" << std::endl;
+	for (const auto& material : materials)
+	{
+		stream << "  " << material.name << ": " << material.scatterCount << " / " << material.absorbCount << std::endl;
+	}
+
+	stream << "Samples: " << samplesTaken << " taken, " << samplesSavedByConvergence << " saved by convergence" << std::endl;
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
+
+void RenderStats::WriteJson(std::ostream& stream) const
+{
+	stream << "{\n  \"rays\": {\"primary\": " << primaryRays << ", \"secondary\": " << secondaryRays << "},\n";
+	stream << "  \"intersections\": {\n"
+		   << "    \"sphere\": {\"tests\": " << sphereTests << ", \"hits\": " << sphereHits << "},\n"
+		   << "    \"triangle\": {\"tests\": " << triangleTests << ", \"hits\": " << triangleHits << "},\n"
+		   << "    \"instance\": {\"tests\": " << instanceTests << ", \"hits\": " << instanceHits << "}\n  },\n";
+	stream << "  \"paths\": {\"escaped\": " << pathsEscaped << ", \"absorbed\": " << pathsAbsorbed
+		   << ", \"truncated\": " << pathsTruncated << ", \"roulette\": " << pathsRouletted << ", \"maxDepth\": " << maxDepth << ",\n    \"depths\": [";
+
+	// Up to the deepest bin in use
+	int lastDepth = STATS_MAX_DEPTH;
+	while (lastDepth > 0 && pathDepths[lastDepth] == 0)
+	{
+		lastDepth--;
+	}
+
+	for (int depth = 0; depth <= lastDepth; ++depth)
+	{
+		stream << (depth > 0 ? ", " : "") << pathDepths[depth];
+	}
+
+	stream << "]},\n  \"materials\": [";
+	for (size_t i = 0; i < materials.size(); ++i)
+	{
+		stream << (i > 0 ? "," : "") << "\n    {\"name\": \"" << EscapeJson(materials[i].name) << "\", \"scattered\": "
+			   << materials[i].scatterCount << ", \"absorbed\": " << materials[i].absorbCount << "}";
+	}
+
+	stream << "\n  ],\n  \"samples\": {\"taken\": " << samplesTaken << ", \"savedByConvergence\": "
+		   << samplesSavedByConvergence << "}\n}\n";
+}
+
+namespace Stats
+{
+	RenderStats& Local()
+	{
+		return threadStats.stats;
+	}
+
+	RenderStats Collect()
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+
+		RenderStats total = retired;
+		for (auto thread : liveThreads)
+		{
+			total.Add(thread->stats);
+		}
+
+		return total;
+	}
+
+	void Reset()
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+
+		retired = RenderStats();
+		for (auto thread : liveThreads)
+		{
+			thread->stats = RenderStats();
+			thread->materialKeys.clear();
+			thread->lastMaterial = -1;
+		}
+	}
+
+	void CountRays(int depth, int64_t count)
+	{
+		if (depth <= 1)
+		{
+			threadStats.stats.primaryRays += count;
+		}
+		else
+		{
+			threadStats.stats.secondaryRays += count;
+		}
+	}
+
+	void CountPathEnd(int depth, PathEnd reason)
+	{
+		RenderStats& stats = threadStats.stats;
+		stats.pathDepths[std::min(std::max(depth, 0), STATS_MAX_DEPTH)]++;
+
+		switch (reason)
+		{
+		case PathEnd::Escaped: stats.pathsEscaped++; break;
+		case PathEnd::Absorbed: stats.pathsAbsorbed++; break;
+		case PathEnd::Truncated: stats.pathsTruncated++; break;
+		case PathEnd::Roulette: stats.pathsRouletted++; break;
+		}
+	}
+
+	// Consecutive scatters tend to be off the same material, so the last
+	// one is checked before searching
+	void CountScatter(const AMaterial* material, bool isScattered)
+	{
+		ThreadStats& local = threadStats;
+		int index = local.lastMaterial;
+
+		if (index < 0 || local.materialKeys[index] != material)
+		{
+			auto match = std::find(local.materialKeys.begin(), local.materialKeys.end(), material);
+			index = (int)(match - local.materialKeys.begin());
+
+			if (match == local.materialKeys.end())
+			{
+				local.materialKeys.push_back(material);
+				local.stats.materials.push_back(MaterialStats{ material->name });
+			}
+
+			local.lastMaterial = index;
+		}
+
+		if (isScattered)
+		{
+			local.stats.materials[index].scatterCount++;
+		}
+		else
+		{
+			local.stats.materials[index].absorbCount++;
+		}
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Counters for what a render actually did: rays by kind, intersection
+// tests and hits by primitive type, how paths ended and at what depth, and
+// what each material did with the rays that reached it.
+//
+// They are only built in when RT_STATS is defined (RAYTRACER_STATS in
+// CMake). Otherwise the RT_STAT_* macros below expand to nothing, and the
+// hot paths are exactly what they would be without them. Each thread
+// counts into its own RenderStats, so there is no sharing while rendering;
+// Stats::Collect() adds them all up afterwards.
+
+struct AMaterial;
+
+const int STATS_MAX_DEPTH = 64;		// deeper paths go in the last histogram bin
+
+enum class PathEnd
+{
+	Escaped,		// missed everything; picks up the sky
+	Absorbed,		// the material didn't scatter
+	Truncated,		// reached maxDepth
+	Roulette		// stopped by Russian roulette
+};
+
+struct MaterialStats
+{
+	std::string name;
+	int64_t scatterCount = 0;
+	int64_t absorbCount = 0;
+};
+
+struct RenderStats
+{
+	int64_t primaryRays = 0;
+	int64_t secondaryRays = 0;
+
+	// A "hit" is a test that found something closer than everything before
+	// it, so hits / tests is the fraction of tests that changed the answer.
+	// Instance tests are rays taken into a mesh's space; the triangles they
+	// test there count as triangle tests.
+	int64_t sphereTests = 0;
+	int64_t sphereHits = 0;
+	int64_t triangleTests = 0;
+	int64_t triangleHits = 0;
+	int64_t instanceTests = 0;
+	int64_t instanceHits = 0;
+
+	// pathDepths[d]: paths that ended at depth d, i.e. on their d-th ray
+	// (1 is the camera ray); truncated paths end at maxDepth
+	int64_t pathsEscaped = 0;
+	int64_t pathsAbsorbed = 0;
+	int64_t pathsTruncated = 0;
+	int64_t pathsRouletted = 0;
+	int64_t pathDepths[STATS_MAX_DEPTH + 1] = {};
+	int maxDepth = 0;
+
+	// Adaptive sampling: the samples pixels in tiles that had converged
+	// didn't take, out of the most they were allowed
+	int64_t samplesTaken = 0;
+	int64_t samplesSavedByConvergence = 0;
+
+	std::vector<MaterialStats> materials;
+
+	// Materials are matched by name
+	void Add(const RenderStats& other);
+	int64_t RayCount() const { return primaryRays + secondaryRays; }
+	int64_t TestCount() const { return sphereTests + triangleTests + instanceTests; }
+	int64_t PathCount() const { return pathsEscaped + pathsAbsorbed + pathsTruncated + pathsRouletted; }
+	int64_t DepthSum() const;
+	// Rays per path
+	double AveragePathLength() const { return PathCount() > 0 ? (double)DepthSum() / PathCount() : 0.0; }
+
+	void PrintSummary(std::ostream& stream) const;
+	void WriteJson(std::ostream& stream) const;
+};
+
+namespace Stats
+{
+	// The calling thread's counters
+	RenderStats& Local();
+
+	// The sum over all threads, including ones that have exited. Neither of
+	// these synchronizes with threads that are still counting, so call them
+	// between renders (ThreadPool::Wait() is enough).
+	RenderStats Collect();
+	void Reset();
+
+	void CountRays(int depth, int64_t count);
+	void CountPathEnd(int depth, PathEnd reason);
+	void CountScatter(const AMaterial* material, bool isScattered);
+}
+
+#ifdef RT_STATS
+#define RT_STAT_ADD(counter, n) (Stats::Local().counter += (n))
+#define RT_STAT_RAYS(depth, count) Stats::CountRays(depth, count)
+#define RT_STAT_PATH_END(depth, reason) Stats::CountPathEnd(depth, reason)
+#define RT_STAT_SCATTER(material, isScattered) Stats::CountScatter(material, isScattered)
+#else
+#define RT_STAT_ADD(counter, n) ((void)0)
+#define RT_STAT_RAYS(depth, count) ((void)0)
+#define RT_STAT_PATH_END(depth, reason) ((void)0)
+#define RT_STAT_SCATTER(material, isScattered) ((void)0)
+#endif
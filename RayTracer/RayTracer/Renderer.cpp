@@ -0,0 +1,365 @@
+#include "pch.h"
+#include "Renderer.h"
+#include "Integrator.h"
+#include "RenderStats.h"
+#include "Trace.h"
+#include "Wavefront.h"
+#include <algorithm>
+
+const int PACKET_BLOCK_SIZE = 8;
+
+Renderer::Renderer(const HitableList* world, const Camera& camera, const RenderSettings& settings) :
+	world{ world }, camera{ camera }, settings{ settings },
+	sequence{ MakeSampleSequence(settings.samplerType, settings.seed, settings.width, settings.sampleCount) }
+{
+}
+
+void Renderer::Render(ThreadPool& pool, Framebuffer& framebuffer) const
+{
+	AccumulationBuffer accumulation(settings);
+	RenderProgressive(pool, accumulation, settings.sampleCount, nullptr);
+	accumulation.Resolve(framebuffer);
+}
+
+void Renderer::RenderProgressive(ThreadPool& pool, AccumulationBuffer& accumulation, int passSampleCount,
+								 const std::function<void(const AccumulationBuffer&)>& onPassDone) const
+{
+#ifdef RT_STATS
+	uint64_t startSamples = accumulation.TotalSamples();
+#endif
+
+	for (auto passes = SchedulePass(accumulation, passSampleCount); !passes.empty();
+		 passes = SchedulePass(accumulation, passSampleCount))
+	{
+		TraceScope scope("pass", "render");
+		scope.AddArg("tiles", (int64_t)passes.size());
+
+		for (const auto& pass : passes)
+		{
+			pool.Submit([this, pass, &accumulation] { RenderTile(pass.tile, accumulation, pass.endSample); });
+		}
+
+		pool.Wait();
+
+		if (onPassDone)
+		{
+			onPassDone(accumulation);
+		}
+	}
+
+#ifdef RT_STATS
+	CountSamples(accumulation, startSamples);
+#endif
+}
+
+#ifdef RT_STATS
+void Renderer::CountSamples(const AccumulationBuffer& accumulation, uint64_t startSamples) const
+{
+	RenderStats& stats = Stats::Local();
+	stats.maxDepth = std::max(stats.maxDepth, settings.maxDepth);
+	stats.samplesTaken += (int64_t)(accumulation.TotalSamples() - startSamples);
+
+	if (!IsAdaptive())
+	{
+		return;
+	}
+
+	for (const auto& tile : MakeTiles())
+	{
+		int level = accumulation.At(tile.x, tile.y).samplesTaken;
+		if (level < MaxSamplesPerPixel() && TileError(tile, accumulation) <= settings.adaptiveThreshold)
+		{
+			stats.samplesSavedByConvergence += (int64_t)tile.width * tile.height * (MaxSamplesPerPixel() - level);
+		}
+	}
+}
+#endif
+
+int Renderer::MinSamplesPerPixel() const
+{
+	return IsAdaptive() ? std::min(ADAPTIVE_MIN_SAMPLES, settings.sampleCount) : settings.sampleCount;
+}
+
+int Renderer::MaxSamplesPerPixel() const
+{
+	return IsAdaptive() ? settings.sampleCount * ADAPTIVE_MAX_SAMPLE_FACTOR : settings.sampleCount;
+}
+
+float Renderer::TileError(const Tile& tile, const AccumulationBuffer& accumulation) const
+{
+	float sumOfSquares = 0.0f;
+
+	for (int y = tile.y; y < tile.y + tile.height; ++y)
+	{
+		for (int x = tile.x; x < tile.x + tile.width; ++x)
+		{
+			float error = Minf(accumulation.At(x, y).RelativeError(), 1.0e6f);
+			sumOfSquares += error * error;
+		}
+	}
+
+	return sqrtf(sumOfSquares / (float)(tile.width * tile.height));
+}
+
+// Decides which tiles get more samples next, and how many. Until every
+// pixel has had its minimum number of samples, that's all that happens;
+// then the remaining budget goes to the tiles with the largest error.
+//
+// The error is pooled over the whole tile: with a handful of samples a
+// single pixel's variance is often badly underestimated (the rare dark or
+// bright path just hasn't turned up yet), which would stop it far too
+// early. The decision only depends on the accumulation buffer, so a
+// resumed render continues exactly as the original one would have.
+
+std::vector<Renderer::TilePass> Renderer::SchedulePass(const AccumulationBuffer& accumulation, int passSampleCount) const
+{
+	struct Candidate
+	{
+		TilePass pass;
+		int64_t cost;
+		float error;
+	};
+
+	int step = std::max(passSampleCount, 1);
+
+	TraceScope scope("schedule pass", "render");
+	std::vector<TilePass> passes;
+	std::vector<Candidate> candidates;
+
+	for (const auto& tile : MakeTiles())
+	{
+		// Every pixel of a tile gets the same number of samples
+		int level = accumulation.At(tile.x, tile.y).samplesTaken;
+
+		if (level < MinSamplesPerPixel())
+		{
+			passes.push_back(TilePass{ tile, std::min(level + step, MinSamplesPerPixel()) });
+		}
+		else if (level < MaxSamplesPerPixel())
+		{
+			float error = TileError(tile, accumulation);
+			if (error > settings.adaptiveThreshold)
+			{
+				// Always the same step here, so that the result doesn't
+				// depend on how the caller splits the render into passes
+				int endSample = std::min(level + ADAPTIVE_PASS_SAMPLES, MaxSamplesPerPixel());
+				candidates.push_back(Candidate{ TilePass{ tile, endSample }, (int64_t)tile.width * tile.height * (endSample - level), error });
+			}
+		}
+	}
+
+	if (!passes.empty())
+	{
+		return passes;
+	}
+
+	std::stable_sort(candidates.begin(), candidates.end(),
+					 [](const Candidate& a, const Candidate& b) { return a.error > b.error; });
+
+	int64_t budget = (int64_t)settings.width * settings.height * settings.sampleCount - (int64_t)accumulation.TotalSamples();
+	for (const auto& candidate : candidates)
+	{
+		if (budget <= 0)
+		{
+			break;
+		}
+
+		passes.push_back(candidate.pass);
+		budget -= candidate.cost;
+	}
+
+	return passes;
+}
+
+std::vector<Tile> Renderer::MakeTiles() const
+{
+	std::vector<Tile> tiles;
+	int tileSize = settings.tileSize > 0 ? settings.tileSize : DEFAULT_TILE_SIZE;
+
+	for (int y = 0; y < settings.height; y += tileSize)
+	{
+		for (int x = 0; x < settings.width; x += tileSize)
+		{
+			int tileWidth = std::min(tileSize, settings.width - x);
+			int tileHeight = std::min(tileSize, settings.height - y);
+			tiles.push_back(Tile{ x, y, tileWidth, tileHeight });
+		}
+	}
+
+	return tiles;
+}
+
+void Renderer::RenderTile(const Tile& tile, AccumulationBuffer& accumulation, int endSample) const
+{
+	TraceScope scope("tile", "render");
+	scope.AddArg("x", tile.x);
+	scope.AddArg("y", tile.y);
+	scope.AddArg("endSample", endSample);
+
+	// With maxDepth <= 1 not even the primary rays are traced. Packets and
+	// the wavefront work on the whole tile at once, so that is as finely
+	// as their cost can be measured.
+	if (settings.usePackets && settings.maxDepth > 1)
+	{
+		MeasureCost(tile, [&] { RenderTileWithPackets(tile, accumulation, endSample); });
+		return;
+	}
+
+	if (settings.useWavefront)
+	{
+		MeasureCost(tile, [&] { RenderTileWavefront(tile, accumulation, endSample); });
+		return;
+	}
+
+	Sampler sampler(accumulation.Seed(), sequence.get());
+
+	for (int y = tile.y; y < tile.y + tile.height; ++y)
+	{
+		for (int x = tile.x; x < tile.x + tile.width; ++x)
+		{
+			MeasureCost(Tile{ x, y, 1, 1 }, [&] { RenderPixel(x, y, endSample, sampler, accumulation.At(x, y)); });
+		}
+	}
+}
+
+Ray Renderer::GetCameraRay(int x, int y, Sampler& sampler) const
+{
+	int j = settings.height - 1 - y;
+
+	Point2 jitter = sampler.Next2D();
+	float u = float(x + jitter.u) / (float)settings.width;
+	float v = float(j + jitter.v) / (float)settings.height;
+	return camera.GetRay(u, v);
+}
+
+void Renderer::RenderPixel(int x, int y, int endSample, Sampler& sampler, PixelEstimate& estimate) const
+{
+	while (estimate.samplesTaken < endSample)
+	{
+		sampler.StartSample(PixelIndex(x, y), (uint32_t)estimate.samplesTaken);
+		auto ray = GetCameraRay(x, y, sampler);
+		estimate.Add(SampleRecursiveWithMaterial(ray, world, sampler, 0, Paths()));
+	}
+}
+
+// Same result as RenderPixel for every pixel, but the primary rays of
+// each 8x8 block are traced together, one packet per round of samples;
+// only the bounces after the first hit are traced one ray at a time.
+
+void Renderer::RenderTileWithPackets(const Tile& tile, AccumulationBuffer& accumulation, int endSample) const
+{
+	Sampler sampler(accumulation.Seed(), sequence.get());
+	RayPacket packet;
+	HitInfo hits[RayPacket::MAX_SIZE];
+	bool isHit[RayPacket::MAX_SIZE];
+	PixelEstimate* rayEstimates[RayPacket::MAX_SIZE];
+	uint32_t rayPixels[RayPacket::MAX_SIZE];
+	uint32_t raySamples[RayPacket::MAX_SIZE];
+	const PathSettings paths = Paths();
+
+	for (int blockY = tile.y; blockY < tile.y + tile.height; blockY += PACKET_BLOCK_SIZE)
+	{
+		for (int blockX = tile.x; blockX < tile.x + tile.width; blockX += PACKET_BLOCK_SIZE)
+		{
+			int blockWidth = std::min(PACKET_BLOCK_SIZE, tile.x + tile.width - blockX);
+			int blockHeight = std::min(PACKET_BLOCK_SIZE, tile.y + tile.height - blockY);
+			int pixelCount = blockWidth * blockHeight;
+
+			for (;;)
+			{
+				packet.Clear();
+
+				for (int p = 0; p < pixelCount; ++p)
+				{
+					int x = blockX + p % blockWidth;
+					int y = blockY + p / blockWidth;
+					PixelEstimate& estimate = accumulation.At(x, y);
+
+					if (estimate.samplesTaken < endSample)
+					{
+						rayEstimates[packet.size] = &estimate;
+						rayPixels[packet.size] = PixelIndex(x, y);
+						raySamples[packet.size] = (uint32_t)estimate.samplesTaken;
+						sampler.StartSample(rayPixels[packet.size], raySamples[packet.size]);
+						packet.Add(GetCameraRay(x, y, sampler));
+					}
+				}
+
+				if (packet.size == 0)
+				{
+					break;
+				}
+
+				packet.Finalize();
+				RT_STAT_RAYS(1, packet.size);
+				world->RaycastPacket(packet, true, OUT hits, OUT isHit);
+
+				for (int r = 0; r < packet.size; ++r)
+				{
+					// Replay the camera jitter, so that the rest of the path
+					// draws the same numbers as it would in RenderPixel
+					sampler.StartSample(rayPixels[r], raySamples[r]);
+					sampler.Next2D();
+
+					if (!isHit[r])
+					{
+						RT_STAT_PATH_END(1, PathEnd::Escaped);
+					}
+
+					rayEstimates[r]->Add(isHit[r] ? ShadeHit(packet.rays[r], hits[r], world, sampler, 1, paths, Vec3(1.0f, 1.0f, 1.0f))
+												  : SampleSky(packet.rays[r]));
+				}
+			}
+		}
+	}
+}
+
+// Each round of samples over the tile is one wave: a path for each pixel
+// that still wants samples, all traced together by the WavefrontIntegrator.
+// Waves run in sample order, so adaptive sampling stops pixels at the same
+// point as RenderPixel does.
+
+void Renderer::RenderTileWavefront(const Tile& tile, AccumulationBuffer& accumulation, int endSample) const
+{
+	WavefrontIntegrator integrator(world, Paths());
+	int pixelCount = tile.width * tile.height;
+
+	std::vector<Vec3> results(pixelCount);
+	std::vector<int> wavePixels;
+	std::vector<PathState> paths;
+	paths.reserve(pixelCount);
+
+	for (;;)
+	{
+		wavePixels.clear();
+
+		for (int p = 0; p < pixelCount; ++p)
+		{
+			int x = tile.x + p % tile.width;
+			int y = tile.y + p / tile.width;
+			const PixelEstimate& estimate = accumulation.At(x, y);
+
+			if (estimate.samplesTaken < endSample)
+			{
+				Sampler sampler(accumulation.Seed(), sequence.get());
+				sampler.StartSample(PixelIndex(x, y), (uint32_t)estimate.samplesTaken);
+				Ray ray = GetCameraRay(x, y, sampler);
+
+				paths.push_back(PathState{ ray, Vec3(1.0f, 1.0f, 1.0f), sampler, p, 0 });
+				wavePixels.push_back(p);
+			}
+		}
+
+		if (wavePixels.empty())
+		{
+			break;
+		}
+
+		integrator.Trace(paths, OUT results.data());
+
+		for (int p : wavePixels)
+		{
+			accumulation.At(tile.x + p % tile.width, tile.y + p / tile.width).Add(results[p]);
+		}
+	}
+}
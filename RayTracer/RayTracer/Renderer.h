@@ -0,0 +1,131 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Accumulation.h"
+#include "Camera.h"
+#include "CostMap.h"
+#include "Framebuffer.h"
+#include "Hitable.h"
+#include "Integrator.h"
+#include "SampleSequence.h"
+#include "Sampler.h"
+#include "ThreadPool.h"
+
+const int DEFAULT_MAX_DEPTH = 32;
+const int DEFAULT_SAMPLE_COUNT = 10;
+const int DEFAULT_TILE_SIZE = 16;
+
+// Adaptive sampling: every pixel first gets ADAPTIVE_MIN_SAMPLES samples;
+// after that, tiles whose (RMS) RelativeError() is below the threshold
+// stop, and the budget they leave (width * height * sampleCount samples in
+// total) is handed out in passes of ADAPTIVE_PASS_SAMPLES to the tiles with
+// the largest error, up to ADAPTIVE_MAX_SAMPLE_FACTOR * sampleCount per
+// pixel. It is off unless asked for (--adaptive), so that the sample
+// count is exact by default; SUGGESTED_ADAPTIVE_THRESHOLD is what a bare
+// --adaptive uses.
+const float DEFAULT_ADAPTIVE_THRESHOLD = 0.0f;
+const float SUGGESTED_ADAPTIVE_THRESHOLD = 0.01f;
+const int ADAPTIVE_MIN_SAMPLES = 8;
+const int ADAPTIVE_PASS_SAMPLES = 8;
+const int ADAPTIVE_MAX_SAMPLE_FACTOR = 8;
+
+struct RenderSettings
+{
+	int width = 320;
+	int height = 200;
+	int sampleCount = DEFAULT_SAMPLE_COUNT;
+	int maxDepth = DEFAULT_MAX_DEPTH;
+	int rouletteDepth = DEFAULT_ROULETTE_DEPTH;		// see PathSettings; 0: no Russian roulette
+	float rouletteMinSurvival = DEFAULT_ROULETTE_MIN_SURVIVAL;
+	int threadCount = ThreadPool::DefaultThreadCount();
+	int tileSize = DEFAULT_TILE_SIZE;
+	uint64_t seed = DEFAULT_RENDER_SEED;
+	bool usePackets = false;		// trace primary rays in 8x8 packets
+	bool useWavefront = false;		// trace whole tiles with the WavefrontIntegrator
+	float adaptiveThreshold = DEFAULT_ADAPTIVE_THRESHOLD;	// 0: sampleCount samples for every pixel
+	SamplerType samplerType = SamplerType::Random;
+};
+
+// A rectangle of pixels in image space (y == 0 is the top row).
+struct Tile
+{
+	int x;
+	int y;
+	int width;
+	int height;
+};
+
+class Renderer
+{
+public:
+	Renderer(const HitableList* world, const Camera& camera, const RenderSettings& settings);
+
+	// Splits the image into tiles, renders them on the pool, and
+	// returns once every pixel of the framebuffer has been written.
+	void Render(ThreadPool& pool, Framebuffer& framebuffer) const;
+
+	// Carries on from wherever the accumulation buffer is until every pixel
+	// is done, passSampleCount samples per pixel at a time (the adaptive
+	// passes that follow the minimum samples always add
+	// ADAPTIVE_PASS_SAMPLES); onPassDone (if set) is called after each pass,
+	// e.g. to checkpoint.
+	void RenderProgressive(ThreadPool& pool, AccumulationBuffer& accumulation, int passSampleCount,
+						   const std::function<void(const AccumulationBuffer&)>& onPassDone) const;
+
+	std::vector<Tile> MakeTiles() const;
+
+	// Brings every pixel of the tile that isn't done yet up to endSample
+	// samples.
+	void RenderTile(const Tile& tile, AccumulationBuffer& accumulation, int endSample) const;
+
+	// While set, every tile rendered adds what it cost to the map
+	void SetCostMap(CostMap* map) { costMap = map; }
+
+	bool IsAdaptive() const { return settings.adaptiveThreshold > 0.0f; }
+	int MinSamplesPerPixel() const;
+	int MaxSamplesPerPixel() const;
+	float TileError(const Tile& tile, const AccumulationBuffer& accumulation) const;
+
+	struct TilePass
+	{
+		Tile tile;
+		int endSample;
+	};
+
+	// The tiles RenderProgressive renders next, and to how many samples;
+	// none once the image is done. Only reads the accumulation buffer, so
+	// it can also drive tiles rendered elsewhere (see Distributed.h).
+	std::vector<TilePass> SchedulePass(const AccumulationBuffer& accumulation, int passSampleCount) const;
+
+private:
+#ifdef RT_STATS
+	void CountSamples(const AccumulationBuffer& accumulation, uint64_t startSamples) const;
+#endif
+	void RenderPixel(int x, int y, int endSample, Sampler& sampler, PixelEstimate& estimate) const;
+	void RenderTileWithPackets(const Tile& tile, AccumulationBuffer& accumulation, int endSample) const;
+	void RenderTileWavefront(const Tile& tile, AccumulationBuffer& accumulation, int endSample) const;
+	Ray GetCameraRay(int x, int y, Sampler& sampler) const;
+	PathSettings Paths() const { return PathSettings{ settings.maxDepth, settings.rouletteDepth, settings.rouletteMinSurvival }; }
+	uint32_t PixelIndex(int x, int y) const { return (uint32_t)(y * settings.width + x); }
+
+	template <typename Work>
+	void MeasureCost(const Tile& region, const Work& work) const
+	{
+		if (costMap == nullptr)
+		{
+			work();
+			return;
+		}
+
+		CostProbe probe;
+		work();
+		costMap->Add(region.x, region.y, region.width, region.height, probe.Elapsed());
+	}
+
+	const HitableList* world;
+	Camera camera;
+	RenderSettings settings;
+	std::shared_ptr<const ASampleSequence> sequence;		// null: random
+	CostMap* costMap = nullptr;
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+// A thin wrapper over whatever SIMD instruction set the compiler targets:
+// AVX (8 lanes) when built with /arch:AVX2 or -mavx2, SSE (4 lanes) on any
+// x64 build, and plain floats otherwise. Define RT_NO_SIMD to force the
+// scalar version, e.g. to compare results against it.
+//
+// SimdFloat holds SIMD_WIDTH floats; comparisons return a SimdMask, which
+// can be combined, tested and used to Select() between two SimdFloats.
+// SimdVec3 (at the end) is SIMD_WIDTH Vec3s as three SimdFloats.
+//
+// Besides the exact Sqrt(), there are the hardware estimates of 1 / x and
+// 1 / sqrt(x), RcpApprox() and RsqrtApprox(), good to a relative error of
+// 1.5 * 2^-12 (about 4e-4), and RcpFast() and RsqrtFast(), which add a
+// Newton-Raphson step and are good to about 2^-22 (2.5e-7) - nearly float
+// precision, for half the latency of a division or square root. The scalar
+// version computes all four exactly.
+
+#include <cmath>
+#include <cstdint>
+
+#if !defined(RT_NO_SIMD) && (defined(__AVX2__) || defined(__AVX__))
+#define RT_SIMD_AVX 1
+#include <immintrin.h>
+#elif !defined(RT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define RT_SIMD_SSE 1
+#include <emmintrin.h>
+#endif
+
+#if defined(RT_SIMD_AVX)
+
+const int SIMD_WIDTH = 8;
+inline const char* SimdBackendName() { return "AVX"; }
+
+struct SimdMask
+{
+	__m256 m;
+	inline SimdMask operator&(const SimdMask& o) const { return SimdMask{ _mm256_and_ps(m, o.m) }; }
+	inline SimdMask operator|(const SimdMask& o) const { return SimdMask{ _mm256_or_ps(m, o.m) }; }
+	inline int Bits() const { return _mm256_movemask_ps(m); }
+	inline bool Any() const { return Bits() != 0; }
+};
+
+// Lanes of "a" that are not set in "b"
+inline SimdMask AndNot(const SimdMask& a, const SimdMask& b) { return SimdMask{ _mm256_andnot_ps(b.m, a.m) }; }
+
+struct SimdFloat
+{
+	__m256 v;
+
+	static inline SimdFloat Splat(float f) { return SimdFloat{ _mm256_set1_ps(f) }; }
+	static inline SimdFloat Load(const float* p) { return SimdFloat{ _mm256_loadu_ps(p) }; }
+	static inline SimdFloat LaneIndices() { return SimdFloat{ _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7) }; }
+	inline void Store(float* p) const { _mm256_storeu_ps(p, v); }
+	inline void StoreTruncated(int32_t* p) const { _mm256_storeu_si256((__m256i*)p, _mm256_cvttps_epi32(v)); }
+
+	inline SimdFloat operator+(const SimdFloat& o) const { return SimdFloat{ _mm256_add_ps(v, o.v) }; }
+	inline SimdFloat operator-(const SimdFloat& o) const { return SimdFloat{ _mm256_sub_ps(v, o.v) }; }
+	inline SimdFloat operator*(const SimdFloat& o) const { return SimdFloat{ _mm256_mul_ps(v, o.v) }; }
+	inline SimdFloat operator/(const SimdFloat& o) const { return SimdFloat{ _mm256_div_ps(v, o.v) }; }
+
+	inline SimdMask operator<(const SimdFloat& o) const { return SimdMask{ _mm256_cmp_ps(v, o.v, _CMP_LT_OQ) }; }
+	inline SimdMask operator>(const SimdFloat& o) const { return SimdMask{ _mm256_cmp_ps(v, o.v, _CMP_GT_OQ) }; }
+	inline SimdMask operator<=(const SimdFloat& o) const { return SimdMask{ _mm256_cmp_ps(v, o.v, _CMP_LE_OQ) }; }
+	inline SimdMask operator>=(const SimdFloat& o) const { return SimdMask{ _mm256_cmp_ps(v, o.v, _CMP_GE_OQ) }; }
+};
+
+inline SimdFloat Select(const SimdMask& mask, const SimdFloat& a, const SimdFloat& b) { return SimdFloat{ _mm256_blendv_ps(b.v, a.v, mask.m) }; }
+inline SimdFloat Min(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{ _mm256_min_ps(a.v, b.v) }; }
+inline SimdFloat Max(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{ _mm256_max_ps(a.v, b.v) }; }
+inline SimdFloat Sqrt(const SimdFloat& a) { return SimdFloat{ _mm256_sqrt_ps(a.v) }; }
+inline SimdFloat RcpApprox(const SimdFloat& a) { return SimdFloat{ _mm256_rcp_ps(a.v) }; }
+inline SimdFloat RsqrtApprox(const SimdFloat& a) { return SimdFloat{ _mm256_rsqrt_ps(a.v) }; }
+
+#elif defined(RT_SIMD_SSE)
+
+const int SIMD_WIDTH = 4;
+inline const char* SimdBackendName() { return "SSE2"; }
+
+struct SimdMask
+{
+	__m128 m;
+	inline SimdMask operator&(const SimdMask& o) const { return SimdMask{ _mm_and_ps(m, o.m) }; }
+	inline SimdMask operator|(const SimdMask& o) const { return SimdMask{ _mm_or_ps(m, o.m) }; }
+	inline int Bits() const { return _mm_movemask_ps(m); }
+	inline bool Any() const { return Bits() != 0; }
+};
+
+inline SimdMask AndNot(const SimdMask& a, const SimdMask& b) { return SimdMask{ _mm_andnot_ps(b.m, a.m) }; }
+
+struct SimdFloat
+{
+	__m128 v;
+
+	static inline SimdFloat Splat(float f) { return SimdFloat{ _mm_set1_ps(f) }; }
+	static inline SimdFloat Load(const float* p) { return SimdFloat{ _mm_loadu_ps(p) }; }
+	static inline SimdFloat LaneIndices() { return SimdFloat{ _mm_setr_ps(0, 1, 2, 3) }; }
+	inline void Store(float* p) const { _mm_storeu_ps(p, v); }
+	inline void StoreTruncated(int32_t* p) const { _mm_storeu_si128((__m128i*)p, _mm_cvttps_epi32(v)); }
+
+	inline SimdFloat operator+(const SimdFloat& o) const { return SimdFloat{ _mm_add_ps(v, o.v) }; }
+	inline SimdFloat operator-(const SimdFloat& o) const { return SimdFloat{ _mm_sub_ps(v, o.v) }; }
+	inline SimdFloat operator*(const SimdFloat& o) const { return SimdFloat{ _mm_mul_ps(v, o.v) }; }
+	inline SimdFloat operator/(const SimdFloat& o) const { return SimdFloat{ _mm_div_ps(v, o.v) }; }
+
+	inline SimdMask operator<(const SimdFloat& o) const { return SimdMask{ _mm_cmplt_ps(v, o.v) }; }
+	inline SimdMask operator>(const SimdFloat& o) const { return SimdMask{ _mm_cmpgt_ps(v, o.v) }; }
+	inline SimdMask operator<=(const SimdFloat& o) const { return SimdMask{ _mm_cmple_ps(v, o.v) }; }
+	inline SimdMask operator>=(const SimdFloat& o) const { return SimdMask{ _mm_cmpge_ps(v, o.v) }; }
+};
+
+inline SimdFloat Select(const SimdMask& mask, const SimdFloat& a, const SimdFloat& b)
+{
+	return SimdFloat{ _mm_or_ps(_mm_and_ps(mask.m, a.v), _mm_andnot_ps(mask.m, b.v)) };
+}
+
+inline SimdFloat Min(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{ _mm_min_ps(a.v, b.v) }; }
+inline SimdFloat Max(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{ _mm_max_ps(a.v, b.v) }; }
+inline SimdFloat Sqrt(const SimdFloat& a) { return SimdFloat{ _mm_sqrt_ps(a.v) }; }
+inline SimdFloat RcpApprox(const SimdFloat& a) { return SimdFloat{ _mm_rcp_ps(a.v) }; }
+inline SimdFloat RsqrtApprox(const SimdFloat& a) { return SimdFloat{ _mm_rsqrt_ps(a.v) }; }
+
+#else
+
+const int SIMD_WIDTH = 1;
+inline const char* SimdBackendName() { return "scalar"; }
+
+struct SimdMask
+{
+	bool m;
+	inline SimdMask operator&(const SimdMask& o) const { return SimdMask{ m && o.m }; }
+	inline SimdMask operator|(const SimdMask& o) const { return SimdMask{ m || o.m }; }
+	inline int Bits() const { return m ? 1 : 0; }
+	inline bool Any() const { return m; }
+};
+
+inline SimdMask AndNot(const SimdMask& a, const SimdMask& b) { return SimdMask{ a.m && !b.m }; }
+
+struct SimdFloat
+{
+	float v;
+
+	static inline SimdFloat Splat(float f) { return SimdFloat{ f }; }
+	static inline SimdFloat Load(const float* p) { return SimdFloat{ *p }; }
+	static inline SimdFloat LaneIndices() { return SimdFloat{ 0.0f }; }
+	inline void Store(float* p) const { *p = v; }
+	inline void StoreTruncated(int32_t* p) const { *p = (int32_t)v; }
+
+	inline SimdFloat operator+(const SimdFloat& o) const { return SimdFloat{ v + o.v }; }
+	inline SimdFloat operator-(const SimdFloat& o) const { return SimdFloat{ v - o.v }; }
+	inline SimdFloat operator*(const SimdFloat& o) const { return SimdFloat{ v * o.v }; }
+	inline SimdFloat operator/(const SimdFloat& o) const { return SimdFloat{ v / o.v }; }
+
+	inline SimdMask operator<(const SimdFloat& o) const { return SimdMask{ v < o.v }; }
+	inline SimdMask operator>(const SimdFloat& o) const { return SimdMask{ v > o.v }; }
+	inline SimdMask operator<=(const SimdFloat& o) const { return SimdMask{ v <= o.v }; }
+	inline SimdMask operator>=(const SimdFloat& o) const { return SimdMask{ v >= o.v }; }
+};
+
+inline SimdFloat Select(const SimdMask& mask, const SimdFloat& a, const SimdFloat& b) { return mask.m ? a : b; }
+inline SimdFloat Min(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{ a.v < b.v ? a.v : b.v }; }
+inline SimdFloat Max(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{ a.v > b.v ? a.v : b.v }; }
+inline SimdFloat Sqrt(const SimdFloat& a) { return SimdFloat{ std::sqrt(a.v) }; }
+inline SimdFloat RcpApprox(const SimdFloat& a) { return SimdFloat{ 1.0f / a.v }; }
+inline SimdFloat RsqrtApprox(const SimdFloat& a) { return SimdFloat{ 1.0f / std::sqrt(a.v) }; }
+
+#endif
+
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE)
+
+// One Newton-Raphson step on the estimate roughly doubles its bits
+inline SimdFloat RcpFast(const SimdFloat& a)
+{
+	SimdFloat estimate = RcpApprox(a);
+	return estimate * (SimdFloat::Splat(2.0f) - a * estimate);
+}
+
+inline SimdFloat RsqrtFast(const SimdFloat& a)
+{
+	SimdFloat estimate = RsqrtApprox(a);
+	return estimate * (SimdFloat::Splat(1.5f) - SimdFloat::Splat(0.5f) * a * estimate * estimate);
+}
+
+#else
+
+inline SimdFloat RcpFast(const SimdFloat& a) { return RcpApprox(a); }
+inline SimdFloat RsqrtFast(const SimdFloat& a) { return RsqrtApprox(a); }
+
+#endif
+
+struct SimdVec3
+{
+	SimdFloat x;
+	SimdFloat y;
+	SimdFloat z;
+
+	static inline SimdVec3 Splat(float x, float y, float z)
+	{
+		return SimdVec3{ SimdFloat::Splat(x), SimdFloat::Splat(y), SimdFloat::Splat(z) };
+	}
+
+	// SIMD_WIDTH consecutive entries of three structure-of-arrays columns
+	static inline SimdVec3 Load(const float* xs, const float* ys, const float* zs)
+	{
+		return SimdVec3{ SimdFloat::Load(xs), SimdFloat::Load(ys), SimdFloat::Load(zs) };
+	}
+
+	inline SimdVec3 operator+(const SimdVec3& o) const { return SimdVec3{ x + o.x, y + o.y, z + o.z }; }
+	inline SimdVec3 operator-(const SimdVec3& o) const { return SimdVec3{ x - o.x, y - o.y, z - o.z }; }
+	inline SimdVec3 operator*(const SimdFloat& s) const { return SimdVec3{ x * s, y * s, z * s }; }
+
+	// Same order of operations as Vec3's, so lanes match it bit for bit
+	inline SimdFloat Dot(const SimdVec3& o) const { return x * o.x + y * o.y + z * o.z; }
+	inline SimdFloat SqrMagnitude() const { return x * x + y * y + z * z; }
+
+	inline SimdVec3 Cross(const SimdVec3& o) const
+	{
+		return SimdVec3{ y * o.z - z * o.y, z * o.x - x * o.z, x * o.y - y * o.x };
+	}
+};
+
+// The names for the widths the backends have
+#if defined(RT_SIMD_AVX)
+typedef SimdVec3 Vec3x8;
+#elif defined(RT_SIMD_SSE)
+typedef SimdVec3 Vec3x4;
+#endif
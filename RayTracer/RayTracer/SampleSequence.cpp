@@ -0,0 +1,434 @@
+#include "pch.h"
+#include "SampleSequence.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const char* SAMPLER_NAMES[] = { "random", "stratified", "halton", "sobol", "blue-noise" };
+
+	// Tell apart the scrambles of the two coordinates of a pair
+	const uint32_t SCRAMBLE_SEEDS[2] = { 0x68bc21ebu, 0x02e5be93u };
+
+	const uint32_t PRIMES[HALTON_DIMENSIONS] = {
+		2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+		59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131
+	};
+
+	inline uint32_t Hash(uint32_t a, uint32_t b)
+	{
+		return (uint32_t)MixBits(((uint64_t)a << 32) | b);
+	}
+
+	inline uint32_t Hash(uint32_t a, uint32_t b, uint32_t c)
+	{
+		return Hash(Hash(a, b), c);
+	}
+
+	// The top 24 bits, as in Pcg32::NextFloat()
+	inline float ToFloat(uint32_t bits)
+	{
+		return (float)(bits >> 8) * (1.0f / 16777216.0f);
+	}
+
+	inline float WhiteNoise(uint32_t seed, uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension)
+	{
+		return ToFloat(Hash(Hash(seed, pixelIndex), sampleIndex, dimension));
+	}
+
+	inline float Fraction(float value)
+	{
+		return value - std::floor(value);
+	}
+
+	inline uint32_t ReverseBits(uint32_t x)
+	{
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+		x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+		x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+		x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+		return x;
+	}
+
+	// A random permutation of [0, length), one for every "seed" (Kensler,
+	// "Correlated Multi-Jittered Sampling", 2013)
+	uint32_t Permute(uint32_t i, uint32_t length, uint32_t seed)
+	{
+		uint32_t mask = length - 1;
+		mask |= mask >> 1;
+		mask |= mask >> 2;
+		mask |= mask >> 4;
+		mask |= mask >> 8;
+		mask |= mask >> 16;
+
+		do
+		{
+			i ^= seed;
+			i *= 0xe170893du;
+			i ^= seed >> 16;
+			i ^= (i & mask) >> 4;
+			i ^= seed >> 8;
+			i *= 0x0929eb3fu;
+			i ^= seed >> 23;
+			i ^= (i & mask) >> 1;
+			i *= 1 | seed >> 27;
+			i *= 0x6935fa69u;
+			i ^= (i & mask) >> 11;
+			i *= 0x74dcb303u;
+			i ^= (i & mask) >> 2;
+			i *= 0x9e501cc3u;
+			i ^= (i & mask) >> 2;
+			i *= 0xc860a3dfu;
+			i &= mask;
+			i ^= i >> 5;
+		} while (i >= length);
+
+		return (i + seed) % length;
+	}
+
+	// Owen scrambling: flips each bit depending on all the bits above it.
+	// Applied to a sample index, it shuffles the points without breaking
+	// up the power of two sized blocks that make Sobol points even.
+	inline uint32_t NestedUniformScramble(uint32_t x, uint32_t seed)
+	{
+		x = ReverseBits(x);
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return ReverseBits(x);
+	}
+
+	// The second dimension of the Sobol sequence is linear in the bits of
+	// the index; shuffled indices use all 32 of them, so it's looked up a
+	// byte at a time rather than computed bit by bit
+	struct SobolTable
+	{
+		uint32_t bytes[4][256];
+
+		SobolTable()
+		{
+			for (int byte = 0; byte < 4; ++byte)
+			{
+				for (uint32_t value = 0; value < 256; ++value)
+				{
+					uint32_t index = value << (8 * byte);
+					uint32_t result = 0;
+					for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+					{
+						if (index & 1)
+						{
+							result ^= v;
+						}
+					}
+
+					bytes[byte][value] = result;
+				}
+			}
+		}
+	};
+
+	const SobolTable SOBOL_SECOND_DIMENSION;
+
+	// The first two dimensions of the Sobol sequence, as 0.32 fixed point
+	inline uint32_t Sobol(uint32_t index, uint32_t dimension)
+	{
+		if (dimension == 0)
+		{
+			return ReverseBits(index);
+		}
+
+		const auto& bytes = SOBOL_SECOND_DIMENSION.bytes;
+		return bytes[0][index & 0xff] ^ bytes[1][(index >> 8) & 0xff] ^ bytes[2][(index >> 16) & 0xff] ^ bytes[3][index >> 24];
+	}
+
+	// Dimensions are used in pairs (the 2D sets); each gets its own
+	// shuffle and scramble from "pairSeed"
+	inline float ScrambledSobol(uint32_t sampleIndex, uint32_t coordinate, uint32_t pairSeed)
+	{
+		uint32_t index = NestedUniformScramble(sampleIndex, pairSeed);
+		return ToFloat(NestedUniformScramble(Sobol(index, coordinate), pairSeed ^ SCRAMBLE_SEEDS[coordinate]));
+	}
+
+	inline Point2 ScrambledSobol2D(uint32_t sampleIndex, uint32_t pairSeed)
+	{
+		uint32_t index = NestedUniformScramble(sampleIndex, pairSeed);
+		return Point2{ ToFloat(NestedUniformScramble(Sobol(index, 0), pairSeed ^ SCRAMBLE_SEEDS[0])),
+					   ToFloat(NestedUniformScramble(Sobol(index, 1), pairSeed ^ SCRAMBLE_SEEDS[1])) };
+	}
+
+	// The index's digits in the given base, mirrored around the point, with
+	// each digit permuted depending on the ones before it (Owen scrambling,
+	// as in pbrt-v4). Plain radical inverses in the larger bases line up in
+	// stripes over the first few hundred samples, which is worse than
+	// random; scrambled, they aren't. Scrambling the zeros past the index's
+	// last digit would make them uniformly random, so that's what they
+	// become, all in one go.
+	float ScrambledRadicalInverse(uint32_t index, uint32_t base, uint32_t seed)
+	{
+		double inverseBase = 1.0 / base;
+		double factor = 1.0;
+		uint64_t reversedDigits = 0;
+
+		do
+		{
+			uint32_t next = index / base;
+			uint32_t digit = index - next * base;
+			digit = Permute(digit, base, (uint32_t)MixBits(seed ^ reversedDigits));
+
+			reversedDigits = reversedDigits * base + digit;
+			factor *= inverseBase;
+			index = next;
+		} while (index > 0);
+
+		double tail = ToFloat((uint32_t)MixBits(seed ^ reversedDigits));
+		return std::min((float)((reversedDigits + tail) * factor), 0.99999994f);
+	}
+
+	// The energy of a set of pixels: a (wrapping) Gaussian around each.
+	// The set pixel with the most is in the tightest cluster; the unset
+	// pixel with the least, in the largest void.
+	class VoidAndCluster
+	{
+	public:
+		static const int SIZE = BLUE_NOISE_SIZE;
+		static const int COUNT = SIZE * SIZE;
+
+		VoidAndCluster() : kernel(COUNT), energy(COUNT, 0.0f), isSet(COUNT, 0)
+		{
+			const float sigma = 1.5f;
+
+			for (int y = 0; y < SIZE; ++y)
+			{
+				for (int x = 0; x < SIZE; ++x)
+				{
+					float dx = (float)std::min(x, SIZE - x);
+					float dy = (float)std::min(y, SIZE - y);
+					kernel[y * SIZE + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+				}
+			}
+		}
+
+		bool IsSet(int pixel) const { return isSet[pixel] != 0; }
+
+		void Set(int pixel, bool value)
+		{
+			isSet[pixel] = value ? 1 : 0;
+
+			float sign = value ? 1.0f : -1.0f;
+			int pixelX = pixel % SIZE;
+			int pixelY = pixel / SIZE;
+
+			for (int y = 0; y < SIZE; ++y)
+			{
+				const float* kernelRow = &kernel[((y - pixelY + SIZE) % SIZE) * SIZE];
+				for (int x = 0; x < SIZE; ++x)
+				{
+					energy[y * SIZE + x] += sign * kernelRow[(x - pixelX + SIZE) % SIZE];
+				}
+			}
+		}
+
+		int TightestCluster() const
+		{
+			int best = -1;
+			for (int pixel = 0; pixel < COUNT; ++pixel)
+			{
+				if (isSet[pixel] && (best < 0 || energy[pixel] > energy[best]))
+				{
+					best = pixel;
+				}
+			}
+
+			return best;
+		}
+
+		int LargestVoid() const
+		{
+			int best = -1;
+			for (int pixel = 0; pixel < COUNT; ++pixel)
+			{
+				if (!isSet[pixel] && (best < 0 || energy[pixel] < energy[best]))
+				{
+					best = pixel;
+				}
+			}
+
+			return best;
+		}
+
+	private:
+		std::vector<float> kernel;
+		std::vector<float> energy;
+		std::vector<char> isSet;
+	};
+
+	std::vector<float> MakeBlueNoiseMask()
+	{
+		const int count = VoidAndCluster::COUNT;
+		const int initialCount = count / 10;
+
+		// A tenth of the pixels at random, then spread out by moving the
+		// tightest cluster into the largest void until that changes nothing
+		VoidAndCluster pattern;
+		Pcg32 rng(DEFAULT_RENDER_SEED, 7);
+		for (int setCount = 0; setCount < initialCount;)
+		{
+			int pixel = (int)(rng.NextUInt() % count);
+			if (!pattern.IsSet(pixel))
+			{
+				pattern.Set(pixel, true);
+				setCount++;
+			}
+		}
+
+		for (;;)
+		{
+			int cluster = pattern.TightestCluster();
+			pattern.Set(cluster, false);
+			int hole = pattern.LargestVoid();
+			pattern.Set(hole, true);
+
+			if (hole == cluster)
+			{
+				break;
+			}
+		}
+
+		// Ranks below initialCount by taking pixels out of the pattern, the
+		// rest by filling it up
+		std::vector<int> ranks(count);
+		VoidAndCluster emptying = pattern;
+		for (int rank = initialCount - 1; rank >= 0; --rank)
+		{
+			int cluster = emptying.TightestCluster();
+			emptying.Set(cluster, false);
+			ranks[cluster] = rank;
+		}
+
+		for (int rank = initialCount; rank < count; ++rank)
+		{
+			int hole = pattern.LargestVoid();
+			pattern.Set(hole, true);
+			ranks[hole] = rank;
+		}
+
+		std::vector<float> mask(count);
+		for (int pixel = 0; pixel < count; ++pixel)
+		{
+			mask[pixel] = ((float)ranks[pixel] + 0.5f) / (float)count;
+		}
+
+		return mask;
+	}
+}
+
+bool ParseSamplerType(const std::string& name, SamplerType& type)
+{
+	for (int i = 0; i < 5; ++i)
+	{
+		if (name == SAMPLER_NAMES[i])
+		{
+			type = (SamplerType)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* SamplerTypeName(SamplerType type)
+{
+	return SAMPLER_NAMES[(int)type];
+}
+
+std::unique_ptr<ASampleSequence> MakeSampleSequence(SamplerType type, uint64_t seed, int width, int sampleCount)
+{
+	switch (type)
+	{
+	case SamplerType::Random: return nullptr;
+	case SamplerType::Stratified: return std::make_unique<StratifiedSequence>(seed, sampleCount);
+	case SamplerType::Halton: return std::make_unique<HaltonSequence>(seed);
+	case SamplerType::Sobol: return std::make_unique<SobolSequence>(seed);
+	case SamplerType::BlueNoise: return std::make_unique<BlueNoiseSequence>(seed, width);
+	}
+
+	return nullptr;
+}
+
+StratifiedSequence::StratifiedSequence(uint64_t seed, int sampleCount) :
+	seed{ (uint32_t)MixBits(seed) }, sampleCount{ (uint32_t)std::max(sampleCount, 1) }, gridSize{ 1 }
+{
+	while (gridSize * gridSize < this->sampleCount)
+	{
+		gridSize++;
+	}
+}
+
+float StratifiedSequence::Get(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const
+{
+	float jitter = WhiteNoise(seed, pixelIndex, sampleIndex, dimension);
+	if (sampleIndex >= sampleCount)
+	{
+		return jitter;
+	}
+
+	uint32_t cell = Permute(sampleIndex, gridSize * gridSize, Hash(seed, pixelIndex, dimension / 2));
+	uint32_t row = (dimension & 1) == 0 ? cell % gridSize : cell / gridSize;
+	return ((float)row + jitter) / (float)gridSize;
+}
+
+float HaltonSequence::Get(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const
+{
+	if (dimension >= (uint32_t)HALTON_DIMENSIONS)
+	{
+		return WhiteNoise(seed, pixelIndex, sampleIndex, dimension);
+	}
+
+	return ScrambledRadicalInverse(sampleIndex, PRIMES[dimension], Hash(seed, pixelIndex, dimension));
+}
+
+float SobolSequence::Get(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const
+{
+	return ScrambledSobol(sampleIndex, dimension & 1, Hash(seed, pixelIndex, dimension / 2));
+}
+
+Point2 SobolSequence::Get2D(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const
+{
+	return ScrambledSobol2D(sampleIndex, Hash(seed, pixelIndex, dimension / 2));
+}
+
+BlueNoiseSequence::BlueNoiseSequence(uint64_t seed, int width) :
+	seed{ (uint32_t)MixBits(seed) }, width{ (uint32_t)width }, mask{ BlueNoiseMask().data() }
+{
+}
+
+// A different part of the mask for each dimension, so that they aren't
+// all shifted alike
+float BlueNoiseSequence::Shift(uint32_t pixelIndex, uint32_t dimension) const
+{
+	uint32_t offset = Hash(seed, dimension);
+	uint32_t x = (pixelIndex % width + offset) % BLUE_NOISE_SIZE;
+	uint32_t y = (pixelIndex / width + (offset >> 16)) % BLUE_NOISE_SIZE;
+	return mask[y * BLUE_NOISE_SIZE + x];
+}
+
+float BlueNoiseSequence::Get(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const
+{
+	float point = ScrambledSobol(sampleIndex, dimension & 1, Hash(seed, dimension / 2));
+	return Fraction(point + Shift(pixelIndex, dimension));
+}
+
+Point2 BlueNoiseSequence::Get2D(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const
+{
+	Point2 point = ScrambledSobol2D(sampleIndex, Hash(seed, dimension / 2));
+	return Point2{ Fraction(point.u + Shift(pixelIndex, dimension)), Fraction(point.v + Shift(pixelIndex, dimension + 1)) };
+}
+
+const std::vector<float>& BlueNoiseMask()
+{
+	static const std::vector<float> mask = MakeBlueNoiseMask();
+	return mask;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Sampler.h"
+
+// Where a Sampler's numbers come from. Random is plain PCG, one
+// independent stream per sample. The others are point sets that cover
+// [0, 1)^n more evenly than random points do, so the error of a pixel's
+// average falls off faster with the number of samples:
+//
+//	Stratified	a jittered grid per pair of dimensions, with the cells
+//				visited in a random order; only the first sampleCount
+//				samples are stratified, later ones (adaptive sampling) are
+//				random
+//	Halton		radical inverses in the first HALTON_DIMENSIONS prime bases,
+//				Owen-scrambled per pixel; random beyond that
+//	Sobol		Owen-scrambled Sobol points, one 2D set per pair of
+//				dimensions, each shuffled and scrambled independently per
+//				pixel (Burley, "Practical Hash-based Owen Scrambling", 2020)
+//	BlueNoise	the same Sobol points in every pixel, shifted by a blue
+//				noise mask, so that what error is left is spread out as
+//				fine-grained, even noise instead of clumps
+enum class SamplerType
+{
+	Random,
+	Stratified,
+	Halton,
+	Sobol,
+	BlueNoise
+};
+
+const int HALTON_DIMENSIONS = 32;
+const int BLUE_NOISE_SIZE = 64;		// the mask repeats every 64x64 pixels
+
+bool ParseSamplerType(const std::string& name, SamplerType& type);
+const char* SamplerTypeName(SamplerType type);
+
+// nullptr for SamplerType::Random. "width" is the image's, to find the
+// pixel's position in the blue noise mask; sampleCount, the number of
+// strata.
+std::unique_ptr<ASampleSequence> MakeSampleSequence(SamplerType type, uint64_t seed, int width, int sampleCount);
+
+class StratifiedSequence : public ASampleSequence
+{
+public:
+	StratifiedSequence(uint64_t seed, int sampleCount);
+	float Get(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const override;
+
+private:
+	uint32_t seed;
+	uint32_t sampleCount;
+	uint32_t gridSize;		// cells per side; gridSize^2 >= sampleCount
+};
+
+class HaltonSequence : public ASampleSequence
+{
+public:
+	explicit HaltonSequence(uint64_t seed) : seed{ (uint32_t)MixBits(seed) } {}
+	float Get(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const override;
+
+private:
+	uint32_t seed;
+};
+
+class SobolSequence : public ASampleSequence
+{
+public:
+	explicit SobolSequence(uint64_t seed) : seed{ (uint32_t)MixBits(seed) } {}
+	float Get(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const override;
+	Point2 Get2D(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const override;
+
+private:
+	uint32_t seed;
+};
+
+class BlueNoiseSequence : public ASampleSequence
+{
+public:
+	BlueNoiseSequence(uint64_t seed, int width);
+	float Get(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const override;
+	Point2 Get2D(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const override;
+
+private:
+	float Shift(uint32_t pixelIndex, uint32_t dimension) const;
+
+	uint32_t seed;
+	uint32_t width;
+	const float* mask;
+};
+
+// BLUE_NOISE_SIZE^2 thresholds in [0, 1), each value once, ordered so that
+// any threshold picks an evenly spread set of pixels (void and cluster;
+// Ulichney, 1993). Made on first use and shared.
+const std::vector<float>& BlueNoiseMask();
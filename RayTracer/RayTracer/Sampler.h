@@ -0,0 +1,153 @@
+#pragma once
+#include <cstdint>
+
+const uint64_t DEFAULT_RENDER_SEED = 0x853c49e6748fea9bULL;
+
+struct Point2
+{
+	float u;
+	float v;
+};
+
+// PCG32 (M. E. O'Neill, pcg-random.org): 64 bits of state, 32 bits of
+// output per step, and a lot better statistically than the LCG hiding
+// behind std::default_random_engine - at a fraction of the cost of
+// going through std::uniform_real_distribution.
+
+class Pcg32
+{
+public:
+	Pcg32() { Seed(DEFAULT_RENDER_SEED, 1); }
+	Pcg32(uint64_t seed, uint64_t stream) { Seed(seed, stream); }
+
+	inline void Seed(uint64_t seed, uint64_t stream)
+	{
+		state = 0;
+		increment = (stream << 1u) | 1u;
+		NextUInt();
+		state += seed;
+		NextUInt();
+	}
+
+	inline uint32_t NextUInt()
+	{
+		uint64_t oldState = state;
+		state = oldState * 6364136223846793005ULL + increment;
+		uint32_t xorShifted = (uint32_t)(((oldState >> 18u) ^ oldState) >> 27u);
+		uint32_t rotation = (uint32_t)(oldState >> 59u);
+		return (xorShifted >> rotation) | (xorShifted << ((0u - rotation) & 31u));
+	}
+
+	// Uniform in [0, 1); uses the top 24 bits, which is all a float can hold.
+	inline float NextFloat()
+	{
+		return (float)(NextUInt() >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	uint64_t state;
+	uint64_t increment;
+};
+
+// SplitMix64 finalizer; turns structured keys (seed, pixel, sample)
+// into well-mixed 64 bit seeds.
+inline uint64_t MixBits(uint64_t value)
+{
+	value += 0x9e3779b97f4a7c15ULL;
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+	return value ^ (value >> 31);
+}
+
+// A point set with one point per (pixel, sample): Get() is one coordinate
+// of it, in [0, 1). Must be a pure function of its arguments, like the
+// PCG streams. The implementations are in SampleSequence.h.
+class ASampleSequence
+{
+public:
+	virtual ~ASampleSequence() {}
+	virtual float Get(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const = 0;
+
+	// Dimensions "dimension" (even) and "dimension" + 1 at once; sequences
+	// that make points in pairs can share the work
+	virtual Point2 Get2D(uint32_t pixelIndex, uint32_t sampleIndex, uint32_t dimension) const
+	{
+		return Point2{ Get(pixelIndex, sampleIndex, dimension), Get(pixelIndex, sampleIndex, dimension + 1) };
+	}
+};
+
+// How a sample's dimensions are laid out: the camera jitter first, then
+// a block per bounce, so that e.g. the third bounce always draws from the
+// same dimensions, however many numbers the bounces before it used.
+const uint32_t CAMERA_DIMENSIONS = 2;
+const uint32_t BOUNCE_DIMENSIONS = 4;		// scatter direction (2), roulette (1), spare (1)
+
+// Hands out the random numbers for one path at a time. Each (pixel, sample)
+// pair gets its own PCG stream derived from the render seed, so a pixel's
+// value doesn't depend on which thread rendered it, or in what order the
+// tiles were processed.
+//
+// With a sequence, numbers come from it instead, as long as they fit in
+// the current block of dimensions; any more come from the PCG stream.
+
+class Sampler
+{
+public:
+	explicit Sampler(uint64_t renderSeed, const ASampleSequence* sequence = nullptr) :
+		renderSeed{ renderSeed }, sequence{ sequence } {}
+
+	inline void StartSample(uint32_t pixelIndex, uint32_t sampleIndex)
+	{
+		uint64_t key = ((uint64_t)pixelIndex << 32) | sampleIndex;
+		rng.Seed(MixBits(renderSeed ^ MixBits(key)), pixelIndex);
+
+		pixel = pixelIndex;
+		sample = sampleIndex;
+		dimension = 0;
+		dimensionEnd = CAMERA_DIMENSIONS;
+	}
+
+	// "depth" as in ShadeHit: 1 for the camera ray's hit
+	inline void StartBounce(int depth)
+	{
+		dimension = CAMERA_DIMENSIONS + (uint32_t)(depth - 1) * BOUNCE_DIMENSIONS;
+		dimensionEnd = dimension + BOUNCE_DIMENSIONS;
+	}
+
+	inline float Next1D()
+	{
+		if (sequence != nullptr && dimension < dimensionEnd)
+		{
+			return sequence->Get(pixel, sample, dimension++);
+		}
+
+		return rng.NextFloat();
+	}
+
+	// Both halves from the same 2D set of the sequence
+	inline Point2 Next2D()
+	{
+		dimension += dimension & 1;
+		if (sequence != nullptr && dimension < dimensionEnd)
+		{
+			Point2 point = sequence->Get2D(pixel, sample, dimension);
+			dimension += 2;
+			return point;
+		}
+
+		float u = rng.NextFloat();
+		float v = rng.NextFloat();
+		return Point2{ u, v };
+	}
+
+	uint64_t RenderSeed() const { return renderSeed; }
+
+private:
+	uint64_t renderSeed;
+	const ASampleSequence* sequence;
+	Pcg32 rng;
+	uint32_t pixel = 0;
+	uint32_t sample = 0;
+	uint32_t dimension = 0;
+	uint32_t dimensionEnd = 0;
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <cmath>
+#include "Sampler.h"
+#include "Vec3.h"
+
+// Warps from the unit square to directions, for sampler-provided points:
+// each takes exactly one Point2 and has no rejection loop, so it keeps to
+// its bounce's dimensions and costs the same every time. Directions are
+// unit length, in a local frame with z along the normal; an
+// OrthonormalBasis takes them to world space. The pdfs are per unit solid
+// angle.
+
+const float SAMPLING_PI = 3.14159265f;
+const float SAMPLING_INV_PI = 1.0f / SAMPLING_PI;
+
+struct DirectionSample
+{
+	Vec3 direction;
+	float pdf;
+};
+
+// Three perpendicular unit vectors, the third along a given unit normal
+// (Duff et al., "Building an Orthonormal Basis, Revisited", 2017); no
+// branches beyond the sign.
+struct OrthonormalBasis
+{
+	Vec3 tangent;
+	Vec3 bitangent;
+	Vec3 normal;
+
+	explicit OrthonormalBasis(const Vec3& n) : normal{ n }
+	{
+		float sign = std::copysign(1.0f, n.z());
+		float a = -1.0f / (sign + n.z());
+		float b = n.x() * n.y() * a;
+		tangent = Vec3(1.0f + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+		bitangent = Vec3(b, sign + n.y() * n.y() * a, -n.y());
+	}
+
+	inline Vec3 ToWorld(const Vec3& local) const
+	{
+		return tangent * local.x() + bitangent * local.y() + normal * local.z();
+	}
+};
+
+// Shirley and Chiu's concentric mapping: keeps areas, and distorts less
+// than the polar one, so stratified points stay evenly spread. The
+// branches pick between two formulas and compile to selects.
+inline Point2 SampleConcentricDisk(const Point2& point)
+{
+	float x = 2.0f * point.u - 1.0f;
+	float y = 2.0f * point.v - 1.0f;
+
+	bool isNearXAxis = std::fabs(x) > std::fabs(y);
+	float radius = isNearXAxis ? x : y;
+	float ratio = isNearXAxis ? y / (x != 0.0f ? x : 1.0f) : x / (y != 0.0f ? y : 1.0f);
+	float phi = (SAMPLING_PI / 4.0f) * ratio;
+	float cosPhi = std::cos(phi);
+	float sinPhi = std::sin(phi);
+
+	return isNearXAxis ? Point2{ radius * cosPhi, radius * sinPhi } : Point2{ radius * sinPhi, radius * cosPhi };
+}
+
+inline float CosineHemispherePdf(float cosTheta)
+{
+	return cosTheta > 0.0f ? cosTheta * SAMPLING_INV_PI : 0.0f;
+}
+
+// Malley's method: a uniform point on the disk, lifted up to the
+// hemisphere, is distributed as cos(theta)
+inline DirectionSample SampleCosineHemisphere(const Point2& point)
+{
+	Point2 disk = SampleConcentricDisk(point);
+	float z = std::sqrt(std::fmax(0.0f, 1.0f - disk.u * disk.u - disk.v * disk.v));
+	return DirectionSample{ Vec3(disk.u, disk.v, z), CosineHemispherePdf(z) };
+}
+
+inline DirectionSample SampleUniformSphere(const Point2& point)
+{
+	float z = 1.0f - 2.0f * point.u;
+	float ring = std::sqrt(std::fmax(0.0f, 1.0f - z * z));
+	float phi = 2.0f * SAMPLING_PI * point.v;
+	return DirectionSample{ Vec3(ring * std::cos(phi), ring * std::sin(phi), z), 0.25f * SAMPLING_INV_PI };
+}
+
+inline DirectionSample SampleUniformHemisphere(const Point2& point)
+{
+	float z = point.u;
+	float ring = std::sqrt(std::fmax(0.0f, 1.0f - z * z));
+	float phi = 2.0f * SAMPLING_PI * point.v;
+	return DirectionSample{ Vec3(ring * std::cos(phi), ring * std::sin(phi), z), 0.5f * SAMPLING_INV_PI };
+}
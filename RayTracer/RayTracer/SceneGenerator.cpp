@@ -0,0 +1,194 @@
+#include "pch.h"
+#include "SceneGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <vector>
+#include "Sampler.h"
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+
+	// The default camera (MakeCamera) sees x in [-0.8z, 0.8z] and y in
+	// [-0.5z, 0.5z]; points are kept a little inside that.
+	Vec3 RandomPointInView(Pcg32& rng, float depth)
+	{
+		float z = 2.0f + rng.NextFloat() * depth;
+		float x = (rng.NextFloat() * 2.0f - 1.0f) * 0.7f * z;
+		float y = (rng.NextFloat() * 2.0f - 1.0f) * 0.45f * z;
+		return Vec3(x, y, z);
+	}
+
+	// Box - Muller
+	float RandomGaussian(Pcg32& rng)
+	{
+		float u = 1.0f - rng.NextFloat();
+		float v = rng.NextFloat();
+		return sqrtf(-2.0f * logf(u)) * cosf(2.0f * PI * v);
+	}
+
+	class Placer
+	{
+	public:
+		Placer(Pcg32& rng, const SceneParameters& parameters) : rng{ rng }, depth{ parameters.depth }
+		{
+			for (int i = 0; i < parameters.clusterCount; ++i)
+			{
+				clusters.push_back(RandomPointInView(rng, depth));
+			}
+		}
+
+		Vec3 Next()
+		{
+			if (clusters.empty())
+			{
+				return RandomPointInView(rng, depth);
+			}
+
+			const Vec3& center = clusters[rng.NextUInt() % clusters.size()];
+			float spread = depth * 0.05f;
+			return center + Vec3(RandomGaussian(rng), RandomGaussian(rng), RandomGaussian(rng)) * spread;
+		}
+
+	private:
+		Pcg32& rng;
+		float depth;
+		std::vector<Vec3> clusters;
+	};
+
+	double SecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void TessellateBlob(Mesh* mesh, int triangleCount, float bumpiness, float bumpFrequency)
+{
+	// rings - 1 rows of vertices between the two poles, with 2 * rings
+	// vertices each, give 4 * rings * (rings - 1) triangles
+	int rings = std::max(2, (int)(sqrtf(triangleCount / 4.0f) + 0.5f));
+	int segments = 2 * rings;
+	float frequency = floorf(bumpFrequency);
+
+	auto vertex = [&](float theta, float phi)
+	{
+		float radius = 1.0f + bumpiness * sinf(frequency * theta) * sinf(frequency * phi);
+		return Vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)) * radius;
+	};
+
+	int first = (int)mesh->Vertices().size();
+	int top = first;
+	int bottom = first + 1 + (rings - 1) * segments;
+	mesh->Reserve(bottom + 1, mesh->TriangleCount() + 4 * rings * (rings - 1));
+	auto ringVertex = [&](int ring, int segment) { return first + 1 + (ring - 1) * segments + segment % segments; };
+
+	mesh->AddVertex(Vec3(0.0f, 1.0f, 0.0f));
+	for (int ring = 1; ring < rings; ++ring)
+	{
+		for (int segment = 0; segment < segments; ++segment)
+		{
+			mesh->AddVertex(vertex(PI * ring / rings, 2.0f * PI * segment / segments));
+		}
+	}
+	mesh->AddVertex(Vec3(0.0f, -1.0f, 0.0f));
+
+	for (int segment = 0; segment < segments; ++segment)
+	{
+		mesh->AddTriangle(top, ringVertex(1, segment + 1), ringVertex(1, segment));
+		mesh->AddTriangle(bottom, ringVertex(rings - 1, segment), ringVertex(rings - 1, segment + 1));
+
+		for (int ring = 1; ring < rings - 1; ++ring)
+		{
+			int upper = ringVertex(ring, segment);
+			int upperNext = ringVertex(ring, segment + 1);
+			int lower = ringVertex(ring + 1, segment);
+			int lowerNext = ringVertex(ring + 1, segment + 1);
+			mesh->AddTriangle(upper, upperNext, lower);
+			mesh->AddTriangle(upperNext, lowerNext, lower);
+		}
+	}
+}
+
+std::unique_ptr<HitableList> GenerateScene(const SceneParameters& parameters, MaterialStorage* matStorage,
+										   MeshStorage* meshStorage, OUT SceneStatistics* statistics)
+{
+	Pcg32 rng(parameters.seed, 0x5ce9e);
+	Placer placer(rng, parameters);
+	auto worldPtr = std::make_unique<HitableList>();
+
+	std::vector<AMaterial*> palette;
+	int materialCount = std::min(std::max(1, parameters.materialCount), MAX_MATERIAL_COUNT);
+	for (int i = 0; i < materialCount; ++i)
+	{
+		std::string name = "generated_" + std::to_string(i);
+		Vec3 albedo(0.2f + 0.8f * rng.NextFloat(), 0.2f + 0.8f * rng.NextFloat(), 0.2f + 0.8f * rng.NextFloat());
+		bool isDiffuse = rng.NextFloat() < 0.7f;
+		matStorage->CreateMaterial(name, isDiffuse, albedo, 0.5f + 0.4f * rng.NextFloat());
+		palette.push_back(matStorage->Get(name));
+	}
+
+	auto randomMaterial = [&]() { return palette[rng.NextUInt() % palette.size()]; };
+
+	for (int i = 0; i < parameters.sphereCount; ++i)
+	{
+		Vec3 center = placer.Next();
+		worldPtr->AddSphere(center, parameters.objectSize * (0.2f + 0.8f * rng.NextFloat()), randomMaterial());
+	}
+
+	double buildSeconds = 0.0;
+	int64_t uniqueTriangleCount = 0;
+	std::vector<Mesh*> meshes;
+	for (int i = 0; i < parameters.meshCount; ++i)
+	{
+		Mesh* mesh = meshStorage->Create("generated_blob_" + std::to_string(i));
+		TessellateBlob(mesh, parameters.meshTriangleCount, 0.1f + 0.2f * rng.NextFloat(), 2.0f + 6.0f * rng.NextFloat());
+		uniqueTriangleCount += mesh->TriangleCount();
+
+		auto start = std::chrono::steady_clock::now();
+		mesh->Finalize();
+		buildSeconds += SecondsSince(start);
+		meshes.push_back(mesh);
+	}
+
+	int64_t instancedTriangleCount = 0;
+	for (int i = 0; i < parameters.instanceCount && !meshes.empty(); ++i)
+	{
+		Mesh* mesh = meshes[i % meshes.size()];
+		float scale = parameters.objectSize * (0.5f + 0.5f * rng.NextFloat());
+		Vec3 position = placer.Next();
+		Transform localToWorld = Transform::Translation(position) *
+								 Transform::RotationY(2.0f * PI * rng.NextFloat()) *
+								 Transform::RotationX(2.0f * PI * rng.NextFloat()) *
+								 Transform::Scale(Vec3(scale, scale, scale));
+		worldPtr->AddInstance(mesh, randomMaterial(), localToWorld);
+		instancedTriangleCount += mesh->TriangleCount();
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	worldPtr->BuildAccelerationStructure();
+	buildSeconds += SecondsSince(start);
+
+	if (statistics != nullptr)
+	{
+		statistics->sphereCount = worldPtr->Spheres().Count();
+		statistics->instanceCount = worldPtr->InstanceCount();
+		statistics->uniqueTriangleCount = uniqueTriangleCount;
+		statistics->instancedTriangleCount = instancedTriangleCount;
+		statistics->buildSeconds = buildSeconds;
+		statistics->memoryFootprint = worldPtr->MemoryFootprint();
+	}
+
+	return worldPtr;
+}
+
+std::string DescribeScene(const SceneStatistics& statistics)
+{
+	std::ostringstream description;
+	description << statistics.sphereCount << " spheres, " << statistics.instanceCount << " mesh instances ("
+				<< statistics.uniqueTriangleCount << " unique triangles, " << statistics.instancedTriangleCount
+				<< " placed); built in " << statistics.buildSeconds * 1000.0 << " ms; "
+				<< statistics.memoryFootprint / (1024.0 * 1024.0) << " MB";
+	return description.str();
+}
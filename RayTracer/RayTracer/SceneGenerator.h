@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "Hitable.h"
+#include "Material.h"
+#include "Mesh.h"
+
+const uint64_t DEFAULT_SCENE_SEED = 1;
+
+// Parameters for GenerateScene(), a seedable stand-in for large production
+// scenes: random spheres, plus meshCount tessellated meshes of about
+// meshTriangleCount triangles each, placed instanceCount times in total
+// with random rotations and scales. Everything goes into the part of the
+// default camera's view between z = 2 and z = 2 + depth, uniformly, or in
+// clusterCount gaussian clumps if that isn't 0.
+struct SceneParameters
+{
+	bool isGenerated = false;	// false: the hand made demo scene (MakeWorld)
+	uint64_t seed = DEFAULT_SCENE_SEED;
+	int sphereCount = 1000;
+	int meshCount = 4;
+	int meshTriangleCount = 5000;
+	int instanceCount = 100;
+	int materialCount = 16;
+	int clusterCount = 0;
+	float depth = 20.0f;
+	float objectSize = 0.3f;	// the largest sphere radius / mesh instance scale
+};
+
+struct SceneStatistics
+{
+	int sphereCount;
+	int instanceCount;
+	int64_t uniqueTriangleCount;		// in the meshes, each counted once
+	int64_t instancedTriangleCount;		// as placed in the scene
+	double buildSeconds;				// mesh BVHs and the scene's BVHs
+	size_t memoryFootprint;				// HitableList::MemoryFootprint()
+};
+
+std::unique_ptr<HitableList> GenerateScene(const SceneParameters& parameters, MaterialStorage* matStorage,
+										   MeshStorage* meshStorage, OUT SceneStatistics* statistics = nullptr);
+
+// A closed, bumpy sphere of radius ~1 around the origin, with about
+// triangleCount outward facing triangles
+void TessellateBlob(Mesh* mesh, int triangleCount, float bumpiness, float bumpFrequency);
+
+std::string DescribeScene(const SceneStatistics& statistics);
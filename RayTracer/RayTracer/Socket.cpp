@@ -0,0 +1,322 @@
+#include "pch.h"
+#include "Socket.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+
+typedef int SocketLength;
+typedef SOCKET NativeHandle;
+
+namespace
+{
+	// Winsock has to be started before the first call
+	struct WinsockSession
+	{
+		WinsockSession() { WSADATA data; WSAStartup(MAKEWORD(2, 2), &data); }
+		~WinsockSession() { WSACleanup(); }
+	};
+
+	void StartSockets() { static WinsockSession session; }
+	void CloseNative(NativeHandle handle) { closesocket(handle); }
+	int Poll(pollfd* fds, size_t count, int timeout) { return WSAPoll(fds, (ULONG)count, timeout); }
+
+	// Winsock has no SIGPIPE
+	const int SEND_FLAGS = 0;
+	void SuppressSigPipe(NativeHandle) {}
+
+	bool IsWouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+
+	bool SetNativeNonBlocking(NativeHandle handle)
+	{
+		u_long isNonBlocking = 1;
+		return ioctlsocket(handle, FIONBIO, &isNonBlocking) == 0;
+	}
+}
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+typedef socklen_t SocketLength;
+typedef int NativeHandle;
+
+namespace
+{
+	void CloseNative(NativeHandle handle) { close(handle); }
+	int Poll(pollfd* fds, size_t count, int timeout) { return poll(fds, (nfds_t)count, timeout); }
+
+	// A write to a closed connection fails instead of raising SIGPIPE:
+	// per send on Linux, per socket on macOS and the BSDs, and anywhere
+	// else by ignoring the signal altogether
+#ifdef MSG_NOSIGNAL
+	const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+	const int SEND_FLAGS = 0;
+#endif
+
+	void StartSockets()
+	{
+#if !defined(MSG_NOSIGNAL) && !defined(SO_NOSIGPIPE)
+		static bool isSigPipeIgnored = (signal(SIGPIPE, SIG_IGN), true);
+		(void)isSigPipeIgnored;
+#endif
+	}
+
+	void SuppressSigPipe(NativeHandle handle)
+	{
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+		int isSet = 1;
+		setsockopt(handle, SOL_SOCKET, SO_NOSIGPIPE, &isSet, sizeof(isSet));
+#else
+		(void)handle;
+#endif
+	}
+
+	bool IsWouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+
+	bool SetNativeNonBlocking(NativeHandle handle)
+	{
+		int flags = fcntl(handle, F_GETFL, 0);
+		return flags != -1 && fcntl(handle, F_SETFL, flags | O_NONBLOCK) == 0;
+	}
+}
+#endif
+
+namespace
+{
+	inline NativeHandle Native(uintptr_t handle) { return (NativeHandle)handle; }
+
+	// Tiles are small messages, and the other side waits for each; don't
+	// hold them back to batch them up (Nagle's algorithm). And see
+	// SEND_FLAGS.
+	void SetUpConnection(uintptr_t handle)
+	{
+		int isEnabled = 1;
+		setsockopt(Native(handle), IPPROTO_TCP, TCP_NODELAY, (const char*)&isEnabled, sizeof(isEnabled));
+		SuppressSigPipe(Native(handle));
+	}
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		handle = other.handle;
+		other.handle = INVALID_HANDLE;
+	}
+
+	return *this;
+}
+
+Socket Socket::Listen(int port, bool isPublic)
+{
+	StartSockets();
+
+	Socket socket((uintptr_t)::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (!socket.IsValid())
+	{
+		return Socket();
+	}
+
+	int reuse = 1;
+	setsockopt(Native(socket.handle), SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(isPublic ? INADDR_ANY : INADDR_LOOPBACK);
+	address.sin_port = htons((uint16_t)port);
+
+	if (bind(Native(socket.handle), (const sockaddr*)&address, sizeof(address)) != 0 || listen(Native(socket.handle), SOMAXCONN) != 0)
+	{
+		return Socket();
+	}
+
+	return socket;
+}
+
+Socket Socket::Connect(const std::string& host, int port)
+{
+	StartSockets();
+
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* addresses = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+	{
+		return Socket();
+	}
+
+	Socket socket;
+	for (addrinfo* address = addresses; address != nullptr; address = address->ai_next)
+	{
+		socket = Socket((uintptr_t)::socket(address->ai_family, address->ai_socktype, address->ai_protocol));
+		if (socket.IsValid() && connect(Native(socket.handle), address->ai_addr, (SocketLength)address->ai_addrlen) == 0)
+		{
+			SetUpConnection(socket.handle);
+			break;
+		}
+
+		socket.Close();
+	}
+
+	freeaddrinfo(addresses);
+	return socket;
+}
+
+Socket Socket::Accept() const
+{
+	Socket connection((uintptr_t)accept(Native(handle), nullptr, nullptr));
+	if (connection.IsValid())
+	{
+		SetUpConnection(connection.handle);
+	}
+
+	return connection;
+}
+
+int Socket::LocalPort() const
+{
+	sockaddr_in address;
+	SocketLength length = sizeof(address);
+	if (getsockname(Native(handle), (sockaddr*)&address, &length) != 0)
+	{
+		return -1;
+	}
+
+	return ntohs(address.sin_port);
+}
+
+bool Socket::SendAll(const void* data, size_t size) const
+{
+	const char* bytes = (const char*)data;
+	while (size > 0)
+	{
+		int chunk = (int)(size < (1u << 30) ? size : (1u << 30));
+		int sent = (int)send(Native(handle), bytes, chunk, SEND_FLAGS);
+		if (sent <= 0)
+		{
+			return false;
+		}
+
+		bytes += sent;
+		size -= sent;
+	}
+
+	return true;
+}
+
+bool Socket::ReceiveAll(void* data, size_t size) const
+{
+	char* bytes = (char*)data;
+	while (size > 0)
+	{
+		int chunk = (int)(size < (1u << 30) ? size : (1u << 30));
+		int received = (int)recv(Native(handle), bytes, chunk, 0);
+		if (received <= 0)
+		{
+			return false;
+		}
+
+		bytes += received;
+		size -= received;
+	}
+
+	return true;
+}
+
+int Socket::Receive(void* data, size_t size) const
+{
+	int chunk = (int)(size < (1u << 30) ? size : (1u << 30));
+	int received = (int)recv(Native(handle), (char*)data, chunk, 0);
+	return received < 0 ? -1 : received;
+}
+
+int Socket::Send(const void* data, size_t size) const
+{
+	int chunk = (int)(size < (1u << 30) ? size : (1u << 30));
+	int sent = (int)send(Native(handle), (const char*)data, chunk, SEND_FLAGS);
+	if (sent < 0)
+	{
+		return IsWouldBlock() ? 0 : -1;
+	}
+
+	return sent;
+}
+
+bool Socket::SetNonBlocking() const
+{
+	return SetNativeNonBlocking(Native(handle));
+}
+
+bool Socket::SetReceiveTimeout(int timeoutMilliseconds) const
+{
+#ifdef _WIN32
+	DWORD timeout = (DWORD)timeoutMilliseconds;
+#else
+	timeval timeout;
+	timeout.tv_sec = timeoutMilliseconds / 1000;
+	timeout.tv_usec = timeoutMilliseconds % 1000 * 1000;
+#endif
+	return setsockopt(Native(handle), SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout)) == 0;
+}
+
+void Socket::Close()
+{
+	if (IsValid())
+	{
+		CloseNative(Native(handle));
+		handle = INVALID_HANDLE;
+	}
+}
+
+int Socket::WaitReadable(const std::vector<const Socket*>& sockets, int timeoutMilliseconds,
+						 std::vector<bool>& isReadable)
+{
+	std::vector<bool> isWritable;
+	return WaitReady(sockets, std::vector<bool>(sockets.size(), false), timeoutMilliseconds, isReadable, isWritable);
+}
+
+int Socket::WaitReady(const std::vector<const Socket*>& sockets, const std::vector<bool>& wantsToWrite,
+					  int timeoutMilliseconds, std::vector<bool>& isReadable, std::vector<bool>& isWritable)
+{
+	std::vector<pollfd> fds(sockets.size());
+	for (size_t i = 0; i < sockets.size(); ++i)
+	{
+		fds[i].fd = Native(sockets[i]->handle);
+		fds[i].events = POLLIN | (wantsToWrite[i] ? POLLOUT : 0);
+		fds[i].revents = 0;
+	}
+
+	isReadable.assign(sockets.size(), false);
+	isWritable.assign(sockets.size(), false);
+	if (Poll(fds.data(), fds.size(), timeoutMilliseconds) <= 0)
+	{
+		return 0;
+	}
+
+	int readyCount = 0;
+	for (size_t i = 0; i < sockets.size(); ++i)
+	{
+		isReadable[i] = (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+		isWritable[i] = wantsToWrite[i] && (fds[i].revents & (POLLOUT | POLLHUP | POLLERR)) != 0;
+		readyCount += isReadable[i] || isWritable[i] ? 1 : 0;
+	}
+
+	return readyCount;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A TCP socket, wrapping Winsock or BSD sockets; blocking unless made
+// otherwise with SetNonBlocking(). Move only; the destructor closes it.
+// The calls report failure (a closed connection, an unreachable host, ...)
+// by returning false or an invalid Socket, never by throwing; the
+// connection is not usable after a failed send or receive.
+
+class Socket
+{
+public:
+	Socket() = default;
+	~Socket() { Close(); }
+
+	Socket(Socket&& other) noexcept : handle{ other.handle } { other.handle = INVALID_HANDLE; }
+	Socket& operator=(Socket&& other) noexcept;
+
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+
+	// Listens on "port" (0: any free one, see LocalPort()), on the loopback
+	// interface only unless isPublic is set
+	static Socket Listen(int port, bool isPublic);
+	static Socket Connect(const std::string& host, int port);
+
+	// Blocks until someone connects
+	Socket Accept() const;
+
+	bool IsValid() const { return handle != INVALID_HANDLE; }
+	int LocalPort() const;
+
+	bool SendAll(const void* data, size_t size) const;
+	bool ReceiveAll(void* data, size_t size) const;
+
+	// Whatever has arrived, up to "size" bytes (blocking until something
+	// has); returns how many, 0 once the other side has closed the
+	// connection, or -1 - also for a non-blocking socket with nothing yet
+	int Receive(void* data, size_t size) const;
+
+	// For a non-blocking socket: sends as much of "data" as goes out right
+	// away, and returns how many bytes that was (0: none, for now) or -1
+	int Send(const void* data, size_t size) const;
+
+	// Sends and receives return at once from now on, instead of waiting
+	bool SetNonBlocking() const;
+
+	// From now on a receive that gets nothing for timeoutMilliseconds
+	// fails (0: waits for ever, as at first)
+	bool SetReceiveTimeout(int timeoutMilliseconds) const;
+
+	void Close();
+
+	// Waits up to timeoutMilliseconds (-1: for ever) until any of the
+	// sockets can be read from without blocking - or Accept()ed from, for
+	// a listening one; a closed connection counts as readable. Sets
+	// isReadable[i] for each, and returns how many are.
+	static int WaitReadable(const std::vector<const Socket*>& sockets, int timeoutMilliseconds,
+							std::vector<bool>& isReadable);
+
+	// The same, and also until those with wantsToWrite[i] set can be sent
+	// to without blocking; sets isWritable[i] for those, a failed
+	// connection counting as writable. Returns how many are either.
+	static int WaitReady(const std::vector<const Socket*>& sockets, const std::vector<bool>& wantsToWrite,
+						 int timeoutMilliseconds, std::vector<bool>& isReadable, std::vector<bool>& isWritable);
+
+private:
+	static const uintptr_t INVALID_HANDLE = ~(uintptr_t)0;
+
+	explicit Socket(uintptr_t handle) : handle{ handle } {}
+
+	uintptr_t handle = INVALID_HANDLE;		// a SOCKET, or a file descriptor
+};
@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "PrimitiveStore.h"
+#include "RenderStats.h"
+
+// IntersectSphere() (Intersection.h), SIMD_WIDTH spheres at a time: the
+// same quadratic, with the same operations in the same order, so each lane
+// rounds exactly like the scalar test does. The branches become masks, and
+// the square root and divisions are only paid for when some lane has a
+// positive discriminant.
+
+int SphereStore::IntersectRange(int first, int count, const Ray& ray, bool ignoreBackFaces, float& tMax) const
+{
+	const SimdFloat zero = SimdFloat::Splat(0.0f);
+	const SimdFloat two = SimdFloat::Splat(2.0f);
+	const SimdFloat four = SimdFloat::Splat(4.0f);
+	const SimdFloat minDistance = SimdFloat::Splat(SPHERE_MIN_DISTANCE);
+	const SimdFloat laneIndices = SimdFloat::LaneIndices();
+	RT_STAT_ADD(sphereTests, count);
+
+	const Vec3& direction = ray.Direction();
+	const SimdVec3 rayOrigin = SimdVec3::Splat(ray.Origin().x(), ray.Origin().y(), ray.Origin().z());
+	const SimdVec3 rayDirection = SimdVec3::Splat(direction.x(), direction.y(), direction.z());
+	const SimdFloat a = SimdFloat::Splat(direction.SqrMagnitude());
+	const SimdFloat twoA = a * two;
+
+	int closest = -1;
+
+	for (int base = first; base < first + count; base += SIMD_WIDTH)
+	{
+		SimdMask active = laneIndices < SimdFloat::Splat((float)(first + count - base));
+
+		SimdFloat radius = SimdFloat::Load(&radii[base]);
+		SimdFloat squaredRadius = radius * radius;
+		SimdVec3 fromOriginToRayStart = rayOrigin - SimdVec3::Load(&originX[base], &originY[base], &originZ[base]);
+		SimdFloat distanceSquared = fromOriginToRayStart.SqrMagnitude();
+
+		if (ignoreBackFaces)
+		{
+			active = AndNot(active, distanceSquared <= squaredRadius);
+		}
+
+		SimdFloat b = two * rayDirection.Dot(fromOriginToRayStart);
+		SimdFloat c = distanceSquared - squaredRadius;
+		SimdFloat d = b * b - four * a * c;
+		active = active & (d > zero);
+
+		if (!active.Any())
+		{
+			continue;
+		}
+
+		SimdFloat root = Sqrt(d);
+		SimdFloat minusB = zero - b;
+		SimdFloat t0 = (minusB + root) / twoA;
+		SimdFloat t1 = (minusB - root) / twoA;
+		SimdMask isT0Nearer = t0 < t1;
+		SimdMask areBothAhead = (t0 > zero) & (t1 > zero);
+		SimdFloat t = Select(areBothAhead, Select(isT0Nearer, t0, t1), Select(isT0Nearer, t1, t0));
+
+		active = active & (t > minDistance) & (t < SimdFloat::Splat(tMax));
+
+		if (!active.Any())
+		{
+			continue;
+		}
+
+		float distances[SIMD_WIDTH];
+		t.Store(distances);
+		int hitLanes = active.Bits();
+
+		for (int lane = 0; lane < SIMD_WIDTH; ++lane)
+		{
+			if ((hitLanes & (1 << lane)) && distances[lane] < tMax)
+			{
+				tMax = distances[lane];
+				closest = base + lane;
+				RT_STAT_ADD(sphereHits, 1);
+			}
+		}
+	}
+
+	return closest;
+}
+
+int SphereStore::IntersectRangeScalar(int first, int count, const Ray& ray, bool ignoreBackFaces, float& tMax) const
+{
+	int closest = -1;
+
+	for (int i = first; i < first + count; ++i)
+	{
+		float t;
+		if (Intersect(i, ray, ignoreBackFaces, t) && t < tMax)
+		{
+			tMax = t;
+			closest = i;
+		}
+	}
+
+	return closest;
+}
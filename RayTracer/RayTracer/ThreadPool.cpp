@@ -0,0 +1,150 @@
+#include "pch.h"
+#include "ThreadPool.h"
+#include <string>
+#include "Trace.h"
+
+namespace
+{
+	thread_local const ThreadPool* currentPool = nullptr;
+	thread_local int currentWorkerIndex = -1;
+}
+
+int ThreadPool::DefaultThreadCount()
+{
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	return hardwareThreads > 0 ? (int)hardwareThreads : 1;
+}
+
+ThreadPool::ThreadPool(int threadCount) :
+	queuedTaskCount{ 0 },
+	unfinishedTaskCount{ 0 },
+	nextQueue{ 0 },
+	isShuttingDown{ false }
+{
+	if (threadCount < 1)
+	{
+		threadCount = 1;
+	}
+
+	for (int i = 0; i < threadCount; ++i)
+	{
+		queues.push_back(std::make_unique<WorkQueue>());
+	}
+
+	for (int i = 0; i < threadCount; ++i)
+	{
+		workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		isShuttingDown = true;
+	}
+
+	wakeCondition.notify_all();
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::Submit(Task task)
+{
+	int queueIndex = currentPool == this ? currentWorkerIndex
+										 : (int)(nextQueue++ % (unsigned int)queues.size());
+
+	unfinishedTaskCount++;
+
+	{
+		std::lock_guard<std::mutex> lock(queues[queueIndex]->mutex);
+		queues[queueIndex]->tasks.push_back(std::move(task));
+	}
+
+	{
+		// Taking the lock here makes sure that a worker which has just
+		// found every queue empty can't miss the wake-up call.
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		queuedTaskCount++;
+	}
+
+	wakeCondition.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(wakeMutex);
+	doneCondition.wait(lock, [this] { return unfinishedTaskCount == 0; });
+}
+
+bool ThreadPool::TryPopOwn(int workerIndex, Task& task)
+{
+	auto& queue = *queues[workerIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	if (queue.tasks.empty())
+	{
+		return false;
+	}
+
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	return true;
+}
+
+bool ThreadPool::TrySteal(int thiefIndex, Task& task)
+{
+	int queueCount = (int)queues.size();
+
+	for (int offset = 1; offset < queueCount; ++offset)
+	{
+		auto& queue = *queues[(thiefIndex + offset) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::WorkerLoop(int workerIndex)
+{
+	currentPool = this;
+	currentWorkerIndex = workerIndex;
+	Trace::SetThreadName("worker " + std::to_string(workerIndex));
+
+	while (true)
+	{
+		Task task;
+
+		if (TryPopOwn(workerIndex, task) || TrySteal(workerIndex, task))
+		{
+			queuedTaskCount--;
+			task();
+
+			if (--unfinishedTaskCount == 0)
+			{
+				std::lock_guard<std::mutex> lock(wakeMutex);
+				doneCondition.notify_all();
+			}
+
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		wakeCondition.wait(lock, [this] { return isShuttingDown || queuedTaskCount > 0; });
+
+		if (isShuttingDown && queuedTaskCount == 0)
+		{
+			return;
+		}
+	}
+}
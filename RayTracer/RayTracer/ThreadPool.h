@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing thread pool. Every worker owns a deque of tasks;
+// it pops work from the back of its own deque (most recently pushed, so
+// probably still warm in cache), and when that runs dry, it steals from
+// the front of the other workers' deques. Tasks submitted from outside
+// the pool are dealt round-robin; tasks submitted from inside a worker
+// go to that worker's own deque.
+
+class ThreadPool
+{
+public:
+	using Task = std::function<void()>;
+
+	static int DefaultThreadCount();
+
+	explicit ThreadPool(int threadCount);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int ThreadCount() const { return (int)workers.size(); }
+
+	void Submit(Task task);
+
+	// Blocks until every task submitted so far has finished.
+	void Wait();
+
+private:
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void WorkerLoop(int workerIndex);
+	bool TryPopOwn(int workerIndex, Task& task);
+	bool TrySteal(int thiefIndex, Task& task);
+
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::thread> workers;
+
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+
+	std::atomic<int> queuedTaskCount;
+	std::atomic<int> unfinishedTaskCount;
+	std::atomic<unsigned int> nextQueue;
+	bool isShuttingDown;
+};
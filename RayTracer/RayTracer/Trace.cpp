@@ -0,0 +1,220 @@
+#include "pch.h"
+#include "Trace.h"
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	// One per thread that has recorded anything. Once the thread exits,
+	// the buffer is retired: "events" shrinks to just the spans that were
+	// recorded, oldest first, so that they still make it into the trace
+	// without holding on to a whole ring per thread that ever ran.
+	struct TraceBuffer
+	{
+		std::string threadName;
+		std::vector<TraceEvent> events;
+		std::atomic<uint64_t> recordedCount{ 0 };
+		bool isRetired = false;
+	};
+
+	std::mutex registryMutex;
+	std::vector<std::unique_ptr<TraceBuffer>> buffers;
+	int namedThreadCount = 0;
+
+	int64_t SteadyNanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Nanoseconds on the steady clock; Enable() moves it while other
+	// threads may be asking for the time
+	std::atomic<int64_t> epoch{ SteadyNanoseconds() };
+
+	void Retire(TraceBuffer* buffer)
+	{
+		uint64_t count = buffer->recordedCount.load(std::memory_order_relaxed);
+		uint64_t first = count > (uint64_t)TRACE_BUFFER_SIZE ? count - TRACE_BUFFER_SIZE : 0;
+
+		std::vector<TraceEvent> spans;
+		spans.reserve((size_t)(count - first));
+		for (uint64_t i = first; i < count; ++i)
+		{
+			spans.push_back(buffer->events[i & (TRACE_BUFFER_SIZE - 1)]);
+		}
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		buffer->events.swap(spans);
+		buffer->isRetired = true;
+	}
+
+	// Retires the thread's buffer as the thread exits
+	struct ThreadBuffer
+	{
+		TraceBuffer* buffer = nullptr;
+
+		~ThreadBuffer()
+		{
+			if (buffer != nullptr)
+			{
+				Retire(buffer);
+			}
+		}
+	};
+
+	thread_local ThreadBuffer threadBuffer;
+	thread_local std::string threadName;
+
+	TraceBuffer* GetThreadBuffer()
+	{
+		if (threadBuffer.buffer == nullptr)
+		{
+			auto buffer = std::make_unique<TraceBuffer>();
+			buffer->events.resize(TRACE_BUFFER_SIZE);
+
+			std::lock_guard<std::mutex> lock(registryMutex);
+			buffer->threadName = threadName.empty() ? "thread " + std::to_string(namedThreadCount) : threadName;
+			namedThreadCount++;
+			threadBuffer.buffer = buffer.get();
+			buffers.push_back(std::move(buffer));
+		}
+
+		return threadBuffer.buffer;
+	}
+
+	std::string EscapeJson(const std::string& text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				escaped += '\\';
+			}
+
+			escaped += c;
+		}
+
+		return escaped;
+	}
+
+	// Trace-event timestamps are in microseconds. A span that started
+	// before the latest Enable() has a negative start.
+	void WriteMicroseconds(std::ostream& stream, int64_t nanoseconds)
+	{
+		uint64_t magnitude = nanoseconds < 0 ? 0 - (uint64_t)nanoseconds : (uint64_t)nanoseconds;
+		stream << (nanoseconds < 0 ? "-" : "") << magnitude / 1000 << "." << (char)('0' + magnitude / 100 % 10)
+			   << (char)('0' + magnitude / 10 % 10) << (char)('0' + magnitude % 10);
+	}
+}
+
+namespace Trace
+{
+	std::atomic<bool> isEnabled{ false };
+
+	void Enable()
+	{
+		{
+			// The spans of exited threads are all from before, so their
+			// buffers go
+			std::lock_guard<std::mutex> lock(registryMutex);
+			buffers.erase(std::remove_if(buffers.begin(), buffers.end(),
+										 [](const std::unique_ptr<TraceBuffer>& buffer) { return buffer->isRetired; }),
+						  buffers.end());
+			for (auto& buffer : buffers)
+			{
+				buffer->recordedCount.store(0, std::memory_order_relaxed);
+			}
+
+			epoch.store(SteadyNanoseconds(), std::memory_order_relaxed);
+		}
+
+		isEnabled.store(true);
+	}
+
+	void Disable()
+	{
+		isEnabled.store(false);
+	}
+
+	void SetThreadName(const std::string& name)
+	{
+		threadName = name;
+
+		if (threadBuffer.buffer != nullptr)
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			threadBuffer.buffer->threadName = name;
+		}
+	}
+
+	int64_t Now()
+	{
+		return SteadyNanoseconds() - epoch.load(std::memory_order_relaxed);
+	}
+
+	// Only the owning thread writes to its buffer; the release store
+	// publishes the event to whoever reads recordedCount afterwards
+	void Record(const TraceEvent& event)
+	{
+		TraceBuffer* buffer = GetThreadBuffer();
+		uint64_t count = buffer->recordedCount.load(std::memory_order_relaxed);
+		buffer->events[count & (TRACE_BUFFER_SIZE - 1)] = event;
+		buffer->recordedCount.store(count + 1, std::memory_order_release);
+	}
+
+	void WriteChromeTrace(std::ostream& stream)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+
+		stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+		const char* separator = "\n";
+
+		for (size_t thread = 0; thread < buffers.size(); ++thread)
+		{
+			const TraceBuffer& buffer = *buffers[thread];
+			stream << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread
+				   << ", \"args\": {\"name\": \"" << EscapeJson(buffer.threadName) << "\"}}";
+			separator = ",\n";
+
+			// If the buffer wrapped around, the oldest spans are gone; a
+			// retired buffer has just the rest, in order
+			uint64_t count = buffer.isRetired ? buffer.events.size() : buffer.recordedCount.load(std::memory_order_acquire);
+			uint64_t first = count > (uint64_t)TRACE_BUFFER_SIZE ? count - TRACE_BUFFER_SIZE : 0;
+
+			for (uint64_t i = first; i < count; ++i)
+			{
+				const TraceEvent& event = buffer.events[buffer.isRetired ? i : i & (TRACE_BUFFER_SIZE - 1)];
+				stream << separator << "{\"name\": \"" << EscapeJson(event.name) << "\", \"cat\": \"" << EscapeJson(event.category)
+					   << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread << ", \"ts\": ";
+				WriteMicroseconds(stream, event.startNanoseconds);
+				stream << ", \"dur\": ";
+				WriteMicroseconds(stream, event.durationNanoseconds);
+
+				if (event.argCount > 0)
+				{
+					stream << ", \"args\": {";
+					for (int arg = 0; arg < event.argCount; ++arg)
+					{
+						stream << (arg > 0 ? ", " : "") << "\"" << EscapeJson(event.argNames[arg]) << "\": " << event.argValues[arg];
+					}
+
+					stream << "}";
+				}
+
+				stream << "}";
+			}
+		}
+
+		stream << "\n]}\n";
+	}
+
+	bool WriteChromeTrace(const std::string& path)
+	{
+		std::ofstream stream(path);
+		WriteChromeTrace(stream);
+		return (bool)stream;
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// A timeline of what every thread was doing, for finding load imbalance,
+// idle workers and serial phases: e.g.
+//
+//	{
+//		TraceScope scope("tile", "render");
+//		scope.AddArg("x", tile.x);
+//		...
+//	}
+//
+// records one span from construction to destruction, on the steady clock.
+// Spans go into a fixed size ring buffer per thread that only that thread
+// writes to, so recording takes no locks; when a buffer is full, the
+// oldest spans are overwritten. When a thread exits, its ring is given
+// back and only the spans in it are kept, until the next Enable().
+// WriteChromeTrace() dumps everything as Chrome trace-event JSON, for
+// chrome://tracing or ui.perfetto.dev.
+//
+// Nothing is recorded until Trace::Enable(); while disabled, a TraceScope
+// costs a single load of a flag.
+
+const int TRACE_MAX_ARGS = 4;
+const int TRACE_BUFFER_SIZE = 1 << 14;		// spans per thread; a power of two
+
+// Names are not copied, so they must be string literals or otherwise
+// outlive the trace
+struct TraceEvent
+{
+	const char* name;
+	const char* category;
+	int64_t startNanoseconds;		// since Trace::Enable()
+	int64_t durationNanoseconds;
+	const char* argNames[TRACE_MAX_ARGS];
+	int64_t argValues[TRACE_MAX_ARGS];
+	int argCount;
+};
+
+namespace Trace
+{
+	extern std::atomic<bool> isEnabled;
+
+	inline bool IsEnabled() { return isEnabled.load(std::memory_order_acquire); }
+
+	// Starts recording (again), dropping whatever was recorded before
+	void Enable();
+	void Disable();
+
+	// Shown as the thread's name in the trace viewer; "thread <n>" if unset
+	void SetThreadName(const std::string& name);
+
+	int64_t Now();
+	void Record(const TraceEvent& event);
+
+	// Only safe while no other thread is recording, e.g. after
+	// ThreadPool::Wait()
+	void WriteChromeTrace(std::ostream& stream);
+	bool WriteChromeTrace(const std::string& path);
+}
+
+class TraceScope
+{
+public:
+	TraceScope(const char* name, const char* category) : isRecording{ Trace::IsEnabled() }
+	{
+		if (isRecording)
+		{
+			event.name = name;
+			event.category = category;
+			event.argCount = 0;
+			event.startNanoseconds = Trace::Now();
+		}
+	}
+
+	~TraceScope()
+	{
+		if (isRecording)
+		{
+			event.durationNanoseconds = Trace::Now() - event.startNanoseconds;
+			Trace::Record(event);
+		}
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+	// Extra information shown with the span, e.g. the tile's position
+	void AddArg(const char* name, int64_t value)
+	{
+		if (isRecording && event.argCount < TRACE_MAX_ARGS)
+		{
+			event.argNames[event.argCount] = name;
+			event.argValues[event.argCount] = value;
+			event.argCount++;
+		}
+	}
+
+private:
+	bool isRecording;
+	TraceEvent event;
+};
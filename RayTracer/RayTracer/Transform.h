@@ -0,0 +1,194 @@
+#pragma once
+#include <cmath>
+#include "AABB.h"
+
+// Affine transform: a 3x4 matrix - rotation, scale and shear in the left
+// 3x3 block, translation in the last column - kept together with its
+// inverse, so points, vectors and normals can be taken either way without
+// inverting anything at render time.
+
+class Transform
+{
+public:
+	Transform() : matrix{ Matrix::Identity() }, inverse{ Matrix::Identity() } {}
+
+	// Row major; the inverse is computed here, so the matrix must not be
+	// singular.
+	explicit Transform(const float rows[3][4]) : matrix{ rows }, inverse{ Matrix(rows).Inverted() } {}
+
+	static Transform Translation(const Vec3& offset)
+	{
+		const float m[3][4] = { { 1, 0, 0, offset.x() }, { 0, 1, 0, offset.y() }, { 0, 0, 1, offset.z() } };
+		const float inv[3][4] = { { 1, 0, 0, -offset.x() }, { 0, 1, 0, -offset.y() }, { 0, 0, 1, -offset.z() } };
+		return Transform(Matrix(m), Matrix(inv));
+	}
+
+	static Transform Scale(const Vec3& scale)
+	{
+		const float m[3][4] = { { scale.x(), 0, 0, 0 }, { 0, scale.y(), 0, 0 }, { 0, 0, scale.z(), 0 } };
+		const float inv[3][4] = { { 1.0f / scale.x(), 0, 0, 0 }, { 0, 1.0f / scale.y(), 0, 0 }, { 0, 0, 1.0f / scale.z(), 0 } };
+		return Transform(Matrix(m), Matrix(inv));
+	}
+
+	// Rotations take radians; the inverse of a rotation is its transpose
+	static Transform RotationX(float angle)
+	{
+		float s = sinf(angle), c = cosf(angle);
+		const float m[3][4] = { { 1, 0, 0, 0 }, { 0, c, -s, 0 }, { 0, s, c, 0 } };
+		return Transform(Matrix(m), Matrix(m).Transposed());
+	}
+
+	static Transform RotationY(float angle)
+	{
+		float s = sinf(angle), c = cosf(angle);
+		const float m[3][4] = { { c, 0, s, 0 }, { 0, 1, 0, 0 }, { -s, 0, c, 0 } };
+		return Transform(Matrix(m), Matrix(m).Transposed());
+	}
+
+	static Transform RotationZ(float angle)
+	{
+		float s = sinf(angle), c = cosf(angle);
+		const float m[3][4] = { { c, -s, 0, 0 }, { s, c, 0, 0 }, { 0, 0, 1, 0 } };
+		return Transform(Matrix(m), Matrix(m).Transposed());
+	}
+
+	// (a * b) applies b first, then a
+	Transform operator*(const Transform& other) const
+	{
+		return Transform(matrix * other.matrix, other.inverse * inverse);
+	}
+
+	Transform Inverse() const { return Transform(inverse, matrix); }
+
+	inline Vec3 TransformPoint(const Vec3& p) const { return matrix.Point(p); }
+	inline Vec3 TransformVector(const Vec3& v) const { return matrix.Vector(v); }
+	inline Vec3 InverseTransformPoint(const Vec3& p) const { return inverse.Point(p); }
+	inline Vec3 InverseTransformVector(const Vec3& v) const { return inverse.Vector(v); }
+
+	// Normals go by the inverse transpose, so that they stay perpendicular
+	// to the surface under non-uniform scaling. The result isn't normalized.
+	inline Vec3 TransformNormal(const Vec3& n) const { return inverse.TransposedVector(n); }
+
+	AABB TransformBounds(const AABB& bounds) const
+	{
+		AABB result;
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			Vec3 point((corner & 1) ? bounds.max.x() : bounds.min.x(),
+					   (corner & 2) ? bounds.max.y() : bounds.min.y(),
+					   (corner & 4) ? bounds.max.z() : bounds.min.z());
+			result.Grow(TransformPoint(point));
+		}
+
+		return result;
+	}
+
+private:
+	struct Matrix
+	{
+		float m[3][4];
+
+		Matrix() = default;
+		explicit Matrix(const float rows[3][4])
+		{
+			for (int r = 0; r < 3; ++r)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					m[r][c] = rows[r][c];
+				}
+			}
+		}
+
+		static Matrix Identity()
+		{
+			const float rows[3][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } };
+			return Matrix(rows);
+		}
+
+		inline Vec3 Point(const Vec3& p) const
+		{
+			return Vec3(m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+						m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+						m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3]);
+		}
+
+		inline Vec3 Vector(const Vec3& v) const
+		{
+			return Vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+						m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+						m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+		}
+
+		inline Vec3 TransposedVector(const Vec3& v) const
+		{
+			return Vec3(m[0][0] * v.x() + m[1][0] * v.y() + m[2][0] * v.z(),
+						m[0][1] * v.x() + m[1][1] * v.y() + m[2][1] * v.z(),
+						m[0][2] * v.x() + m[1][2] * v.y() + m[2][2] * v.z());
+		}
+
+		// Transposes the 3x3 block; only meaningful for rotations, which
+		// have no translation
+		Matrix Transposed() const
+		{
+			Matrix result = *this;
+			for (int r = 0; r < 3; ++r)
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					result.m[r][c] = m[c][r];
+				}
+			}
+
+			return result;
+		}
+
+		Matrix operator*(const Matrix& o) const
+		{
+			Matrix result;
+			for (int r = 0; r < 3; ++r)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					result.m[r][c] = m[r][0] * o.m[0][c] + m[r][1] * o.m[1][c] + m[r][2] * o.m[2][c];
+				}
+
+				result.m[r][3] += m[r][3];
+			}
+
+			return result;
+		}
+
+		// Inverse of the 3x3 block by cofactors; the translation is then
+		// -inverse * translation
+		Matrix Inverted() const
+		{
+			float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+			float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+			float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+			float inverseDeterminant = 1.0f / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+
+			Matrix result;
+			result.m[0][0] = c00 * inverseDeterminant;
+			result.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inverseDeterminant;
+			result.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inverseDeterminant;
+			result.m[1][0] = c01 * inverseDeterminant;
+			result.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inverseDeterminant;
+			result.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inverseDeterminant;
+			result.m[2][0] = c02 * inverseDeterminant;
+			result.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inverseDeterminant;
+			result.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inverseDeterminant;
+
+			Vec3 translation = result.Vector(Vec3(m[0][3], m[1][3], m[2][3]));
+			result.m[0][3] = -translation.x();
+			result.m[1][3] = -translation.y();
+			result.m[2][3] = -translation.z();
+			return result;
+		}
+	};
+
+	Transform(const Matrix& matrix, const Matrix& inverse) : matrix{ matrix }, inverse{ inverse } {}
+
+	Matrix matrix;
+	Matrix inverse;
+};
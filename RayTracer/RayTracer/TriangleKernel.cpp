@@ -0,0 +1,104 @@
+#include "pch.h"
+#include "PrimitiveStore.h"
+#include "RenderStats.h"
+
+// The ray is taken into each triangle's unit space (see PrimitiveStore.h),
+// SIMD_WIDTH triangles at a time: there, the hit distance is where the ray
+// crosses z = 0, and the hit is inside when the crossing point's (u, v) is
+// in the unit triangle. Rejections just clear lanes, and the barycentrics
+// are only computed when some lane is still in range after the distance
+// test, which rejects most triangles of a leaf on its own.
+
+int TriangleStore::IntersectRange(int first, int count, const Ray& ray, bool ignoreBackFaces, float& tMax) const
+{
+	const SimdFloat zero = SimdFloat::Splat(0.0f);
+	const SimdFloat one = SimdFloat::Splat(1.0f);
+	const SimdFloat epsilon = SimdFloat::Splat(EPSILON);
+	const SimdFloat maxDistance = SimdFloat::Splat(1.0f / EPSILON);
+	const SimdFloat laneIndices = SimdFloat::LaneIndices();
+	RT_STAT_ADD(triangleTests, count);
+
+	const SimdFloat dx = SimdFloat::Splat(ray.Direction().x());
+	const SimdFloat dy = SimdFloat::Splat(ray.Direction().y());
+	const SimdFloat dz = SimdFloat::Splat(ray.Direction().z());
+	const SimdFloat ox = SimdFloat::Splat(ray.Origin().x());
+	const SimdFloat oy = SimdFloat::Splat(ray.Origin().y());
+	const SimdFloat oz = SimdFloat::Splat(ray.Origin().z());
+
+	int closest = -1;
+
+	for (int base = first; base < first + count; base += SIMD_WIDTH)
+	{
+		SimdMask active = laneIndices < SimdFloat::Splat((float)(first + count - base));
+
+		// The w row is the (scaled) normal, so its direction component's
+		// sign tells back faces apart
+		SimdFloat wx = SimdFloat::Load(&wX[base]);
+		SimdFloat wy = SimdFloat::Load(&wY[base]);
+		SimdFloat wz = SimdFloat::Load(&wZ[base]);
+		SimdFloat originW = SimdFloat::Load(&wW[base]) + ox * wx + oy * wy + oz * wz;
+		SimdFloat directionW = dx * wx + dy * wy + dz * wz;
+
+		if (ignoreBackFaces)
+		{
+			active = AndNot(active, directionW > zero);
+		}
+
+		SimdFloat t = (zero - originW) / directionW;
+		active = active & (t > epsilon) & (t < maxDistance) & (t < SimdFloat::Splat(tMax));
+
+		if (!active.Any())
+		{
+			continue;
+		}
+
+		SimdFloat hitX = ox + dx * t;
+		SimdFloat hitY = oy + dy * t;
+		SimdFloat hitZ = oz + dz * t;
+
+		SimdFloat u = SimdFloat::Load(&uW[base]) + hitX * SimdFloat::Load(&uX[base]) +
+					  hitY * SimdFloat::Load(&uY[base]) + hitZ * SimdFloat::Load(&uZ[base]);
+		SimdFloat v = SimdFloat::Load(&vW[base]) + hitX * SimdFloat::Load(&vX[base]) +
+					  hitY * SimdFloat::Load(&vY[base]) + hitZ * SimdFloat::Load(&vZ[base]);
+
+		active = active & (u >= zero) & (v >= zero) & (u + v <= one);
+
+		if (!active.Any())
+		{
+			continue;
+		}
+
+		float distances[SIMD_WIDTH];
+		t.Store(distances);
+		int hitLanes = active.Bits();
+
+		for (int lane = 0; lane < SIMD_WIDTH; ++lane)
+		{
+			if ((hitLanes & (1 << lane)) && distances[lane] < tMax)
+			{
+				tMax = distances[lane];
+				closest = base + lane;
+				RT_STAT_ADD(triangleHits, 1);
+			}
+		}
+	}
+
+	return closest;
+}
+
+int TriangleStore::IntersectRangeScalar(int first, int count, const Ray& ray, bool ignoreBackFaces, float& tMax) const
+{
+	int closest = -1;
+
+	for (int i = first; i < first + count; ++i)
+	{
+		float t;
+		if (Intersect(i, ray, ignoreBackFaces, t) && t < tMax)
+		{
+			tMax = t;
+			closest = i;
+		}
+	}
+
+	return closest;
+}
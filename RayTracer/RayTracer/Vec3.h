@@ -8,9 +8,9 @@ class Vec3
 {
 public:
 	// Using a left-handed coordinate system, like Unity
-	static Vec3 Up() { return Vec3(0.0f, 1.0f, 0.0f); }
-	static Vec3 Forward() { return Vec3(0.0f, 0.0f, 1.0f); }
-	static Vec3 Right() { return Vec3(1.0f, 0.0f, 0.0f); }
+	static constexpr Vec3 Up() { return Vec3(0.0f, 1.0f, 0.0f); }
+	static constexpr Vec3 Forward() { return Vec3(0.0f, 0.0f, 1.0f); }
+	static constexpr Vec3 Right() { return Vec3(1.0f, 0.0f, 0.0f); }
 	
 	static Vec3 Lerp(const Vec3& a, const Vec3& b, float normalizedValue)
 	{
@@ -20,16 +20,18 @@ public:
 					oneMinusNormalizedValue * a.val[2] + normalizedValue * b.val[2]);
 	}
 
-	Vec3() : val{ 0.0f, 0.0f, 0.0f } {}
-	Vec3(float x, float y, float z) : val{ x, y, z } {}
+	constexpr Vec3() : val{ 0.0f, 0.0f, 0.0f } {}
+	constexpr Vec3(float x, float y, float z) : val{ x, y, z } {}
 	
-	inline float x() const { return val[0]; }
-	inline float y() const { return val[1]; }
-	inline float z() const { return val[2]; }
+	inline constexpr float x() const { return val[0]; }
+	inline constexpr float y() const { return val[1]; }
+	inline constexpr float z() const { return val[2]; }
 
-	inline float r() const { return val[0]; }
-	inline float g() const { return val[1]; }
-	inline float b() const { return val[2]; }
+	inline constexpr float r() const { return val[0]; }
+	inline constexpr float g() const { return val[1]; }
+	inline constexpr float b() const { return val[2]; }
+
+	inline constexpr float operator[](int axis) const { return val[axis]; }
 
 	inline bool operator==(const Vec3& other) const
 	{
@@ -147,6 +149,21 @@ inline Vec3 operator*(const Vec3& a, const Vec3& b)
 }
 
 
+// Unlike fminf / fmaxf these compile to a single minss / maxss; if
+// "a" is NaN, they return "b".
+inline float Minf(float a, float b) { return a < b ? a : b; }
+inline float Maxf(float a, float b) { return a > b ? a : b; }
+
+inline Vec3 Min(const Vec3& a, const Vec3& b)
+{
+	return Vec3(Minf(a.x(), b.x()), Minf(a.y(), b.y()), Minf(a.z(), b.z()));
+}
+
+inline Vec3 Max(const Vec3& a, const Vec3& b)
+{
+	return Vec3(Maxf(a.x(), b.x()), Maxf(a.y(), b.y()), Maxf(a.z(), b.z()));
+}
+
 inline std::ostream& operator<<(std::ostream& stream, const Vec3& v)
 {
 	stream << v.x() << " " << v.y() << " " << v.z();
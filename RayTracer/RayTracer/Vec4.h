@@ -0,0 +1,223 @@
+#pragma once
+#include <math.h>
+#include "SIMD.h"
+#include "Vec3.h"
+
+// 16 byte aligned, four float vectors that map onto one SSE register (or
+// one NEON register, for a port): Vec4, and Vec3A, a Vec3 with an unused
+// fourth lane that is kept at zero. Their operations work on all four lanes
+// at once when an SSE backend is selected in SIMD.h, and fall back to plain
+// scalar code otherwise (RT_NO_SIMD, or no SSE). Vec3A has the same API as
+// Vec3 and rounds the same way - Dot adds x, y and z in that order - so
+// switching code between the two does not change its results.
+//
+// The wide types for batch kernels, Vec3x4 and Vec3x8, are SimdVec3 in
+// SIMD.h: SIMD_WIDTH Vec3s stored as three registers.
+//
+// RcpFast() and RsqrtFast() are the scalar forms of SIMD.h's: 1 / x and
+// 1 / sqrt(x) to a relative error of about 2^-22 with SSE, exact otherwise.
+
+namespace Lanes4
+{
+#if defined(RT_SIMD_AVX) || defined(RT_SIMD_SSE)
+
+	inline __m128 Load(const float* v) { return _mm_load_ps(v); }
+	inline void Store(float* v, __m128 a) { _mm_store_ps(v, a); }
+
+	// Built in a register and stored whole: written one float at a time,
+	// the next vector load of it would have to wait for all four stores
+	inline void Set(float x, float y, float z, float w, float* result) { Store(result, _mm_set_ps(w, z, y, x)); }
+
+	inline void Add(const float* a, const float* b, float* result) { Store(result, _mm_add_ps(Load(a), Load(b))); }
+	inline void Sub(const float* a, const float* b, float* result) { Store(result, _mm_sub_ps(Load(a), Load(b))); }
+	inline void Mul(const float* a, const float* b, float* result) { Store(result, _mm_mul_ps(Load(a), Load(b))); }
+	inline void Min(const float* a, const float* b, float* result) { Store(result, _mm_min_ps(Load(a), Load(b))); }
+	inline void Max(const float* a, const float* b, float* result) { Store(result, _mm_max_ps(Load(a), Load(b))); }
+	inline void Scale(const float* a, float s, float* result) { Store(result, _mm_mul_ps(Load(a), _mm_set1_ps(s))); }
+	inline void Divide(const float* a, float s, float* result) { Store(result, _mm_div_ps(Load(a), _mm_set1_ps(s))); }
+
+	// (a.x * b.x + a.y * b.y) + a.z * b.z, plus a.w * b.w for four lanes
+	inline float Dot(const float* a, const float* b, int lanes)
+	{
+		__m128 products = _mm_mul_ps(Load(a), Load(b));
+		__m128 sum = _mm_add_ss(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 1, 1, 1)));
+		sum = _mm_add_ss(sum, _mm_movehl_ps(products, products));
+		if (lanes == 4)
+		{
+			sum = _mm_add_ss(sum, _mm_shuffle_ps(products, products, _MM_SHUFFLE(3, 3, 3, 3)));
+		}
+
+		return _mm_cvtss_f32(sum);
+	}
+
+	// a.yzx * b.zxy - a.zxy * b.yzx; w stays 0
+	inline void Cross(const float* a, const float* b, float* result)
+	{
+		__m128 va = Load(a);
+		__m128 vb = Load(b);
+		__m128 aYZX = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 bYZX = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 aZXY = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 1, 0, 2));
+		__m128 bZXY = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 1, 0, 2));
+		Store(result, _mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX)));
+	}
+
+	inline float RcpFast(float x)
+	{
+		__m128 value = _mm_set_ss(x);
+		__m128 estimate = _mm_rcp_ss(value);
+		return _mm_cvtss_f32(_mm_mul_ss(estimate, _mm_sub_ss(_mm_set_ss(2.0f), _mm_mul_ss(value, estimate))));
+	}
+
+	inline float RsqrtFast(float x)
+	{
+		__m128 value = _mm_set_ss(x);
+		__m128 estimate = _mm_rsqrt_ss(value);
+		__m128 halfValue = _mm_mul_ss(_mm_set_ss(0.5f), value);
+		__m128 correction = _mm_sub_ss(_mm_set_ss(1.5f), _mm_mul_ss(_mm_mul_ss(halfValue, estimate), estimate));
+		return _mm_cvtss_f32(_mm_mul_ss(estimate, correction));
+	}
+
+#else
+
+	inline void Set(float x, float y, float z, float w, float* result) { result[0] = x; result[1] = y; result[2] = z; result[3] = w; }
+	inline void Add(const float* a, const float* b, float* result) { for (int i = 0; i < 4; ++i) { result[i] = a[i] + b[i]; } }
+	inline void Sub(const float* a, const float* b, float* result) { for (int i = 0; i < 4; ++i) { result[i] = a[i] - b[i]; } }
+	inline void Mul(const float* a, const float* b, float* result) { for (int i = 0; i < 4; ++i) { result[i] = a[i] * b[i]; } }
+	inline void Min(const float* a, const float* b, float* result) { for (int i = 0; i < 4; ++i) { result[i] = Minf(a[i], b[i]); } }
+	inline void Max(const float* a, const float* b, float* result) { for (int i = 0; i < 4; ++i) { result[i] = Maxf(a[i], b[i]); } }
+	inline void Scale(const float* a, float s, float* result) { for (int i = 0; i < 4; ++i) { result[i] = a[i] * s; } }
+	inline void Divide(const float* a, float s, float* result) { for (int i = 0; i < 4; ++i) { result[i] = a[i] / s; } }
+
+	inline float Dot(const float* a, const float* b, int lanes)
+	{
+		float sum = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+		return lanes == 4 ? sum + a[3] * b[3] : sum;
+	}
+
+	inline void Cross(const float* a, const float* b, float* result)
+	{
+		float cx = a[1] * b[2] - a[2] * b[1];
+		float cy = a[2] * b[0] - a[0] * b[2];
+		float cz = a[0] * b[1] - a[1] * b[0];
+		result[0] = cx; result[1] = cy; result[2] = cz; result[3] = 0.0f;
+	}
+
+	inline float RcpFast(float x) { return 1.0f / x; }
+	inline float RsqrtFast(float x) { return 1.0f / sqrtf(x); }
+
+#endif
+}
+
+inline float RcpFast(float x) { return Lanes4::RcpFast(x); }
+inline float RsqrtFast(float x) { return Lanes4::RsqrtFast(x); }
+
+class alignas(16) Vec4
+{
+public:
+	constexpr Vec4() : val{ 0.0f, 0.0f, 0.0f, 0.0f } {}
+	constexpr Vec4(float x, float y, float z, float w) : val{ x, y, z, w } {}
+	constexpr Vec4(const Vec3& v, float w) : val{ v.x(), v.y(), v.z(), w } {}
+
+	inline constexpr float x() const { return val[0]; }
+	inline constexpr float y() const { return val[1]; }
+	inline constexpr float z() const { return val[2]; }
+	inline constexpr float w() const { return val[3]; }
+
+	inline constexpr float operator[](int axis) const { return val[axis]; }
+	inline const float* Data() const { return val; }
+
+	inline constexpr Vec3 XYZ() const { return Vec3(val[0], val[1], val[2]); }
+
+	inline bool operator==(const Vec4& other) const
+	{
+		return val[0] == other.val[0] && val[1] == other.val[1] && val[2] == other.val[2] && val[3] == other.val[3];
+	}
+
+	inline bool operator!=(const Vec4& other) const { return !(*this == other); }
+
+	inline Vec4 operator+(const Vec4& other) const { Vec4 result; Lanes4::Add(val, other.val, result.val); return result; }
+	inline Vec4 operator-(const Vec4& other) const { Vec4 result; Lanes4::Sub(val, other.val, result.val); return result; }
+	inline Vec4 operator*(const Vec4& other) const { Vec4 result; Lanes4::Mul(val, other.val, result.val); return result; }
+	inline Vec4 operator*(float scalar) const { Vec4 result; Lanes4::Scale(val, scalar, result.val); return result; }
+	inline Vec4 operator/(float scalar) const { Vec4 result; Lanes4::Divide(val, scalar, result.val); return result; }
+
+	inline float Dot(const Vec4& other) const { return Lanes4::Dot(val, other.val, 4); }
+
+	friend inline Vec4 Min(const Vec4& a, const Vec4& b) { Vec4 result; Lanes4::Min(a.val, b.val, result.val); return result; }
+	friend inline Vec4 Max(const Vec4& a, const Vec4& b) { Vec4 result; Lanes4::Max(a.val, b.val, result.val); return result; }
+
+private:
+	float val[4];
+};
+
+class alignas(16) Vec3A
+{
+public:
+	static constexpr Vec3A Up() { return Vec3A(0.0f, 1.0f, 0.0f); }
+	static constexpr Vec3A Forward() { return Vec3A(0.0f, 0.0f, 1.0f); }
+	static constexpr Vec3A Right() { return Vec3A(1.0f, 0.0f, 0.0f); }
+
+	static Vec3A Lerp(const Vec3A& a, const Vec3A& b, float normalizedValue)
+	{
+		return a * (1.0f - normalizedValue) + b * normalizedValue;
+	}
+
+	constexpr Vec3A() : val{ 0.0f, 0.0f, 0.0f, 0.0f } {}
+	constexpr Vec3A(float x, float y, float z) : val{ x, y, z, 0.0f } {}
+	explicit Vec3A(const Vec3& v) { Lanes4::Set(v.x(), v.y(), v.z(), 0.0f, val); }
+
+	inline constexpr float x() const { return val[0]; }
+	inline constexpr float y() const { return val[1]; }
+	inline constexpr float z() const { return val[2]; }
+
+	inline constexpr float r() const { return val[0]; }
+	inline constexpr float g() const { return val[1]; }
+	inline constexpr float b() const { return val[2]; }
+
+	inline constexpr float operator[](int axis) const { return val[axis]; }
+
+	inline constexpr Vec3 ToVec3() const { return Vec3(val[0], val[1], val[2]); }
+
+	inline bool operator==(const Vec3A& other) const
+	{
+		return val[0] == other.val[0] && val[1] == other.val[1] && val[2] == other.val[2];
+	}
+
+	inline bool operator!=(const Vec3A& other) const { return !(*this == other); }
+
+	inline Vec3A operator-() const { return *this * -1.0f; }
+	inline Vec3A operator+(const Vec3A& other) const { Vec3A result; Lanes4::Add(val, other.val, result.val); return result; }
+	inline Vec3A operator-(const Vec3A& other) const { Vec3A result; Lanes4::Sub(val, other.val, result.val); return result; }
+	inline Vec3A operator*(const Vec3A& other) const { Vec3A result; Lanes4::Mul(val, other.val, result.val); return result; }
+	inline Vec3A operator*(float scalar) const { Vec3A result; Lanes4::Scale(val, scalar, result.val); return result; }
+
+	// The unused lane holds 0 / scalar afterwards, so it is reset
+	inline Vec3A operator/(float scalar) const
+	{
+		Vec3A result;
+		Lanes4::Divide(val, scalar, result.val);
+		result.val[3] = 0.0f;
+		return result;
+	}
+
+	inline Vec3A& operator+=(const Vec3A& other) { return *this = *this + other; }
+
+	inline Vec3A Cross(const Vec3A& other) const { Vec3A result; Lanes4::Cross(val, other.val, result.val); return result; }
+	inline float Dot(const Vec3A& other) const { return Lanes4::Dot(val, other.val, 3); }
+	inline float SqrMagnitude() const { return Dot(*this); }
+	inline float Length() const { return sqrtf(SqrMagnitude()); }
+
+	inline Vec3A& Normalize() { return *this = *this / Length(); }
+
+	friend inline Vec3A Min(const Vec3A& a, const Vec3A& b) { Vec3A result; Lanes4::Min(a.val, b.val, result.val); return result; }
+	friend inline Vec3A Max(const Vec3A& a, const Vec3A& b) { Vec3A result; Lanes4::Max(a.val, b.val, result.val); return result; }
+
+private:
+	float val[4];
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const Vec3A& v)
+{
+	return stream << v.ToVec3();
+}
@@ -0,0 +1,154 @@
+#include "pch.h"
+#include "Wavefront.h"
+#include "Integrator.h"
+#include "Material.h"
+#include "RenderStats.h"
+
+void WavefrontIntegrator::Trace(std::vector<PathState>& paths, OUT Vec3* results)
+{
+	while (!paths.empty())
+	{
+		Extend(paths, results);
+		Shade(paths, results);
+		Compact(paths);
+	}
+}
+
+void WavefrontIntegrator::Extend(std::vector<PathState>& paths, OUT Vec3* results)
+{
+	hits.resize(paths.size());
+	isActive.assign(paths.size(), 1);
+
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		PathState& path = paths[i];
+
+		path.depth += 1;
+		if (path.depth >= this->path.maxDepth)
+		{
+			RT_STAT_PATH_END(path.depth, PathEnd::Truncated);
+			results[path.resultIndex] = path.throughput * SampleSky(path.ray);
+			isActive[i] = 0;
+			continue;
+		}
+
+		RT_STAT_RAYS(path.depth, 1);
+		if (!world->Raycast(path.ray, OUT hits[i]))
+		{
+			RT_STAT_PATH_END(path.depth, PathEnd::Escaped);
+			results[path.resultIndex] = path.throughput * SampleSky(path.ray);
+			isActive[i] = 0;
+		}
+	}
+}
+
+void WavefrontIntegrator::Shade(std::vector<PathState>& paths, OUT Vec3* results)
+{
+	// Counting sort of the active paths by material. Scenes have a handful
+	// of materials, and neighbouring paths tend to hit the same one, so a
+	// linear search for the group (after checking the last one) is fine.
+
+	materials.clear();
+	groupOfPath.assign(paths.size(), -1);
+	int lastGroup = -1;
+
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		if (isActive[i])
+		{
+			const AMaterial* material = hits[i].materialPtr;
+			if (lastGroup < 0 || materials[lastGroup] != material)
+			{
+				lastGroup = 0;
+				while (lastGroup < (int)materials.size() && materials[lastGroup] != material) { lastGroup++; }
+				if (lastGroup == (int)materials.size()) { materials.push_back(material); }
+			}
+
+			groupOfPath[i] = lastGroup;
+		}
+	}
+
+	groupOffsets.assign(materials.size() + 1, 0);
+	for (int group : groupOfPath)
+	{
+		if (group >= 0) { groupOffsets[group + 1]++; }
+	}
+
+	for (size_t group = 0; group < materials.size(); ++group)
+	{
+		groupOffsets[group + 1] += groupOffsets[group];
+	}
+
+	sortedPaths.resize(groupOffsets.back());
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		if (groupOfPath[i] >= 0)
+		{
+			sortedPaths[groupOffsets[groupOfPath[i]]++] = (int)i;
+		}
+	}
+
+	// After the scatter above each offset points at the end of its
+	// group, i.e. at the start of the next one
+	int groupStart = 0;
+	for (size_t group = 0; group < materials.size(); ++group)
+	{
+		const AMaterial* material = materials[group];
+		int groupEnd = groupOffsets[group];
+
+		for (int s = groupStart; s < groupEnd; ++s)
+		{
+			int i = sortedPaths[s];
+			PathState& path = paths[i];
+
+			Ray scattered;
+			Vec3 attenuation;
+			path.sampler.StartBounce(path.depth);
+			if (material->DoesScatter(path.ray, hits[i], path.sampler, OUT attenuation, OUT scattered))
+			{
+				RT_STAT_SCATTER(material, true);
+
+				// Same roulette, and the same random numbers, as ShadeHit
+				float survival = this->path.SurvivalProbability(path.depth, path.throughput * attenuation);
+				if (survival < 1.0f && path.sampler.Next1D() >= survival)
+				{
+					RT_STAT_PATH_END(path.depth, PathEnd::Roulette);
+					results[path.resultIndex] = Vec3();
+					isActive[i] = 0;
+					continue;
+				}
+
+				path.throughput = path.throughput * (attenuation / survival);
+				path.ray = scattered;
+			}
+			else
+			{
+				RT_STAT_SCATTER(material, false);
+				RT_STAT_PATH_END(path.depth, PathEnd::Absorbed);
+				results[path.resultIndex] = Vec3();
+				isActive[i] = 0;
+			}
+		}
+
+		groupStart = groupEnd;
+	}
+}
+
+void WavefrontIntegrator::Compact(std::vector<PathState>& paths)
+{
+	size_t activeCount = 0;
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		if (isActive[i])
+		{
+			if (activeCount != i)
+			{
+				paths[activeCount] = paths[i];
+			}
+
+			activeCount++;
+		}
+	}
+
+	paths.erase(paths.begin() + activeCount, paths.end());
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include "Hitable.h"
+#include "Integrator.h"
+#include "Sampler.h"
+
+// One path in flight: the ray it's about to trace, the product of the
+// attenuations it has picked up so far, and its own random stream.
+struct PathState
+{
+	Ray ray;
+	Vec3 throughput;
+	Sampler sampler;
+	int resultIndex;		// where Trace() puts the path's radiance
+	int depth;
+};
+
+// Iterative replacement for SampleRecursiveWithMaterial. Instead of
+// following one path to its end, it advances every path of a wave by one
+// bounce at a time:
+//
+//	- extend:  intersect all active rays with the world, one after the other
+//	- shade:   group the hits by material, and scatter each group in a row,
+//			   so consecutive calls go to the same DoesScatter
+//	- compact: drop the paths that have been absorbed or escaped
+//
+// The result is the same estimator as the recursive version; only the
+// order in which the attenuations are multiplied together differs.
+
+class WavefrontIntegrator
+{
+public:
+	WavefrontIntegrator(const HitableList* world, const PathSettings& path) : world{ world }, path{ path } {}
+
+	// Traces "paths" until every one of them has finished; the radiance of
+	// each is written to results[path.resultIndex]. "paths" is consumed.
+	void Trace(std::vector<PathState>& paths, OUT Vec3* results);
+
+private:
+	void Extend(std::vector<PathState>& paths, OUT Vec3* results);
+	void Shade(std::vector<PathState>& paths, OUT Vec3* results);
+	void Compact(std::vector<PathState>& paths);
+
+	const HitableList* world;
+	PathSettings path;
+
+	// Scratch buffers, kept around between waves; indexed like "paths"
+	std::vector<HitInfo> hits;
+	std::vector<uint8_t> isActive;
+
+	// Scratch for grouping hits by material
+	std::vector<const AMaterial*> materials;
+	std::vector<int> groupOffsets;
+	std::vector<int> groupOfPath;
+	std::vector<int> sortedPaths;
+};
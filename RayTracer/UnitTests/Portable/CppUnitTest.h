@@ -0,0 +1,117 @@
+#pragma once
+
+// Stand-in for Visual Studio's CppUnitTest.h, for the CMake build: the
+// TEST_CLASS / TEST_METHOD macros and the parts of Assert that the tests
+// use. Each TEST_METHOD registers itself; TestMain.cpp runs them all, or
+// the ones whose "Class::Method" name contains the first argument.
+//
+// Registration relies on inline static members, so this needs C++17.
+
+#include <cmath>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace PortableUnitTest
+{
+	struct TestCase
+	{
+		std::string name;
+		std::function<void()> run;
+	};
+
+	inline std::vector<TestCase>& Registry()
+	{
+		static std::vector<TestCase> tests;
+		return tests;
+	}
+
+	struct Registrar
+	{
+		Registrar(const char* className, const char* methodName, void (*run)())
+		{
+			Registry().push_back(TestCase{ std::string(className) + "::" + methodName, run });
+		}
+	};
+
+	struct AssertFailed : std::runtime_error
+	{
+		explicit AssertFailed(const std::string& message) : std::runtime_error(message) {}
+	};
+
+	template <typename T>
+	struct TestClass
+	{
+		typedef T Self;
+	};
+}
+
+#define TEST_CLASS(className) \
+	struct className; \
+	inline const char* TestClassName(className*) { return #className; } \
+	struct className : PortableUnitTest::TestClass<className>
+
+#define TEST_METHOD(methodName) \
+	static void methodName##_Run() { Self test; test.methodName(); } \
+	inline static const PortableUnitTest::Registrar methodName##_Registrar{ TestClassName((Self*)nullptr), #methodName, &methodName##_Run }; \
+	void methodName()
+
+namespace Microsoft { namespace VisualStudio { namespace CppUnitTestFramework
+{
+	class Assert
+	{
+	public:
+		template <typename T>
+		static void AreEqual(const T& expected, const T& actual, const wchar_t* = nullptr)
+		{
+			if (!(expected == actual))
+			{
+				throw PortableUnitTest::AssertFailed("AreEqual failed");
+			}
+		}
+
+		static void AreEqual(float expected, float actual, float tolerance, const wchar_t* = nullptr)
+		{
+			AreWithin(expected, actual, tolerance);
+		}
+
+		static void AreEqual(double expected, double actual, double tolerance, const wchar_t* = nullptr)
+		{
+			AreWithin(expected, actual, tolerance);
+		}
+
+		static void IsTrue(bool condition, const wchar_t* = nullptr)
+		{
+			if (!condition)
+			{
+				throw PortableUnitTest::AssertFailed("IsTrue failed");
+			}
+		}
+
+		static void IsFalse(bool condition, const wchar_t* = nullptr)
+		{
+			if (condition)
+			{
+				throw PortableUnitTest::AssertFailed("IsFalse failed");
+			}
+		}
+
+		static void Fail(const wchar_t* = nullptr)
+		{
+			throw PortableUnitTest::AssertFailed("Fail");
+		}
+
+	private:
+		static void AreWithin(double expected, double actual, double tolerance)
+		{
+			if (!(std::fabs(expected - actual) <= tolerance))
+			{
+				std::ostringstream message;
+				message << "AreEqual failed: expected " << expected << ", got " << actual << " (tolerance " << tolerance << ")";
+				throw PortableUnitTest::AssertFailed(message.str());
+			}
+		}
+	};
+}}}
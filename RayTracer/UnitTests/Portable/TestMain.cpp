@@ -0,0 +1,36 @@
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include "CppUnitTest.h"
+
+// Runs the registered tests - all of them, or those whose name contains
+// argv[1] - and returns the number of failures.
+
+int main(int argc, char* argv[])
+{
+	const char* filter = argc > 1 ? argv[1] : "";
+	int runCount = 0;
+	int failureCount = 0;
+
+	for (const auto& test : PortableUnitTest::Registry())
+	{
+		if (strstr(test.name.c_str(), filter) == nullptr)
+		{
+			continue;
+		}
+
+		runCount++;
+		try
+		{
+			test.run();
+		}
+		catch (const std::exception& e)
+		{
+			failureCount++;
+			std::cout << "FAILED " << test.name << ": " << e.what() << std::endl;
+		}
+	}
+
+	std::cout << runCount - failureCount << " of " << runCount << " tests passed" << std::endl;
+	return failureCount;
+}
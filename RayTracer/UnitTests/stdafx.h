@@ -5,7 +5,9 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include "targetver.h"
+#endif
 
 // Headers for CppUnitTest
 #include "CppUnitTest.h"
@@ -2,10 +2,22 @@
 #include "CppUnitTest.h"
 #include "../RayTracer/RayTracer.h"
 #include "../RayTracer/Vec3.h"
+#include "../RayTracer/Vec4.h"
 #include "../RayTracer/Ray.h"
 #include "../RayTracer/Hitable.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <string>
 #include <sstream>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -31,6 +43,72 @@ namespace UnitTests
 			Assert::AreEqual(stream.str(), std::string("0 255 255\n127 0 25\n"));
 		}
 
+		TEST_METHOD(BinaryPPMMatchesTextPPM)
+		{
+			// 5 pixels, so that SIMD rows have a scalar tail too
+			Framebuffer framebuffer(5, 2);
+			for (int y = 0; y < 2; ++y)
+			{
+				for (int x = 0; x < 5; ++x)
+				{
+					framebuffer.Set(x, y, Vec3(x * 0.2f, y * 0.7f, (x + y) * 0.13f));
+				}
+			}
+
+			auto binary = EncodeImage(framebuffer, ImageFormat::BinaryPPM);
+			std::string header("P6\n5 2\n255\n");
+			Assert::AreEqual(header, std::string(binary.begin(), binary.begin() + header.size()));
+			Assert::AreEqual(header.size() + 5 * 2 * 3, binary.size());
+
+			auto text = EncodeImage(framebuffer, ImageFormat::TextPPM);
+			std::istringstream textStream(std::string(text.begin(), text.end()));
+			std::string magic;
+			int width, height, maxValue;
+			textStream >> magic >> width >> height >> maxValue;
+			Assert::AreEqual(std::string("P3"), magic);
+
+			for (size_t i = header.size(); i < binary.size(); ++i)
+			{
+				int value;
+				textStream >> value;
+				Assert::AreEqual(value, (int)(uint8_t)binary[i]);
+			}
+		}
+
+		TEST_METHOD(QuantizeRowClamps)
+		{
+			Vec3 pixels[3] = { Vec3(-1.0f, 2.0f, 0.5f), Vec3(1.0f, 0.0f, 1000.0f), Vec3(NAN, 0.999f, -0.0f) };
+			uint8_t rgb[9];
+			QuantizeRow(pixels, 3, rgb);
+
+			const uint8_t expected[9] = { 0, 255, 127, 255, 0, 255, 0, 254, 0 };
+			for (int i = 0; i < 9; ++i)
+			{
+				Assert::AreEqual((int)expected[i], (int)rgb[i]);
+			}
+		}
+
+		TEST_METHOD(PFMIsBottomUpFloats)
+		{
+			Framebuffer framebuffer(2, 2);
+			framebuffer.Set(0, 0, Vec3(1.0f, 2.0f, 3.0f));
+			framebuffer.Set(1, 1, Vec3(4.0f, 5.0f, 6.0f));
+
+			auto pfm = EncodeImage(framebuffer, ImageFormat::PFM);
+			std::string header("PF\n2 2\n-1.0\n");
+			Assert::AreEqual(header, std::string(pfm.begin(), pfm.begin() + header.size()));
+
+			float values[12];
+			Assert::AreEqual(header.size() + sizeof(values), pfm.size());
+			memcpy(values, &pfm[header.size()], sizeof(values));
+
+			// The first row in the file is the bottom one
+			Assert::AreEqual(4.0f, values[3]);
+			Assert::AreEqual(6.0f, values[5]);
+			Assert::AreEqual(1.0f, values[6]);
+			Assert::AreEqual(3.0f, values[8]);
+		}
+
 		TEST_METHOD(Vec3RGBTest)
 		{
 			auto a = Vec3(1.0f, 0.0f, 0.0f);
@@ -196,6 +274,68 @@ namespace UnitTests
 			Assert::IsTrue(b * c == Vec3(2.0f, 0.0f, 15.0f));
 		}
 
+		static void AssertSameVector(const Vec3& expected, const Vec3A& actual)
+		{
+			Assert::AreEqual(expected.x(), actual.x(), 1e-5f);
+			Assert::AreEqual(expected.y(), actual.y(), 1e-5f);
+			Assert::AreEqual(expected.z(), actual.z(), 1e-5f);
+		}
+
+		TEST_METHOD(Vec3AMatchesVec3)
+		{
+			static_assert(Vec3A::Up()[1] == 1.0f && Vec3(1.0f, 2.0f, 3.0f).z() == 3.0f, "constexpr construction");
+			static_assert(alignof(Vec3A) == 16 && sizeof(Vec4) == 16, "one SSE register");
+
+			Pcg32 rng(5u, 9u);
+			for (int i = 0; i < 1000; ++i)
+			{
+				Vec3 a(rng.NextFloat() * 4.0f - 2.0f, rng.NextFloat() * 4.0f - 2.0f, rng.NextFloat() * 4.0f - 2.0f);
+				Vec3 b(rng.NextFloat() * 4.0f - 2.0f, rng.NextFloat() * 4.0f - 2.0f, rng.NextFloat() * 4.0f - 2.0f);
+				Vec3A wideA(a);
+				Vec3A wideB(b);
+
+				AssertSameVector(a + b, wideA + wideB);
+				AssertSameVector(a - b, wideA - wideB);
+				AssertSameVector(a * b, wideA * wideB);
+				AssertSameVector(a * 3.0f, wideA * 3.0f);
+				AssertSameVector(a / 3.0f, wideA / 3.0f);
+				AssertSameVector(-a, -wideA);
+				AssertSameVector(a.Cross(b), wideA.Cross(wideB));
+				AssertSameVector(Vec3(a).Normalize(), Vec3A(wideA).Normalize());
+				AssertSameVector(Min(a, b), Min(wideA, wideB));
+				AssertSameVector(Vec3::Lerp(a, b, 0.25f), Vec3A::Lerp(wideA, wideB, 0.25f));
+				Assert::AreEqual(a.Dot(b), wideA.Dot(wideB), 1e-5f);
+				Assert::AreEqual(a.Length(), wideA.Length(), 1e-5f);
+			}
+
+			// The unused lane stays zero, so it never leaks into a dot product
+			Vec4 padded(Vec3(1.0f, 2.0f, 3.0f), 4.0f);
+			Assert::AreEqual(30.0f, padded.Dot(padded));
+			Assert::AreEqual(14.0f, (Vec3A(1.0f, 2.0f, 3.0f) / 0.5f).Dot(Vec3A(1.0f, 2.0f, 3.0f)) / 2.0f);
+		}
+
+		TEST_METHOD(FastReciprocalsMeetTheirAccuracy)
+		{
+			const float approxError = 1.5f / 4096.0f;
+			const float fastError = 1.0f / (1 << 21);
+
+			for (float x = 1e-3f; x < 1e4f; x *= 1.0137f)
+			{
+				Assert::IsTrue(std::fabs(RcpFast(x) * x - 1.0f) <= fastError);
+				Assert::IsTrue(std::fabs(RsqrtFast(x) * std::sqrt(x) - 1.0f) <= fastError);
+
+				float lanes[SIMD_WIDTH];
+				RcpApprox(SimdFloat::Splat(x)).Store(lanes);
+				Assert::IsTrue(std::fabs(lanes[0] * x - 1.0f) <= approxError);
+				RsqrtApprox(SimdFloat::Splat(x)).Store(lanes);
+				Assert::IsTrue(std::fabs(lanes[0] * std::sqrt(x) - 1.0f) <= approxError);
+				RcpFast(SimdFloat::Splat(x)).Store(lanes);
+				Assert::IsTrue(std::fabs(lanes[0] * x - 1.0f) <= fastError);
+				RsqrtFast(SimdFloat::Splat(x)).Store(lanes);
+				Assert::IsTrue(std::fabs(lanes[0] * std::sqrt(x) - 1.0f) <= fastError);
+			}
+		}
+
 		TEST_METHOD(RayBasicTests)
 		{
 			auto ray = Ray(Vec3(), Vec3::Up());
@@ -291,5 +431,1378 @@ namespace UnitTests
 			ray = Ray(Vec3(0.0f, 0.0f, -10.0f), -Vec3::Forward());
 			Assert::IsFalse(hl.Raycast(ray, OUT hit));
 		}
+
+		TEST_METHOD(ThreadPoolRunsAllTasks)
+		{
+			std::atomic<int> counter{ 0 };
+			ThreadPool pool(4);
+
+			for (int i = 0; i < 1000; ++i)
+			{
+				pool.Submit([&counter] { counter++; });
+			}
+
+			pool.Wait();
+			Assert::AreEqual(1000, counter.load());
+		}
+
+		TEST_METHOD(RendererTilesCoverImage)
+		{
+			RenderSettings settings;
+			settings.width = 70;
+			settings.height = 33;
+			settings.tileSize = 16;
+
+			HitableList world;
+			Renderer renderer(&world, Camera(Vec3(), settings.width, settings.height, 200.0f), settings);
+
+			int coveredPixels = 0;
+			for (const auto& tile : renderer.MakeTiles())
+			{
+				Assert::IsTrue(tile.x + tile.width <= settings.width);
+				Assert::IsTrue(tile.y + tile.height <= settings.height);
+				coveredPixels += tile.width * tile.height;
+			}
+
+			Assert::AreEqual(settings.width * settings.height, coveredPixels);
+		}
+
+		TEST_METHOD(Pcg32ReferenceOutput)
+		{
+			// First outputs of the reference pcg32 demo, seeded with (42, 54)
+			Pcg32 rng(42u, 54u);
+			Assert::IsTrue(rng.NextUInt() == 0xa15c02b7u);
+			Assert::IsTrue(rng.NextUInt() == 0x7b47f409u);
+			Assert::IsTrue(rng.NextUInt() == 0xba1d3330u);
+			Assert::IsTrue(rng.NextUInt() == 0x83d2f293u);
+
+			for (int i = 0; i < 10000; ++i)
+			{
+				float f = rng.NextFloat();
+				Assert::IsTrue(f >= 0.0f && f < 1.0f);
+			}
+		}
+
+		TEST_METHOD(SamplerIsDeterministicPerPixelAndSample)
+		{
+			Sampler a(1234u);
+			Sampler b(1234u);
+
+			a.StartSample(17, 3);
+			float first = a.Next1D();
+			a.StartSample(99, 0);
+			a.Next1D();
+
+			b.StartSample(17, 3);
+			Assert::IsTrue(b.Next1D() == first);
+
+			b.StartSample(17, 4);
+			Assert::IsFalse(b.Next1D() == first);
+		}
+
+		// Estimates the area of a disc, bounce 3's scatter direction
+		// dimensions standing in for the plane, in many pixels; the error
+		// should be well below that of random sampling, whatever the
+		// bounces before took. (Halton, in bases 31 and 37 there, is the
+		// weakest, at about 0.6 times the random error.)
+		TEST_METHOD(LowDiscrepancySamplersConvergeFaster)
+		{
+			const int pixelCount = 256;
+			const int sampleCount = 64;
+			const double area = 3.14159265358979 * 0.4 * 0.4;
+
+			auto rmsError = [&](const ASampleSequence* sequence)
+			{
+				Sampler sampler(1234u, sequence);
+				double squaredError = 0.0;
+
+				for (uint32_t pixel = 0; pixel < pixelCount; ++pixel)
+				{
+					int inside = 0;
+					for (uint32_t sample = 0; sample < sampleCount; ++sample)
+					{
+						sampler.StartSample(pixel, sample);
+						sampler.Next2D();
+						for (uint32_t i = 0; i < sample % 5; ++i)
+						{
+							sampler.Next1D();
+						}
+
+						sampler.StartBounce(3);
+						Point2 point = sampler.Next2D();
+						float u = point.u - 0.5f;
+						float v = point.v - 0.5f;
+						Assert::IsTrue(point.u >= 0.0f && point.u < 1.0f && point.v >= 0.0f && point.v < 1.0f);
+						inside += u * u + v * v < 0.16f ? 1 : 0;
+					}
+
+					double error = (double)inside / sampleCount - area;
+					squaredError += error * error;
+				}
+
+				return std::sqrt(squaredError / pixelCount);
+			};
+
+			double randomError = rmsError(nullptr);
+			for (SamplerType type : { SamplerType::Stratified, SamplerType::Halton, SamplerType::Sobol, SamplerType::BlueNoise })
+			{
+				auto sequence = MakeSampleSequence(type, 1234u, 16, sampleCount);
+				Assert::IsTrue(rmsError(sequence.get()) < 0.75 * randomError);
+			}
+		}
+
+		// Chi-square test over BINS x BINS cells that each should get the same
+		// share of the samples: "binCoordinates" maps a direction to a point
+		// that is uniform in the unit square if the sampling is right. The
+		// limit is the 99.9th percentile for 99 degrees of freedom.
+		static double ChiSquare(const std::function<DirectionSample(const Point2&)>& sample,
+								const std::function<Point2(const Vec3&)>& binCoordinates,
+								const std::function<float(const Vec3&)>& pdf)
+		{
+			const int BINS = 10;
+			const int SAMPLE_COUNT = 100000;
+			std::vector<int> counts(BINS * BINS, 0);
+			Pcg32 rng(7u, 11u);
+
+			for (int i = 0; i < SAMPLE_COUNT; ++i)
+			{
+				Point2 point{ rng.NextFloat(), rng.NextFloat() };
+				DirectionSample result = sample(point);
+				Assert::AreEqual(1.0f, result.direction.Length(), 1e-4f);
+				Assert::AreEqual(pdf(result.direction), result.pdf, 1e-4f);
+
+				Point2 bin = binCoordinates(result.direction);
+				int x = std::min((int)(bin.u * BINS), BINS - 1);
+				int y = std::min((int)(bin.v * BINS), BINS - 1);
+				counts[y * BINS + x]++;
+			}
+
+			double expected = (double)SAMPLE_COUNT / (BINS * BINS);
+			double chiSquare = 0.0;
+			for (int count : counts)
+			{
+				chiSquare += (count - expected) * (count - expected) / expected;
+			}
+
+			return chiSquare;
+		}
+
+		static float Azimuth01(const Vec3& direction)
+		{
+			return (std::atan2(direction.y(), direction.x()) + SAMPLING_PI) / (2.0f * SAMPLING_PI);
+		}
+
+		TEST_METHOD(DirectionSamplingMatchesItsDistribution)
+		{
+			const double CHI_SQUARE_LIMIT = 148.2;
+
+			// Cosine weighted: cos^2(theta) is uniform
+			double cosine = ChiSquare(SampleCosineHemisphere,
+				[](const Vec3& d) { return Point2{ d.z() * d.z(), Azimuth01(d) }; },
+				[](const Vec3& d) { return d.z() * SAMPLING_INV_PI; });
+			Assert::IsTrue(cosine < CHI_SQUARE_LIMIT);
+
+			double sphere = ChiSquare(SampleUniformSphere,
+				[](const Vec3& d) { return Point2{ (d.z() + 1.0f) * 0.5f, Azimuth01(d) }; },
+				[](const Vec3&) { return 0.25f * SAMPLING_INV_PI; });
+			Assert::IsTrue(sphere < CHI_SQUARE_LIMIT);
+
+			double hemisphere = ChiSquare(SampleUniformHemisphere,
+				[](const Vec3& d) { return Point2{ d.z(), Azimuth01(d) }; },
+				[](const Vec3&) { return 0.5f * SAMPLING_INV_PI; });
+			Assert::IsTrue(hemisphere < CHI_SQUARE_LIMIT);
+
+			// And the test can tell: uniform hemisphere directions are not
+			// cosine weighted
+			double wrong = ChiSquare(SampleUniformHemisphere,
+				[](const Vec3& d) { return Point2{ d.z() * d.z(), Azimuth01(d) }; },
+				[](const Vec3&) { return 0.5f * SAMPLING_INV_PI; });
+			Assert::IsTrue(wrong > 10.0 * CHI_SQUARE_LIMIT);
+		}
+
+		TEST_METHOD(OrthonormalBasisIsOrthonormal)
+		{
+			Vec3 normals[] = { Vec3(0.0f, 0.0f, 1.0f), Vec3(0.0f, 0.0f, -1.0f), Vec3(0.0f, 1.0f, 0.0f),
+							   Vec3(1.0f, 2.0f, -3.0f).Normalize(), Vec3(-0.3f, 0.1f, 0.9f).Normalize() };
+
+			for (const Vec3& normal : normals)
+			{
+				OrthonormalBasis basis(normal);
+				Assert::AreEqual(1.0f, basis.tangent.Length(), 1e-5f);
+				Assert::AreEqual(1.0f, basis.bitangent.Length(), 1e-5f);
+				Assert::AreEqual(0.0f, basis.tangent.Dot(basis.bitangent), 1e-5f);
+				Assert::AreEqual(0.0f, basis.tangent.Dot(normal), 1e-5f);
+				Assert::AreEqual(0.0f, basis.bitangent.Dot(normal), 1e-5f);
+
+				// Local z is the normal, and the hemisphere stays on its side
+				Vec3 up = basis.ToWorld(Vec3(0.0f, 0.0f, 1.0f));
+				Assert::AreEqual(1.0f, up.Dot(normal), 1e-5f);
+				Assert::IsTrue(basis.ToWorld(SampleCosineHemisphere(Point2{ 0.9f, 0.1f }).direction).Dot(normal) > 0.0f);
+			}
+		}
+
+		TEST_METHOD(BlueNoiseMaskUsesEveryThreshold)
+		{
+			std::vector<float> mask = BlueNoiseMask();
+			Assert::AreEqual(BLUE_NOISE_SIZE * BLUE_NOISE_SIZE, (int)mask.size());
+
+			std::sort(mask.begin(), mask.end());
+			for (size_t i = 0; i < mask.size(); ++i)
+			{
+				Assert::AreEqual(((float)i + 0.5f) / (float)mask.size(), mask[i], 1e-6f);
+			}
+		}
+
+		TEST_METHOD(RenderIsIndependentOfThreadCount)
+		{
+			DiffuseMaterial material("diffuse", Vec3(0.8f, 0.5f, 0.5f), 0.8f);
+			HitableList world;
+			world.AddSphere(Vec3(0.0f, 0.0f, 2.0f), 0.5f, &material);
+			world.AddSphere(Vec3(0.0f, -100.5f, 2.0f), 100.0f, &material);
+
+			RenderSettings settings;
+			settings.width = 40;
+			settings.height = 30;
+			settings.sampleCount = 4;
+			settings.tileSize = 8;
+			Camera camera(Vec3(), settings.width, settings.height, 40.0f);
+
+			Framebuffer single(settings.width, settings.height);
+			ThreadPool onePool(1);
+			Renderer(&world, camera, settings).Render(onePool, single);
+
+			settings.tileSize = 5;
+			Framebuffer multi(settings.width, settings.height);
+			ThreadPool threePool(3);
+			Renderer(&world, camera, settings).Render(threePool, multi);
+
+			for (int y = 0; y < settings.height; ++y)
+			{
+				for (int x = 0; x < settings.width; ++x)
+				{
+					Assert::IsTrue(single.Get(x, y) == multi.Get(x, y));
+				}
+			}
+		}
+
+		TEST_METHOD(ResumedRenderMatchesUninterruptedRender)
+		{
+			DiffuseMaterial material("diffuse", Vec3(0.8f, 0.5f, 0.5f), 0.8f);
+			HitableList world;
+			world.AddSphere(Vec3(0.0f, 0.0f, 2.0f), 0.5f, &material);
+			world.AddSphere(Vec3(0.0f, -100.5f, 2.0f), 100.0f, &material);
+
+			Camera camera(Vec3(), 24, 16, 40.0f);
+			ThreadPool pool(2);
+			const std::string checkpointPath = "ResumedRenderMatchesUninterruptedRender.bin";
+			RenderSettings settings;
+
+			for (SamplerType type : { SamplerType::Random, SamplerType::Sobol, SamplerType::Stratified })
+			{
+				settings.width = 24;
+				settings.height = 16;
+				settings.sampleCount = 12;
+				settings.seed = 1234u;
+				settings.samplerType = type;
+				Renderer renderer(&world, camera, settings);
+
+				Framebuffer uninterrupted(settings.width, settings.height);
+				renderer.Render(pool, uninterrupted);
+
+				AccumulationBuffer interrupted(settings);
+				renderer.RenderProgressive(pool, interrupted, 2, [&](const AccumulationBuffer& buffer)
+				{
+					if (buffer.TotalSamples() == 4u * settings.width * settings.height)
+					{
+						Assert::IsTrue(buffer.SaveCheckpoint(checkpointPath));
+					}
+				});
+
+				// Set up afresh, as after "--resume" without "--seed": the
+				// checkpoint's seed has to replace the default one
+				RenderSettings resumeSettings = settings;
+				resumeSettings.seed = RenderSettings().seed;
+				AccumulationBuffer resumed(resumeSettings);
+				Assert::IsTrue(ResumeFromCheckpoint(checkpointPath, resumed, resumeSettings));
+				Assert::AreEqual(4, resumed.At(0, 0).samplesTaken);
+				Renderer(&world, camera, resumeSettings).RenderProgressive(pool, resumed, 2, nullptr);
+
+				Framebuffer resumedImage(settings.width, settings.height);
+				resumed.Resolve(resumedImage);
+
+				for (int y = 0; y < settings.height; ++y)
+				{
+					for (int x = 0; x < settings.width; ++x)
+					{
+						Assert::IsTrue(uninterrupted.Get(x, y) == resumedImage.Get(x, y));
+					}
+				}
+			}
+
+			// The last (stratified) checkpoint is still there; it only loads
+			// into a buffer of its size, sampler and sample count
+			AccumulationBuffer wrongSize(settings.width + 1, settings.height, settings.seed, settings.samplerType, settings.sampleCount);
+			Assert::IsFalse(wrongSize.LoadCheckpoint(checkpointPath));
+			AccumulationBuffer wrongSampler(settings.width, settings.height, settings.seed, SamplerType::Sobol, settings.sampleCount);
+			Assert::IsFalse(wrongSampler.LoadCheckpoint(checkpointPath));
+			AccumulationBuffer wrongCount(settings.width, settings.height, settings.seed, settings.samplerType, settings.sampleCount + 1);
+			Assert::IsFalse(wrongCount.LoadCheckpoint(checkpointPath));
+			AccumulationBuffer rightSize(settings);
+			Assert::IsTrue(rightSize.LoadCheckpoint(checkpointPath));
+			std::remove(checkpointPath.c_str());
+		}
+
+		TEST_METHOD(AdaptiveSamplingMovesSamplesFromSkyToGround)
+		{
+			DiffuseMaterial material("diffuse", Vec3(0.8f, 0.5f, 0.5f), 0.8f);
+			HitableList world;
+			world.AddSphere(Vec3(0.0f, -100.5f, 2.0f), 100.0f, &material);
+
+			RenderSettings settings;
+			settings.width = 32;
+			settings.height = 32;
+			settings.tileSize = 8;
+			settings.sampleCount = 16;
+			settings.adaptiveThreshold = SUGGESTED_ADAPTIVE_THRESHOLD;
+			Camera camera(Vec3(), settings.width, settings.height, 40.0f);
+			Renderer renderer(&world, camera, settings);
+			ThreadPool pool(2);
+
+			AccumulationBuffer accumulation(settings);
+			renderer.RenderProgressive(pool, accumulation, settings.sampleCount, nullptr);
+
+			// The top half only sees the sky, which has no variance at all;
+			// the samples it didn't need went to the ground
+			int mostSamples = 0;
+			for (int y = 0; y < settings.height; ++y)
+			{
+				for (int x = 0; x < settings.width; ++x)
+				{
+					int samplesTaken = accumulation.At(x, y).samplesTaken;
+					mostSamples = std::max(mostSamples, samplesTaken);
+					if (y < settings.height / 2)
+					{
+						Assert::AreEqual(renderer.MinSamplesPerPixel(), samplesTaken);
+					}
+				}
+			}
+
+			Assert::IsTrue(mostSamples > settings.sampleCount);
+
+			// Going over the budget by at most one pass of one tile
+			uint64_t budget = (uint64_t)settings.width * settings.height * settings.sampleCount;
+			Assert::IsTrue(accumulation.TotalSamples() <= budget + settings.tileSize * settings.tileSize * ADAPTIVE_PASS_SAMPLES);
+		}
+
+		TEST_METHOD(BVHMatchesLinearRaycast)
+		{
+			HitableList linear;
+			HitableList accelerated;
+			Pcg32 rng(7u, 1u);
+
+			for (int i = 0; i < 300; ++i)
+			{
+				Vec3 a(rng.NextFloat() * 10.0f - 5.0f, rng.NextFloat() * 10.0f - 5.0f, rng.NextFloat() * 10.0f + 2.0f);
+				Vec3 b = a + Vec3(rng.NextFloat(), rng.NextFloat(), rng.NextFloat() - 0.5f);
+				Vec3 c = a + Vec3(rng.NextFloat(), -rng.NextFloat(), rng.NextFloat() - 0.5f);
+
+				linear.AddTriangle(a, b, c, nullptr);
+				accelerated.AddTriangle(a, b, c, nullptr);
+
+				if (i % 10 == 0)
+				{
+					float radius = rng.NextFloat() * 0.5f;
+					linear.AddSphere(a, radius, nullptr);
+					accelerated.AddSphere(a, radius, nullptr);
+				}
+			}
+
+			accelerated.BuildAccelerationStructure();
+			Assert::IsTrue(accelerated.HasAccelerationStructure());
+			Assert::AreEqual(linear.Count(), accelerated.Count());
+
+			for (int i = 0; i < 2000; ++i)
+			{
+				Ray ray(Vec3(), Vec3(rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f, 1.0f));
+				HitInfo linearHit;
+				HitInfo acceleratedHit;
+
+				bool isLinearHit = linear.Raycast(ray, OUT linearHit);
+				bool isAcceleratedHit = accelerated.Raycast(ray, OUT acceleratedHit);
+
+				Assert::AreEqual(isLinearHit, isAcceleratedHit);
+				if (isLinearHit)
+				{
+					Assert::AreEqual(linearHit.distance, acceleratedHit.distance, 0.0001f);
+				}
+			}
+		}
+
+		TEST_METHOD(HitableListMatchesStandaloneHitables)
+		{
+			DiffuseMaterial red("red", Vec3(1.0f, 0.0f, 0.0f), 0.5f);
+			DiffuseMaterial blue("blue", Vec3(0.0f, 0.0f, 1.0f), 0.5f);
+
+			auto sphere = Sphere(Vec3(0.0f, 0.0f, 4.0f), 1.0f, &red);
+			auto tri = Triangle(Vec3(-1.0f, -1.0f, 2.0f), Vec3(0.0f, 1.0f, 2.0f), Vec3(1.0f, -1.0f, 2.0f), &blue);
+
+			HitableList hl;
+			hl.AddSphere(sphere.Origin(), sphere.Radius(), &red);
+			hl.AddTriangle(tri.A(), tri.B(), tri.C(), &blue);
+			Assert::IsTrue(hl.Spheres().Count() == 1);
+			Assert::IsTrue(hl.Triangles().Count() == 1);
+
+			Ray throughTriangle(Vec3(), Vec3::Forward());
+			HitInfo expected;
+			HitInfo actual;
+			Assert::IsTrue(tri.Raycast(throughTriangle, OUT expected));
+			Assert::IsTrue(hl.Raycast(throughTriangle, OUT actual));
+			Assert::IsTrue(actual.point == expected.point);
+			Assert::IsTrue(actual.normal == expected.normal);
+			Assert::IsTrue(actual.materialPtr == &blue);
+
+			Ray pastTriangle(Vec3(0.5f, 0.5f, 0.0f), Vec3::Forward());
+			Assert::IsTrue(sphere.Raycast(pastTriangle, OUT expected));
+			Assert::IsTrue(hl.Raycast(pastTriangle, OUT actual));
+			Assert::IsTrue(actual.point == expected.point);
+			Assert::IsTrue(actual.normal == expected.normal);
+			Assert::IsTrue(actual.materialPtr == &red);
+		}
+
+		TEST_METHOD(InstancesMatchTransformedTriangles)
+		{
+			DiffuseMaterial red("red", Vec3(1.0f, 0.0f, 0.0f), 0.5f);
+			DiffuseMaterial blue("blue", Vec3(0.0f, 0.0f, 1.0f), 0.5f);
+			Pcg32 rng(11u, 3u);
+
+			Mesh mesh("blob");
+			for (int i = 0; i < 60; ++i)
+			{
+				Vec3 a(rng.NextFloat() * 2.0f - 1.0f, rng.NextFloat() * 2.0f - 1.0f, rng.NextFloat() * 2.0f - 1.0f);
+				mesh.AddVertex(a);
+				mesh.AddVertex(a + Vec3(rng.NextFloat(), rng.NextFloat(), rng.NextFloat() - 0.5f) * 0.5f);
+				mesh.AddVertex(a + Vec3(rng.NextFloat(), -rng.NextFloat(), rng.NextFloat() - 0.5f) * 0.5f);
+				mesh.AddTriangle(3 * i, 3 * i + 1, 3 * i + 2);
+			}
+
+			Transform placements[] = {
+				Transform::Translation(Vec3(-2.0f, 0.0f, 6.0f)) * Transform::RotationY(0.7f),
+				Transform::Translation(Vec3(2.0f, 0.5f, 7.0f)) * Transform::RotationX(-1.1f) * Transform::Scale(Vec3(1.5f, 0.5f, 1.0f)),
+				Transform::Translation(Vec3(0.0f, -1.0f, 9.0f)) * Transform::RotationZ(2.0f),
+			};
+
+			HitableList copied;
+			HitableList instanced;
+			for (int p = 0; p < 3; ++p)
+			{
+				AMaterial* material = p == 1 ? &blue : &red;
+				const auto& vertices = mesh.Vertices();
+				const auto& indices = mesh.Indices();
+				for (size_t i = 0; i < indices.size(); i += 3)
+				{
+					copied.AddTriangle(placements[p].TransformPoint(vertices[indices[i]]),
+									   placements[p].TransformPoint(vertices[indices[i + 1]]),
+									   placements[p].TransformPoint(vertices[indices[i + 2]]), material);
+				}
+
+				instanced.AddInstance(&mesh, material, placements[p]);
+			}
+
+			Assert::AreEqual(3, instanced.InstanceCount());
+
+			// Without and then with the top level BVH
+			for (int pass = 0; pass < 2; ++pass)
+			{
+				for (int i = 0; i < 2000; ++i)
+				{
+					Ray ray(Vec3(), Vec3(rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f, 1.0f));
+					HitInfo expected;
+					HitInfo actual;
+					expected.ignoreBackFaces = actual.ignoreBackFaces = false;
+
+					bool isExpectedHit = copied.Raycast(ray, OUT expected);
+					bool isActualHit = instanced.Raycast(ray, OUT actual);
+
+					Assert::AreEqual(isExpectedHit, isActualHit);
+					if (isExpectedHit)
+					{
+						Assert::AreEqual(expected.distance, actual.distance, 0.0001f);
+						Assert::IsTrue(expected.normal.Dot(actual.normal) > 0.9999f);
+						Assert::IsTrue(expected.materialPtr == actual.materialPtr);
+					}
+				}
+
+				instanced.BuildAccelerationStructure();
+			}
+
+			// Memory grows with the number of placements, not with the
+			// number of triangles placed
+			size_t footprint = instanced.MemoryFootprint();
+			for (int i = 0; i < 100; ++i)
+			{
+				instanced.AddInstance(&mesh, &red, Transform::Translation(Vec3((float)i, 0.0f, 20.0f)));
+			}
+
+			instanced.BuildAccelerationStructure();
+			Assert::IsTrue(instanced.MemoryFootprint() - footprint < 100 * mesh.GetBVH().MemoryFootprint() / 10);
+		}
+
+		TEST_METHOD(MaterialsPastTheIndexRangeAreRefused)
+		{
+			std::deque<DiffuseMaterial> materials;
+			HitableList world;
+			for (int i = 0; i < MAX_MATERIAL_COUNT; ++i)
+			{
+				materials.emplace_back("diffuse", Vec3(0.5f, 0.5f, 0.5f), 0.5f);
+				world.AddSphere(Vec3((float)i, 0.0f, 2.0f), 0.1f, &materials.back());
+			}
+
+			// Materials the scene already has can still be used
+			world.AddSphere(Vec3(0.0f, 1.0f, 2.0f), 0.1f, &materials.front());
+			materials.emplace_back("one too many", Vec3(0.5f, 0.5f, 0.5f), 0.5f);
+
+			bool isThrown = false;
+			try
+			{
+				world.AddSphere(Vec3(0.0f, 2.0f, 2.0f), 0.1f, &materials.back());
+			}
+			catch (const std::length_error&)
+			{
+				isThrown = true;
+			}
+
+			Assert::IsTrue(isThrown);
+			Assert::AreEqual(MAX_MATERIAL_COUNT + 1, world.Count());
+		}
+
+		TEST_METHOD(ChangedMeshIsPickedUpByTheNextBuild)
+		{
+			DiffuseMaterial material("diffuse", Vec3(0.5f, 0.5f, 0.5f), 0.5f);
+			Mesh mesh("quad");
+			mesh.AddVertex(Vec3(-0.5f, -0.5f, 0.0f));
+			mesh.AddVertex(Vec3(-0.5f, 0.5f, 0.0f));
+			mesh.AddVertex(Vec3(0.5f, 0.5f, 0.0f));
+			mesh.AddVertex(Vec3(0.5f, -0.5f, 0.0f));
+			mesh.AddTriangle(0, 1, 2);
+			mesh.AddTriangle(0, 2, 3);
+
+			HitableList world;
+			world.AddInstance(&mesh, &material, Transform::Translation(Vec3(0.0f, 0.0f, 4.0f)));
+			world.BuildAccelerationStructure();
+
+			HitInfo hit;
+			Ray ray(Vec3(), Vec3(0.0f, 0.0f, 1.0f));
+			Assert::IsTrue(world.Raycast(ray, OUT hit));
+			Assert::AreEqual(4.0f, hit.point.z(), 0.0001f);
+
+			// Pushed back one unit, after it was placed
+			for (int i = 0; i < 4; ++i)
+			{
+				mesh.SetVertex(i, mesh.Vertices()[i] + Vec3(0.0f, 0.0f, 1.0f));
+			}
+
+			world.BuildAccelerationStructure();
+			Assert::IsTrue(world.Raycast(ray, OUT hit));
+			Assert::AreEqual(5.0f, hit.point.z(), 0.0001f);
+		}
+
+		TEST_METHOD(OcclusionAndRangeQueriesMatchClosestHit)
+		{
+			Pcg32 rng(5u, 9u);
+			Mesh mesh("quad");
+			mesh.AddVertex(Vec3(-0.5f, -0.5f, 0.0f));
+			mesh.AddVertex(Vec3(-0.5f, 0.5f, 0.0f));
+			mesh.AddVertex(Vec3(0.5f, 0.5f, 0.0f));
+			mesh.AddVertex(Vec3(0.5f, -0.5f, 0.0f));
+			mesh.AddTriangle(0, 1, 2);
+			mesh.AddTriangle(0, 2, 3);
+
+			HitableList world;
+			for (int i = 0; i < 100; ++i)
+			{
+				Vec3 a(rng.NextFloat() * 10.0f - 5.0f, rng.NextFloat() * 10.0f - 5.0f, rng.NextFloat() * 10.0f + 2.0f);
+				world.AddTriangle(a, a + Vec3(rng.NextFloat(), rng.NextFloat(), 0.0f), a + Vec3(rng.NextFloat(), -rng.NextFloat(), 0.0f), nullptr);
+				if (i % 5 == 0)
+				{
+					world.AddSphere(a + Vec3(0.0f, 0.0f, 1.0f), rng.NextFloat() * 0.5f, nullptr);
+					world.AddInstance(&mesh, nullptr, Transform::Translation(a + Vec3(0.5f, 0.0f, 2.0f)) * Transform::RotationY(rng.NextFloat()));
+				}
+			}
+
+			// Without and then with the BVHs
+			for (int pass = 0; pass < 2; ++pass)
+			{
+				for (int i = 0; i < 2000; ++i)
+				{
+					Ray ray(Vec3(), Vec3(rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f, 1.0f));
+					float tMin = rng.NextFloat() * 8.0f;
+					float tMax = tMin + rng.NextFloat() * 8.0f;
+
+					HitInfo closest;
+					bool isHit = world.Raycast(ray, OUT closest);
+					Assert::AreEqual(isHit && closest.distance < tMax, world.Occluded(ray, tMax));
+
+					HitInfo ranged;
+					bool isRangedHit = world.Raycast(ray, tMin, tMax, OUT ranged);
+					if (isRangedHit)
+					{
+						Assert::IsTrue(ranged.distance > tMin && ranged.distance < tMax);
+					}
+
+					if (isHit && closest.distance > tMin + 0.001f && closest.distance < tMax)
+					{
+						Assert::IsTrue(isRangedHit);
+						Assert::AreEqual(closest.distance, ranged.distance, 0.001f);
+					}
+				}
+
+				world.BuildAccelerationStructure();
+			}
+		}
+
+		TEST_METHOD(ArenaPacksObjectsAndDestroysThemOnClear)
+		{
+			struct Counted
+			{
+				Counted(std::vector<int>* log, int id) : log{ log }, id{ id } {}
+				~Counted() { log->push_back(id); }
+				std::vector<int>* log;
+				int id;
+			};
+
+			std::vector<int> destroyed;
+			Arena arena(1024);
+
+			Counted* first = arena.New<Counted>(&destroyed, 1);
+			Counted* second = arena.New<Counted>(&destroyed, 2);
+			Vec3* point = arena.New<Vec3>(1.0f, 2.0f, 3.0f);
+			Assert::IsTrue((char*)second > (char*)first && (char*)second - (char*)first < 64);
+			Assert::AreEqual(2.0f, point->y());
+
+			for (int alignment = 1; alignment <= (int)Arena::BLOCK_ALIGNMENT; alignment *= 2)
+			{
+				void* memory = arena.Allocate(3, alignment);
+				Assert::IsTrue((uintptr_t)memory % alignment == 0);
+			}
+
+			// Too big to share a block
+			arena.Allocate(4096);
+			Assert::AreEqual((size_t)2, arena.BlockCount());
+			Assert::IsTrue(arena.BytesUsed() >= 4096 + 2 * sizeof(Counted) + sizeof(Vec3));
+
+			arena.Clear();
+			Assert::AreEqual(2, (int)destroyed.size());
+			Assert::IsTrue(destroyed[0] == 2 && destroyed[1] == 1);
+			Assert::AreEqual((size_t)0, arena.BlockCount());
+		}
+
+		TEST_METHOD(TessellatedBlobIsClosedAndFacesOutward)
+		{
+			Mesh mesh("blob");
+			TessellateBlob(&mesh, 1000, 0.2f, 4.0f);
+
+			// 16 rings: 4 * 16 * 15 triangles
+			Assert::AreEqual(960, mesh.TriangleCount());
+
+			HitableList world;
+			world.AddInstance(&mesh, nullptr, Transform::Translation(Vec3(0.0f, 0.0f, 5.0f)));
+			world.BuildAccelerationStructure();
+
+			// From outside every ray towards the middle hits a front face, and
+			// from the middle every ray hits a back face
+			Pcg32 rng(2u, 4u);
+			for (int i = 0; i < 500; ++i)
+			{
+				Vec3 direction(rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f);
+				direction.Normalize();
+				Vec3 center(0.0f, 0.0f, 5.0f);
+
+				HitInfo outside;
+				Assert::IsTrue(world.Raycast(Ray(center + direction * 3.0f, -direction), OUT outside));
+				Assert::IsTrue(outside.normal.Dot(direction) > 0.0f);
+
+				HitInfo inside;
+				Assert::IsFalse(world.Raycast(Ray(center, direction), OUT inside));
+				inside.ignoreBackFaces = false;
+				Assert::IsTrue(world.Raycast(Ray(center, direction), OUT inside));
+			}
+		}
+
+		TEST_METHOD(GeneratedSceneDependsOnlyOnSeed)
+		{
+			SceneParameters parameters;
+			parameters.sphereCount = 50;
+			parameters.meshCount = 2;
+			parameters.meshTriangleCount = 200;
+			parameters.instanceCount = 10;
+			parameters.clusterCount = 3;
+
+			MaterialStorage materials[3];
+			MeshStorage meshes[3];
+			SceneStatistics statistics;
+			auto first = GenerateScene(parameters, &materials[0], &meshes[0], OUT &statistics);
+			auto second = GenerateScene(parameters, &materials[1], &meshes[1]);
+			parameters.seed = 2;
+			auto other = GenerateScene(parameters, &materials[2], &meshes[2]);
+
+			Assert::AreEqual(50, statistics.sphereCount);
+			Assert::AreEqual(10, statistics.instanceCount);
+			Assert::IsTrue(statistics.instancedTriangleCount == 5 * statistics.uniqueTriangleCount);
+
+			Camera camera = MakeCamera(40, 25);
+			int differenceCount = 0;
+			for (int y = 0; y < 25; ++y)
+			{
+				for (int x = 0; x < 40; ++x)
+				{
+					Ray ray = camera.GetRay((x + 0.5f) / 40, (y + 0.5f) / 25);
+					HitInfo a;
+					HitInfo b;
+					HitInfo c;
+					bool isHit = first->Raycast(ray, OUT a);
+					Assert::AreEqual(isHit, second->Raycast(ray, OUT b));
+					if (isHit)
+					{
+						Assert::AreEqual(a.distance, b.distance);
+						Assert::IsTrue(a.materialPtr->name == b.materialPtr->name);
+					}
+
+					differenceCount += isHit != other->Raycast(ray, OUT c) ? 1 : 0;
+				}
+			}
+
+			Assert::IsTrue(differenceCount > 0);
+		}
+
+		TEST_METHOD(SIMDTriangleKernelMatchesScalar)
+		{
+			TriangleStore store;
+			std::vector<Triangle> reference;
+			Pcg32 rng(11u, 3u);
+
+			for (int i = 0; i < 61; ++i)
+			{
+				Vec3 a(rng.NextFloat() * 4.0f - 2.0f, rng.NextFloat() * 4.0f - 2.0f, rng.NextFloat() * 4.0f + 1.0f);
+				Vec3 b = a + Vec3(rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f);
+				Vec3 c = a + Vec3(rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f);
+
+				store.Add(a, b, c, 0);
+				reference.push_back(Triangle(a, b, c, nullptr));
+			}
+
+			int hitCount = 0;
+			for (int r = 0; r < 500; ++r)
+			{
+				Ray ray(Vec3(), Vec3(rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f, 1.0f));
+				bool ignoreBackFaces = r % 2 == 0;
+				int first = r % 7;
+				int count = 1 + r % (store.Count() - first);
+
+				float simdDistance = FLT_MAX;
+				float scalarDistance = FLT_MAX;
+				int simdIndex = store.IntersectRange(first, count, ray, ignoreBackFaces, simdDistance);
+				int scalarIndex = store.IntersectRangeScalar(first, count, ray, ignoreBackFaces, scalarDistance);
+
+				int referenceIndex = -1;
+				float referenceDistance = FLT_MAX;
+				for (int i = first; i < first + count; ++i)
+				{
+					HitInfo hit;
+					hit.ignoreBackFaces = ignoreBackFaces;
+					if (reference[i].Raycast(ray, OUT hit) && hit.distance < referenceDistance)
+					{
+						referenceDistance = hit.distance;
+						referenceIndex = i;
+					}
+				}
+
+				Assert::AreEqual(referenceIndex, scalarIndex);
+				Assert::AreEqual(referenceIndex, simdIndex);
+				if (referenceIndex >= 0)
+				{
+					hitCount++;
+					Assert::AreEqual(referenceDistance, scalarDistance, 0.0001f);
+					Assert::AreEqual(referenceDistance, simdDistance, 0.0001f);
+				}
+			}
+
+			Assert::IsTrue(hitCount > 0);
+		}
+
+		TEST_METHOD(SIMDSphereKernelMatchesScalar)
+		{
+			SphereStore store;
+			std::vector<Sphere> reference;
+			Pcg32 rng(13u, 5u);
+
+			for (int i = 0; i < 45; ++i)
+			{
+				Vec3 origin(rng.NextFloat() * 6.0f - 3.0f, rng.NextFloat() * 6.0f - 3.0f, rng.NextFloat() * 6.0f - 1.0f);
+				float radius = 0.1f + rng.NextFloat() * 0.6f;
+
+				store.Add(origin, radius, 0);
+				reference.push_back(Sphere(origin, radius, nullptr));
+			}
+
+			// Some rays start inside a sphere, for the back face test
+			int hitCount = 0;
+			for (int r = 0; r < 500; ++r)
+			{
+				Vec3 start = r % 5 == 0 ? store.Origin(r % store.Count()) : Vec3();
+				Ray ray(start, Vec3(rng.NextFloat() - 0.5f, rng.NextFloat() - 0.5f, 1.0f));
+				bool ignoreBackFaces = r % 2 == 0;
+				int first = r % 7;
+				int count = 1 + r % (store.Count() - first);
+
+				float simdDistance = FLT_MAX;
+				float scalarDistance = FLT_MAX;
+				int simdIndex = store.IntersectRange(first, count, ray, ignoreBackFaces, simdDistance);
+				int scalarIndex = store.IntersectRangeScalar(first, count, ray, ignoreBackFaces, scalarDistance);
+
+				int referenceIndex = -1;
+				float referenceDistance = FLT_MAX;
+				for (int i = first; i < first + count; ++i)
+				{
+					HitInfo hit;
+					hit.ignoreBackFaces = ignoreBackFaces;
+					if (reference[i].Raycast(ray, OUT hit) && hit.distance < referenceDistance)
+					{
+						referenceDistance = hit.distance;
+						referenceIndex = i;
+					}
+				}
+
+				Assert::AreEqual(referenceIndex, scalarIndex);
+				Assert::AreEqual(referenceIndex, simdIndex);
+				if (referenceIndex >= 0)
+				{
+					hitCount++;
+					Assert::AreEqual(referenceDistance, scalarDistance, 0.0001f);
+					Assert::AreEqual(referenceDistance, simdDistance, 0.0001f);
+				}
+			}
+
+			Assert::IsTrue(hitCount > 0);
+		}
+
+		TEST_METHOD(RenderStatsMergeMaterialsByName)
+		{
+			RenderStats a;
+			a.primaryRays = 10;
+			a.pathDepths[3] = 2;
+			a.materials.push_back(MaterialStats{ "red", 5, 1 });
+
+			RenderStats b;
+			b.primaryRays = 20;
+			b.pathDepths[3] = 1;
+			b.materials.push_back(MaterialStats{ "blue", 2, 0 });
+			b.materials.push_back(MaterialStats{ "red", 3, 3 });
+
+			a.Add(b);
+			Assert::IsTrue(a.primaryRays == 30 && a.pathDepths[3] == 3);
+			Assert::AreEqual(2, (int)a.materials.size());
+			Assert::IsTrue(a.materials[0].scatterCount == 8 && a.materials[0].absorbCount == 4);
+
+			std::ostringstream json;
+			a.WriteJson(json);
+			Assert::IsTrue(json.str().find("{\"name\": \"blue\", \"scattered\": 2, \"absorbed\": 0}") != std::string::npos);
+		}
+
+		// Only counts anything in builds with RT_STATS; otherwise checks that
+		// nothing is counted
+		TEST_METHOD(RenderStatsCountEveryPath)
+		{
+			DiffuseMaterial diffuse("diffuse", Vec3(0.8f, 0.5f, 0.5f), 0.8f);
+			HitableList world;
+			world.AddSphere(Vec3(0.0f, 0.0f, 2.0f), 0.5f, &diffuse);
+			world.AddSphere(Vec3(0.0f, -100.5f, 2.0f), 100.0f, &diffuse);
+			world.BuildAccelerationStructure();
+
+			RenderSettings settings;
+			settings.width = 24;
+			settings.height = 16;
+			settings.sampleCount = 4;
+			settings.maxDepth = 4;
+			settings.adaptiveThreshold = 0.0f;
+			Camera camera(Vec3(), settings.width, settings.height, 40.0f);
+			ThreadPool pool(2);
+
+			for (int mode = 0; mode < 3; ++mode)
+			{
+				settings.usePackets = mode == 1;
+				settings.useWavefront = mode == 2;
+
+				Stats::Reset();
+				Framebuffer framebuffer(settings.width, settings.height);
+				Renderer(&world, camera, settings).Render(pool, framebuffer);
+				RenderStats stats = Stats::Collect();
+
+				int64_t histogramTotal = 0;
+				for (int depth = 0; depth <= STATS_MAX_DEPTH; ++depth)
+				{
+					histogramTotal += stats.pathDepths[depth];
+				}
+
+				Assert::IsTrue(histogramTotal == stats.PathCount());
+#ifdef RT_STATS
+				int64_t sampleCount = settings.width * settings.height * settings.sampleCount;
+				Assert::IsTrue(stats.samplesTaken == sampleCount);
+				Assert::IsTrue(stats.primaryRays == sampleCount);
+				Assert::IsTrue(stats.PathCount() == sampleCount);
+				Assert::IsTrue(stats.pathsTruncated == stats.pathDepths[settings.maxDepth]);
+				Assert::IsTrue(stats.sphereHits > 0 && stats.sphereTests >= stats.sphereHits);
+				Assert::AreEqual(1, (int)stats.materials.size());
+				Assert::IsTrue(stats.materials[0].scatterCount == stats.secondaryRays + stats.pathsTruncated + stats.pathsRouletted);
+#else
+				Assert::IsTrue(stats.PathCount() == 0 && stats.primaryRays == 0);
+#endif
+			}
+		}
+
+		// A dark, deep scene where most paths lose their energy long before
+		// maxDepth; roulette must leave the average brightness where it was
+		TEST_METHOD(RussianRouletteKeepsTheMean)
+		{
+			DiffuseMaterial diffuse("diffuse", Vec3(0.5f, 0.5f, 0.5f), 0.9f);
+			HitableList world;
+			world.AddSphere(Vec3(0.0f, 0.0f, 2.0f), 0.5f, &diffuse);
+			world.AddSphere(Vec3(0.0f, -100.5f, 2.0f), 100.0f, &diffuse);
+			world.BuildAccelerationStructure();
+
+			RenderSettings settings;
+			settings.width = 16;
+			settings.height = 16;
+			settings.sampleCount = 512;
+			settings.maxDepth = 32;
+			settings.adaptiveThreshold = 0.0f;
+			Camera camera(Vec3(), settings.width, settings.height, 40.0f);
+			ThreadPool pool(2);
+
+			auto renderMean = [&](int rouletteDepth, double& pathLength)
+			{
+				settings.rouletteDepth = rouletteDepth;
+				Stats::Reset();
+				Framebuffer framebuffer(settings.width, settings.height);
+				Renderer(&world, camera, settings).Render(pool, framebuffer);
+				pathLength = Stats::Collect().AveragePathLength();
+
+				double sum = 0.0;
+				for (int y = 0; y < settings.height; ++y)
+				{
+					for (int x = 0; x < settings.width; ++x)
+					{
+						Vec3 color = framebuffer.Get(x, y);
+						sum += color.x() + color.y() + color.z();
+					}
+				}
+
+				return sum / (3.0 * settings.width * settings.height);
+			};
+
+			double fullLength;
+			double rouletteLength;
+			double fullMean = renderMean(0, fullLength);
+			double rouletteMean = renderMean(2, rouletteLength);
+
+			Assert::AreEqual(fullMean, rouletteMean, 0.01 * fullMean);
+#ifdef RT_STATS
+			Assert::IsTrue(rouletteLength < fullLength);
+#endif
+		}
+
+		TEST_METHOD(CostMapCoversEveryPixel)
+		{
+			CostMap spread(4, 4);
+			PixelCost cost;
+			cost.rays = 8.0f;
+			cost.depthSum = 6.0f;
+			cost.pathCount = 4.0f;
+			spread.Add(0, 2, 4, 2, cost);
+			Assert::AreEqual(0.0f, spread.At(3, 1).rays);
+			Assert::AreEqual(1.0f, spread.At(3, 2).rays);
+			Assert::AreEqual(1.5f, spread.At(0, 3).Get(CostChannel::Depth));
+
+			DiffuseMaterial diffuse("diffuse", Vec3(0.8f, 0.5f, 0.5f), 0.8f);
+			HitableList world;
+			world.AddSphere(Vec3(0.0f, 0.0f, 2.0f), 0.5f, &diffuse);
+			world.BuildAccelerationStructure();
+
+			RenderSettings settings;
+			settings.width = 20;
+			settings.height = 12;
+			settings.sampleCount = 2;
+			settings.tileSize = 8;
+			Camera camera(Vec3(), settings.width, settings.height, 40.0f);
+			ThreadPool pool(2);
+
+			for (int mode = 0; mode < 2; ++mode)
+			{
+				settings.usePackets = mode == 1;
+				CostMap costMap(settings.width, settings.height);
+				Framebuffer framebuffer(settings.width, settings.height);
+				Renderer renderer(&world, camera, settings);
+				renderer.SetCostMap(&costMap);
+				renderer.Render(pool, framebuffer);
+
+				for (int y = 0; y < settings.height; ++y)
+				{
+					for (int x = 0; x < settings.width; ++x)
+					{
+						Assert::IsTrue(costMap.At(x, y).seconds > 0.0f);
+#ifdef RT_STATS
+						Assert::IsTrue(costMap.At(x, y).rays >= 1.0f);
+#endif
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(TraceRecordsTilesPerWorker)
+		{
+			auto countOf = [](const std::string& text, const std::string& pattern)
+			{
+				int count = 0;
+				for (size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + 1))
+				{
+					count++;
+				}
+
+				return count;
+			};
+
+			DiffuseMaterial diffuse("diffuse", Vec3(0.8f, 0.5f, 0.5f), 0.8f);
+			HitableList world;
+			world.AddSphere(Vec3(0.0f, 0.0f, 2.0f), 0.5f, &diffuse);
+
+			RenderSettings settings;
+			settings.width = 32;
+			settings.height = 16;
+			settings.sampleCount = 2;
+			settings.tileSize = 8;
+			ThreadPool pool(2);
+
+			Trace::Enable();
+			world.BuildAccelerationStructure();
+			Framebuffer framebuffer(settings.width, settings.height);
+			Renderer(&world, Camera(Vec3(), settings.width, settings.height, 40.0f), settings).Render(pool, framebuffer);
+
+			// More spans than a buffer holds: only the latest are kept
+			std::thread filler([]
+			{
+				for (int i = 0; i < TRACE_BUFFER_SIZE + 10; ++i)
+				{
+					TraceScope scope("filler", "test");
+				}
+			});
+			filler.join();
+
+			Trace::Disable();
+			{
+				TraceScope scope("after", "test");
+			}
+
+			std::ostringstream json;
+			Trace::WriteChromeTrace(json);
+			std::string trace = json.str();
+
+			Assert::AreEqual(8, countOf(trace, "\"name\": \"tile\""));
+			Assert::AreEqual(1, countOf(trace, "\"name\": \"build BVH\""));
+			Assert::AreEqual(TRACE_BUFFER_SIZE, countOf(trace, "\"name\": \"filler\""));
+			Assert::AreEqual(0, countOf(trace, "\"name\": \"after\""));
+			Assert::IsTrue(countOf(trace, "\"name\": \"worker ") > 0);
+			Assert::AreEqual(1, countOf(trace, "\"args\": {\"x\": 24, \"y\": 8, \"endSample\": 2}"));
+		}
+
+		TEST_METHOD(TraceKeepsExitedThreadsSpansUntilEnabledAgain)
+		{
+			Trace::Enable();
+			std::thread([]
+			{
+				Trace::SetThreadName("short lived");
+				TraceEvent event = {};
+				event.name = "early";
+				event.category = "test";
+				event.startNanoseconds = -1500;
+				event.durationNanoseconds = 2000;
+				Trace::Record(event);
+			}).join();
+			Trace::Disable();
+
+			std::ostringstream before;
+			Trace::WriteChromeTrace(before);
+			Assert::IsTrue(before.str().find("\"short lived\"") != std::string::npos);
+			Assert::IsTrue(before.str().find("\"ts\": -1.500, \"dur\": 2.000") != std::string::npos);
+
+			Trace::Enable();
+			Trace::Disable();
+			std::ostringstream after;
+			Trace::WriteChromeTrace(after);
+			Assert::IsTrue(after.str().find("\"short lived\"") == std::string::npos);
+		}
+
+		TEST_METHOD(PacketRenderMatchesSingleRayRender)
+		{
+			DiffuseMaterial material("diffuse", Vec3(0.8f, 0.5f, 0.5f), 0.8f);
+			HitableList world;
+			world.AddSphere(Vec3(0.0f, 0.0f, 2.0f), 0.5f, &material);
+			world.AddSphere(Vec3(0.0f, -100.5f, 2.0f), 100.0f, &material);
+			world.AddTriangle(Vec3(-1.0f, -0.5f, 3.0f), Vec3(-0.5f, 0.5f, 3.0f), Vec3(0.0f, -0.5f, 3.0f), &material);
+			world.BuildAccelerationStructure();
+
+			RenderSettings settings;
+			settings.width = 37;
+			settings.height = 21;
+			settings.sampleCount = 4;
+			settings.tileSize = 12;
+			Camera camera(Vec3(), settings.width, settings.height, 40.0f);
+			ThreadPool pool(2);
+
+			for (SamplerType type : { SamplerType::Random, SamplerType::Sobol })
+			{
+				settings.samplerType = type;
+				settings.usePackets = false;
+				Framebuffer singleRays(settings.width, settings.height);
+				Renderer(&world, camera, settings).Render(pool, singleRays);
+
+				settings.usePackets = true;
+				Framebuffer packets(settings.width, settings.height);
+				Renderer(&world, camera, settings).Render(pool, packets);
+
+				for (int y = 0; y < settings.height; ++y)
+				{
+					for (int x = 0; x < settings.width; ++x)
+					{
+						Assert::IsTrue(singleRays.Get(x, y) == packets.Get(x, y));
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(WavefrontRenderMatchesRecursiveRender)
+		{
+			DiffuseMaterial diffuse("diffuse", Vec3(0.8f, 0.5f, 0.5f), 0.8f);
+			MetallicMaterial metallic("metallic", Vec3(0.5f, 0.5f, 0.8f));
+			HitableList world;
+			world.AddSphere(Vec3(-0.5f, 0.0f, 2.0f), 0.5f, &metallic);
+			world.AddSphere(Vec3(0.5f, 0.0f, 2.0f), 0.5f, &diffuse);
+			world.AddSphere(Vec3(0.0f, -100.5f, 2.0f), 100.0f, &diffuse);
+			world.BuildAccelerationStructure();
+
+			RenderSettings settings;
+			settings.width = 30;
+			settings.height = 20;
+			settings.sampleCount = 8;
+			settings.maxDepth = 6;
+			Camera camera(Vec3(), settings.width, settings.height, 40.0f);
+			ThreadPool pool(2);
+
+			Framebuffer recursive(settings.width, settings.height);
+			Renderer(&world, camera, settings).Render(pool, recursive);
+
+			settings.useWavefront = true;
+			Framebuffer wavefront(settings.width, settings.height);
+			Renderer(&world, camera, settings).Render(pool, wavefront);
+
+			// Same paths, same random numbers; only the order in which the
+			// attenuations are multiplied differs
+			for (int y = 0; y < settings.height; ++y)
+			{
+				for (int x = 0; x < settings.width; ++x)
+				{
+					Assert::AreEqual(recursive.Get(x, y).x(), wavefront.Get(x, y).x(), 0.0001f);
+					Assert::AreEqual(recursive.Get(x, y).y(), wavefront.Get(x, y).y(), 0.0001f);
+					Assert::AreEqual(recursive.Get(x, y).z(), wavefront.Get(x, y).z(), 0.0001f);
+				}
+			}
+		}
+
+		TEST_METHOD(DistributedRenderMatchesSingleProcessRender)
+		{
+			RenderSettings settings;
+			settings.width = 48;
+			settings.height = 32;
+			settings.tileSize = 8;
+			settings.sampleCount = 8;
+			settings.adaptiveThreshold = 0.05f;
+			settings.seed = 7u;
+			SceneParameters scene;
+			const int PASS_SAMPLE_COUNT = 2;
+			const std::string checkpointPath = "DistributedRenderMatchesSingleProcessRender.bin";
+
+			MaterialStorage materials;
+			MeshStorage meshes;
+			auto world = BuildWorld(scene, &materials, &meshes);
+			Camera camera = MakeCamera(settings.width, settings.height);
+			ThreadPool pool(2);
+
+			// Checkpointed half way, for the resumed render below
+			AccumulationBuffer single(settings);
+			int passCount = 0;
+			Renderer(world.get(), camera, settings).RenderProgressive(pool, single, PASS_SAMPLE_COUNT, [&](const AccumulationBuffer& buffer)
+			{
+				if (++passCount == 2)
+				{
+					Assert::IsTrue(buffer.SaveCheckpoint(checkpointPath));
+				}
+			});
+
+			// Three workers in threads of this process; one of them drops out
+			// after three tiles
+			Coordinator coordinator(settings, scene);
+			Assert::IsTrue(coordinator.Listen(0, false));
+			int port = coordinator.Port();
+
+			std::vector<std::thread> workers;
+			std::atomic<int> failedCount(0);
+			for (int i = 0; i < 3; ++i)
+			{
+				workers.emplace_back([&, i] { failedCount += RunWorker("127.0.0.1", port, 2, i == 0 ? 3 : -1); });
+			}
+
+			Assert::AreEqual(3, coordinator.WaitForWorkers(3, 10.0));
+
+			AccumulationBuffer distributed(settings);
+			Renderer scheduler(nullptr, camera, settings);
+			Assert::IsTrue(coordinator.RenderProgressive(scheduler, distributed, PASS_SAMPLE_COUNT, nullptr));
+			coordinator.Shutdown();
+
+			for (auto& worker : workers)
+			{
+				worker.join();
+			}
+
+			Assert::AreEqual(1, coordinator.LostWorkerCount());
+			Assert::AreEqual(1, failedCount.load());
+
+			// Resumed from the checkpoint with the seed left at its default,
+			// as after "--resume" without "--seed": the worker has to carry on
+			// with the checkpoint's
+			RenderSettings resumeSettings = settings;
+			resumeSettings.seed = RenderSettings().seed;
+			AccumulationBuffer resumed(resumeSettings);
+			Assert::IsTrue(ResumeFromCheckpoint(checkpointPath, resumed, resumeSettings));
+			std::remove(checkpointPath.c_str());
+
+			Coordinator resumeCoordinator(resumeSettings, scene);
+			Assert::IsTrue(resumeCoordinator.Listen(0, false));
+			int resumePort = resumeCoordinator.Port();
+			std::thread resumeWorker([resumePort] { RunWorker("127.0.0.1", resumePort, 2); });
+			Assert::AreEqual(1, resumeCoordinator.WaitForWorkers(1, 10.0));
+			Renderer resumeScheduler(nullptr, camera, resumeSettings);
+			Assert::IsTrue(resumeCoordinator.RenderProgressive(resumeScheduler, resumed, PASS_SAMPLE_COUNT, nullptr));
+			resumeCoordinator.Shutdown();
+			resumeWorker.join();
+
+			for (int y = 0; y < settings.height; ++y)
+			{
+				for (int x = 0; x < settings.width; ++x)
+				{
+					Assert::AreEqual(single.At(x, y).samplesTaken, distributed.At(x, y).samplesTaken);
+					Assert::IsTrue(single.At(x, y).sum == distributed.At(x, y).sum);
+					Assert::AreEqual(single.At(x, y).samplesTaken, resumed.At(x, y).samplesTaken);
+					Assert::IsTrue(single.At(x, y).sum == resumed.At(x, y).sum);
+				}
+			}
+		}
+
+		TEST_METHOD(WorkerWithATileLongerThanTheTimeoutIsKept)
+		{
+			RenderSettings settings;
+			settings.width = 32;
+			settings.height = 32;
+			settings.tileSize = 32;
+			settings.sampleCount = 2048;
+			SceneParameters scene;
+
+			// The one tile takes far longer than the timeout; only the
+			// heartbeats keep the worker in
+			Coordinator coordinator(settings, scene, 0.05);
+			Assert::IsTrue(coordinator.Listen(0, false));
+			int port = coordinator.Port();
+			std::thread worker([port] { RunWorker("127.0.0.1", port, 1); });
+			Assert::AreEqual(1, coordinator.WaitForWorkers(1, 10.0));
+
+			auto start = std::chrono::steady_clock::now();
+			AccumulationBuffer accumulation(settings);
+			Renderer scheduler(nullptr, MakeCamera(settings.width, settings.height), settings);
+			bool isRendered = coordinator.RenderProgressive(scheduler, accumulation, settings.sampleCount, nullptr);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			coordinator.Shutdown();
+			worker.join();
+
+			Assert::IsTrue(seconds > 0.2);
+			Assert::IsTrue(isRendered);
+			Assert::AreEqual(0, coordinator.LostWorkerCount());
+			Assert::AreEqual(settings.sampleCount, accumulation.At(16, 16).samplesTaken);
+		}
+
+		TEST_METHOD(RenderServerCachesScenesAndPutsUrgentJobsFirst)
+		{
+			RenderSettings settings;
+			settings.tileSize = 8;
+			settings.adaptiveThreshold = 0.0f;
+
+			std::mutex repliesMutex;
+			std::condition_variable repliesCondition;
+			std::vector<std::string> replies;
+			auto reply = [&](const std::string& message)
+			{
+				std::lock_guard<std::mutex> lock(repliesMutex);
+				replies.push_back(message);
+				repliesCondition.notify_all();
+			};
+
+			auto indexOf = [&](const std::string& prefix)
+			{
+				std::lock_guard<std::mutex> lock(repliesMutex);
+				auto found = std::find_if(replies.begin(), replies.end(),
+										  [&](const std::string& message) { return message.compare(0, prefix.size(), prefix) == 0; });
+				return found == replies.end() ? -1 : (int)(found - replies.begin());
+			};
+
+			// One thread, so that the jobs have to take turns
+			RenderServer server(1, settings, SceneParameters());
+			Assert::IsTrue(server.HandleRequest("render --scene demo --width 64 --height 64 --samples 400 --out -", reply));
+			Assert::IsTrue(server.HandleRequest("render --scene demo --width 16 --height 12 --samples 4 --depth 8 --priority 1 --out -", reply));
+			Assert::IsTrue(server.HandleRequest("render --scene nowhere --out -", reply));
+
+			{
+				std::unique_lock<std::mutex> lock(repliesMutex);
+				Assert::IsTrue(repliesCondition.wait_for(lock, std::chrono::seconds(30), [&]
+				{
+					return std::any_of(replies.begin(), replies.end(), [](const std::string& message) { return message.compare(0, 7, "done 2 ") == 0; });
+				}));
+			}
+
+			Assert::IsTrue(server.HandleRequest("cancel 1", reply));
+			Assert::IsFalse(server.HandleRequest("quit", reply));
+			server.Wait();
+
+			Assert::AreEqual(1, server.SceneBuildCount());
+			Assert::IsTrue(indexOf("error - unknown scene") >= 0);
+			Assert::IsTrue(indexOf("scene 2 demo cached") >= 0);
+			Assert::IsTrue(indexOf("cancelled 1") > indexOf("done 2 "));
+			Assert::AreEqual(-1, indexOf("done 1 "));
+
+			// The image that came back is the one a local render gives
+			RenderSettings jobSettings = settings;
+			jobSettings.width = 16;
+			jobSettings.height = 12;
+			jobSettings.sampleCount = 4;
+			jobSettings.maxDepth = 8;
+
+			MaterialStorage materials;
+			MeshStorage meshes;
+			auto world = MakeWorld(&materials, &meshes);
+			ThreadPool pool(2);
+			Framebuffer framebuffer(jobSettings.width, jobSettings.height);
+			Renderer(world.get(), MakeCamera(jobSettings.width, jobSettings.height), jobSettings).Render(pool, framebuffer);
+			auto image = EncodeImage(framebuffer, ImageFormat::BinaryPPM);
+
+			std::string header = "image 2 " + std::to_string(image.size()) + "\n";
+			int imageIndex = indexOf(header);
+			Assert::IsTrue(imageIndex >= 0);
+			Assert::IsTrue(replies[imageIndex] == header + std::string(image.begin(), image.end()));
+		}
 	};
 }
\ No newline at end of file